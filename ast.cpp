@@ -4,26 +4,23 @@
 #include <stdexcept>
 
 namespace {
-struct operator_info {
-    const char* repr;
-    int precedence;
-    bool is_left_associative;
-};
 
-const operator_info op_infos[] = {
-    { "*", 2, true },
-    { "/", 2, true },
-    { "+", 1, true },
-    { "-", 1, true },
-    { "=", 0, false },
-};
+struct tree_builder {
+    std::unique_ptr<ast::expression> leaf(const lex::token& tok) {
+        if (tok.type() == lex::token_type::literal) {
+            return std::unique_ptr<ast::expression>(new ast::literal_expression{tok});
+        }
+        return std::unique_ptr<ast::expression>(new ast::atom_expression{tok});
+    }
 
-const operator_info* try_get_op_info(const lex::token& t) {
-    for (const auto& i : op_infos) {
-        if (t.str() == i.repr) return &i;
+    std::unique_ptr<ast::expression> prefix(const lex::token& op, std::unique_ptr<ast::expression> operand) {
+        return std::unique_ptr<ast::expression>(new ast::unary_operation{op, std::move(operand)});
     }
-    return nullptr;
-}
+
+    std::unique_ptr<ast::expression> infix(const lex::token& op, std::unique_ptr<ast::expression> lhs, std::unique_ptr<ast::expression> rhs) {
+        return std::unique_ptr<ast::expression>(new ast::binary_operation{std::move(lhs), std::move(rhs), static_cast<char>(op.type())});
+    }
+};
 
 } // unnamed namespace
 
@@ -36,6 +33,17 @@ atom_expression::atom_expression(const lex::token& token) : token_(token) {
     assert(token_.type() == lex::token_type::identifier);
 }
 
+unary_operation::unary_operation(const lex::token& op, std::unique_ptr<expression> operand) : op_(op), operand_(std::move(operand)) {
+    assert(operand_);
+    assert(find_operator(op_.type()) && find_operator(op_.type())->prefix_bp);
+}
+
+std::string unary_operation::repr() const {
+    std::ostringstream oss;
+    oss << "{" << op() << " " << operand().repr() << "}";
+    return oss.str();
+}
+
 binary_expression::binary_expression(std::unique_ptr<expression> lhs, std::unique_ptr<expression> rhs) : lhs_(std::move(lhs)), rhs_(std::move(rhs)) {
     assert(lhs_);
     assert(rhs_);
@@ -55,7 +63,8 @@ std::unique_ptr<expression> parser::parse_expression() {
     while (tokenizer_.current().type() == lex::token_type::separator) {
         tokenizer_.consume();
     }
-    auto e = parse_expression_1(parse_primary_expression(), 0);
+    tree_builder builder;
+    auto e = parse_operators(tokenizer_, 0, builder);
     assert(e);
     while (tokenizer_.current().type() == lex::token_type::separator) {
         tokenizer_.consume();
@@ -63,69 +72,9 @@ std::unique_ptr<expression> parser::parse_expression() {
     return e;
 }
 
-// http://en.wikipedia.org/wiki/Operator-precedence_parser
-std::unique_ptr<expression> parser::parse_expression_1(std::unique_ptr<expression> lhs, int min_precedence) {
-    for (;;) {
-        // while lookahead is a binary operator whose precedence is >= min_precedence
-        auto lookahead = tokenizer_.current();
-        auto lhs_opinfo = try_get_op_info(lookahead);
-        if (!lhs_opinfo) {
-            break;
-        }
-
-        if (lhs_opinfo->precedence < min_precedence) {
-            // Precedence is not >= min_precedence
-            break;
-        }
-
-        tokenizer_.consume();
-
-        std::unique_ptr<expression> rhs = parse_primary_expression();
-        for (;;) {
-            // while lookahead is a binary operator whose precedence is greater
-            // than op's, or a right-associative operator whose precedence is equal to op's
-            lookahead = tokenizer_.current();
-            auto rhs_opinfo = try_get_op_info(lookahead);
-            if (!rhs_opinfo) {
-                break;
-            }
-
-            if (rhs_opinfo->precedence == lhs_opinfo->precedence) {
-                if (rhs_opinfo->is_left_associative) {
-                    break;
-                }
-                // right-associative and equal precedence
-            } else if (rhs_opinfo->precedence < lhs_opinfo->precedence) {
-                break;
-            }
-
-            // the rhs operator has greater precedence (or equal but is right-associative)
-            // recurse
-            rhs = parse_expression_1(std::move(rhs), rhs_opinfo->precedence);
-        }
-
-        // lhs := the result of applying op with operands lhs and rhs
-        lhs = std::unique_ptr<expression>{new binary_operation{std::move(lhs), std::move(rhs), lhs_opinfo->repr[0]}};
-    }
-    return lhs;
-}
-
-std::unique_ptr<expression> parser::parse_primary_expression() {
-    auto tok = tokenizer_.current();
-    if (tok.type() == lex::token_type::literal) {
-        tokenizer_.consume();
-        return std::unique_ptr<expression>(new literal_expression{tok});
-    } else if (tok.type() == lex::token_type::identifier) {
-        tokenizer_.consume();
-        return std::unique_ptr<expression>(new atom_expression{tok});
-    }
-    throw parse_error("Expeceted literal or atom in parse_primary_expression");
-}
-
-std::runtime_error parser::parse_error(const std::string& message) {
-    const auto& tok = tokenizer_.current();
+std::runtime_error parse_error(const lex::token& at, const std::string& message) {
     std::ostringstream oss;
-    oss << "Parse error at " << tok.position() << " (" << tok << " ): " << message;
+    oss << "Parse error at " << at.position() << " (" << at << " ): " << message;
     return std::runtime_error(oss.str());
 }
 
@@ -3,10 +3,103 @@
 
 #include <string>
 #include <memory>
+#include <vector>
+#include <stdexcept>
 #include "lex.h"
 
 namespace ast {
 
+// Binding powers for the Pratt parsers, keyed on the token type. An infix
+// operator parses its right operand with right_bp, left_bp < right_bp makes
+// it left associative. A prefix operator with a closer groups its operand.
+struct operator_info {
+    lex::token_type type;
+    int             left_bp;    // 0 unless infix
+    int             right_bp;
+    int             prefix_bp;  // 0 unless prefix
+    lex::token_type closer;     // eof unless a grouping
+};
+
+constexpr operator_info operator_table[] = {
+    { lex::token_type::op_eq,  1, 1, 0, lex::token_type::eof },
+    { lex::token_type::op_add, 2, 3, 0, lex::token_type::eof },
+    { lex::token_type::op_sub, 2, 3, 6, lex::token_type::eof },
+    { lex::token_type::op_mul, 4, 5, 0, lex::token_type::eof },
+    { lex::token_type::op_div, 4, 5, 0, lex::token_type::eof },
+    { lex::token_type::lparen, 0, 0, 2, lex::token_type::rparen },
+};
+
+constexpr const operator_info* find_operator(lex::token_type t, size_t i = 0) {
+    return i == sizeof(operator_table) / sizeof(*operator_table) ? nullptr
+        : operator_table[i].type == t ? &operator_table[i] : find_operator(t, i + 1);
+}
+
+static_assert(find_operator(lex::token_type::op_mul)->left_bp > find_operator(lex::token_type::op_sub)->right_bp, "* must bind tighter than -");
+static_assert(find_operator(lex::token_type::op_sub)->prefix_bp > find_operator(lex::token_type::op_div)->right_bp, "Unary minus must bind tighter than /");
+static_assert(find_operator(lex::token_type::lparen)->prefix_bp > find_operator(lex::token_type::op_eq)->left_bp, "= can't be inside parentheses");
+
+std::runtime_error parse_error(const lex::token& at, const std::string& message);
+
+// Pratt parsing of the operators in the table, with an explicit stack so
+// deeply nested input can't overflow the call stack. The builder makes
+// the nodes with leaf(token), prefix(op, operand) and infix(op, lhs, rhs).
+template<typename Builder>
+auto parse_operators(lex::tokenizer& tokenizer, int min_bp, Builder& builder) -> decltype(builder.leaf(tokenizer.current())) {
+    typedef decltype(builder.leaf(tokenizer.current())) node;
+    struct frame {
+        lex::token           op;
+        const operator_info* info;
+        bool                 infix;
+        node                 lhs;
+        int                  min_bp;    // of the operand the frame completes
+    };
+    std::vector<frame> stack;
+    for (;;) {
+        // Prefix operators until an operand
+        const auto tok = tokenizer.current();
+        if (tok.type() != lex::token_type::literal && tok.type() != lex::token_type::identifier) {
+            const auto info = find_operator(tok.type());
+            if (!info || !info->prefix_bp) {
+                throw parse_error(tok, "Expected literal, atom or prefix operator");
+            }
+            tokenizer.consume();
+            stack.push_back(frame{tok, info, false, node{}, min_bp});
+            min_bp = info->prefix_bp;
+            continue;
+        }
+        tokenizer.consume();
+        node operand = builder.leaf(tok);
+
+        // Infix operators binding at least min_bp start a right operand,
+        // anything else completes the innermost frame
+        for (;;) {
+            const auto op = tokenizer.current();
+            const auto info = find_operator(op.type());
+            if (info && info->left_bp && info->left_bp >= min_bp) {
+                tokenizer.consume();
+                stack.push_back(frame{op, info, true, std::move(operand), min_bp});
+                min_bp = info->right_bp;
+                break;
+            }
+            if (stack.empty()) {
+                return operand;
+            }
+            frame f = std::move(stack.back());
+            stack.pop_back();
+            min_bp = f.min_bp;
+            if (f.infix) {
+                operand = builder.infix(f.op, std::move(f.lhs), std::move(operand));
+            } else if (f.info->closer == lex::token_type::eof) {
+                operand = builder.prefix(f.op, std::move(operand));
+            } else if (tokenizer.current().type() == f.info->closer) {
+                tokenizer.consume();
+            } else {
+                throw parse_error(tokenizer.current(), "Expected closing " + std::string(1, static_cast<char>(f.info->closer)));
+            }
+        }
+    }
+}
+
 class expression {
 public:
     virtual ~expression() {}
@@ -41,6 +134,21 @@ private:
     lex::token token_;
 };
 
+class unary_operation : public expression {
+public:
+    unary_operation(const lex::token& op, std::unique_ptr<expression> operand);
+
+    const expression& operand() const { return *operand_; }
+    char op() const { return static_cast<char>(op_.type()); }
+
+    virtual std::string repr() const override;
+    virtual const lex::token& start_token() const override { return op_; }
+    virtual const lex::token& end_token() const override { return operand_->end_token(); }
+private:
+    lex::token                  op_;
+    std::unique_ptr<expression> operand_;
+};
+
 class binary_expression : public expression {
 public:
     const expression& lhs() const { return *lhs_; }
@@ -79,9 +187,6 @@ private:
     const source::file& src_;
     lex::tokenizer      tokenizer_;
 
-    std::unique_ptr<expression> parse_expression_1(std::unique_ptr<expression> lhs, int min_precedence);
-    std::unique_ptr<expression> parse_primary_expression();
-    std::runtime_error parse_error(const std::string& message);
 };
 
 } // namespace ast
@@ -39,6 +39,20 @@ expr_verifier atom(const std::string& s) {
 }
 
 
+expr_verifier unary_op(char op, const expr_verifier& operand) {
+    return [=](const ast::expression& e) {
+        if (auto l = dynamic_cast<const ast::unary_operation*>(&e)) {
+            if (l->op() == op) {
+                operand(l->operand());
+                return;
+            }
+        }
+        std::cout << "Expected unary operator " << op << " got:" << std::endl;
+        print_expression(e);
+        assert(false);
+    };
+}
+
 expr_verifier bin_op(char op, const expr_verifier& lhs, const expr_verifier& rhs) {
     return [=](const ast::expression& e) {
         if (auto l = dynamic_cast<const ast::binary_operation*>(&e)) {
@@ -97,6 +111,23 @@ void ast_test()
     run_one("bind", "zzz=20", bin_op('=', atom("zzz"), lit(20)));
     run_one("bind2", "a=b=c", bin_op('=', atom("a"), bin_op('=', atom("b"), atom("c"))));
     run_one("bind with expr", "x=1+2", bin_op('=', atom("x"), bin_op('+', lit(1), lit(2))));
+    run_one("parentheses", "(1+2)*3", bin_op('*', bin_op('+', lit(1), lit(2)), lit(3)));
+    run_one("nested parentheses", "((x))/(y-(2))", bin_op('/', atom("x"), bin_op('-', atom("y"), lit(2))));
+    run_one("unary minus", "-x*2", bin_op('*', unary_op('-', atom("x")), lit(2)));
+    run_one("unary after binary", "1--2", bin_op('-', lit(1), unary_op('-', lit(2))));
+    run_one("unary of group", "x=-(a+b)", bin_op('=', atom("x"), unary_op('-', bin_op('+', atom("a"), atom("b")))));
+    // = only binds outside of parentheses
+    for (const char* text : { "x=(y=2)", "(a=b)" }) {
+        source::file src{text, text};
+        ast::parser p{src};
+        bool thrown = false;
+        try {
+            p.parse_expression();
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
 
     run_many("multiple lines", R"(
         2+xx
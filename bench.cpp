@@ -0,0 +1,565 @@
+// Micro benchmarks, run with "make bench" (ideally with OPTIMIZED=1)
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <string>
+#include <algorithm>
+#include "parse.h"
+#include "serialize.h"
+#include "eval.h"
+#include "jit.h"
+#include "solver.h"
+#include "equations.h"
+#include "server.h"
+#include "scheduler.h"
+#include "rule_profile.h"
+#include "static_solve.h"
+#include <thread>
+#include <unistd.h>
+#include <pthread.h>
+
+namespace {
+
+// Random infix source the parser understands: no parentheses and no
+// unary minus, precedence still gives the parsed trees some shape
+std::string random_source(std::mt19937& rng, int terms) {
+    static const char* const names[] = { "x", "y", "z", "alpha", "beta", "gamma" };
+    static const char* const ops[] = { " + ", " - ", " * ", " / " };
+    std::ostringstream os;
+    for (int i = 0; i < terms; ++i) {
+        if (i) {
+            os << ops[rng() % 4];
+        }
+        if (rng() % 2) {
+            os << names[rng() % 6];
+        } else {
+            os << static_cast<double>(rng() % 1000) / 8;
+        }
+    }
+    return os.str();
+}
+
+expr_ptr parse(const std::string& text) {
+    source::file src{"<bench>", text};
+    ast::parser p{src};
+    return ast_to_expr(*p.parse_expression());
+}
+
+template<typename F>
+void run(const std::string& name, size_t items, size_t bytes, F f) {
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+    int rounds = 0;
+    double seconds;
+    do {
+        f();
+        ++rounds;
+        seconds = std::chrono::duration<double>(clock::now() - start).count();
+    } while (seconds < 0.5);
+    std::ostringstream os;
+    os << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(0);
+    os << std::setw(12) << items * rounds / seconds << " items/s";
+    os << std::setprecision(1) << std::setw(10) << bytes * rounds / seconds / 1e6 << " MB/s\n";
+    std::cout << os.str();
+}
+
+void serialize_bench() {
+    std::mt19937 rng{42};
+    std::vector<expr_ptr> exprs;
+    std::vector<std::string> texts, binaries;
+    size_t text_bytes = 0, binary_bytes = 0;
+    for (int i = 0; i < 1000; ++i) {
+        texts.push_back(random_source(rng, 40));
+        exprs.push_back(parse(texts.back()));
+        binaries.push_back(serialize::encode(*exprs.back()));
+        text_bytes += texts.back().size();
+        binary_bytes += binaries.back().size();
+    }
+    std::cout << "serialize: " << exprs.size() << " expressions, text " << text_bytes << " bytes, binary " << binary_bytes << " bytes\n";
+
+    size_t sink = 0;
+    run("text print", exprs.size(), text_bytes, [&] {
+        for (const auto& e : exprs) {
+            std::ostringstream os;
+            os << e;
+            sink += os.str().size();
+        }
+    });
+    run("text parse", exprs.size(), text_bytes, [&] {
+        for (const auto& t : texts) {
+            sink += parse(t)->hash();
+        }
+    });
+    run("binary encode", exprs.size(), binary_bytes, [&] {
+        for (const auto& e : exprs) {
+            sink += serialize::encode(*e).size();
+        }
+    });
+    run("binary decode", exprs.size(), binary_bytes, [&] {
+        for (const auto& b : binaries) {
+            sink += serialize::decode_expr(b)->hash();
+        }
+    });
+    run("binary validate", exprs.size(), binary_bytes, [&] {
+        for (const auto& b : binaries) {
+            sink += serialize::reader{b}.size();
+        }
+    });
+    if (sink == 42) std::cout << "";
+}
+
+// Lines per second for the two front ends, alone and followed by the
+// solving and printing do_file does with the result
+void parse_bench() {
+    std::mt19937 rng{42};
+    std::vector<std::string> lines, short_lines;
+    size_t bytes = 0, short_bytes = 0;
+    for (int i = 0; i < 1000; ++i) {
+        lines.push_back("result = " + random_source(rng, 40));
+        bytes += lines.back().size();
+        short_lines.push_back("x = " + random_source(rng, 6));
+        short_bytes += short_lines.back().size();
+    }
+    std::cout << "parse: " << lines.size() << " lines of 40 terms\n";
+
+    auto via_ast = [](const std::string& line) {
+        source::file src{"<bench>", line};
+        ast::parser p{src};
+        auto e = p.parse_expression();
+        auto top = dynamic_cast<const ast::binary_operation*>(&*e);
+        return std::make_pair(ast_to_expr(top->lhs()), ast_to_expr(top->rhs()));
+    };
+    auto direct = [](const std::string& line) {
+        source::file src{"<bench>", line};
+        return parse_equation(src);
+    };
+
+    size_t sink = 0;
+    run("ast parse", lines.size(), bytes, [&] {
+        for (const auto& l : lines) {
+            sink += via_ast(l).second->hash();
+        }
+    });
+    run("direct parse", lines.size(), bytes, [&] {
+        for (const auto& l : lines) {
+            sink += direct(l).second->hash();
+        }
+    });
+
+    // The solver traces to cout
+    std::ostringstream out;
+    auto end_to_end = [&](const std::string& line, std::pair<expr_ptr, expr_ptr> (*parse)(const std::string&)) {
+        const auto eq = parse(line);
+        for (const auto& s : solver::solve_all(*eq.first, *eq.second)) {
+            out << s.first << " = " << s.second << "\n";
+        }
+    };
+    std::cout << "parse: " << short_lines.size() << " lines of 6 terms, solved\n";
+    for (const auto& front_end : { std::make_pair("ast + solve", +via_ast), std::make_pair("direct + solve", +direct) }) {
+        run(front_end.first, short_lines.size(), short_bytes, [&] {
+            auto old = std::cout.rdbuf(out.rdbuf());
+            for (const auto& l : short_lines) {
+                end_to_end(l, front_end.second);
+            }
+            std::cout.rdbuf(old);
+            out.str("");
+        });
+    }
+    if (sink == 42) std::cout << "";
+}
+
+double tree_eval(const expr& e, double y) {
+    if (auto c = expr_cast<const_expr>(e)) return c->value();
+    if (expr_cast<var_expr>(e)) return y;
+    if (auto ne = expr_cast<negation_expr>(e)) return -tree_eval(ne->e(), y);
+    auto be = expr_cast<bin_op_expr>(e);
+    const auto l = tree_eval(be->lhs(), y), r = tree_eval(be->rhs(), y);
+    switch (be->op()) {
+    case '+': return l + r;
+    case '-': return l - r;
+    case '*': return l * r;
+    default:  return l / r;
+    }
+}
+
+// Bytes moved are the input column read and the output written
+void eval_bench() {
+    const size_t rows = 10000000;
+    const auto solution = (var("y") - constant(10)) / constant(4);
+    std::vector<double> y(rows), out(rows);
+    for (size_t r = 0; r < rows; ++r) {
+        y[r] = static_cast<double>(r);
+    }
+    std::cout << "eval: " << solution << " over " << rows << " rows\n";
+
+    run("copy (bandwidth)", rows, rows * 16, [&] { std::copy(y.begin(), y.end(), out.begin()); });
+    run("tree walk", rows, rows * 16, [&] {
+        for (size_t r = 0; r < rows; ++r) {
+            out[r] = tree_eval(*solution, y[r]);
+        }
+    });
+    const eval::program p{*solution, {"y"}};
+    const double* columns[] = { y.data() };
+    for (auto which : { eval::isa::scalar, eval::isa::sse2, eval::isa::avx }) {
+        if (!eval::supported(which)) continue;
+        std::ostringstream name;
+        name << "program " << which;
+        run(name.str(), rows, rows * 16, [&] { p.run(columns, rows, out.data(), which); });
+    }
+}
+
+// One call per row, as when evaluating a formula inside other code
+void jit_bench() {
+    const size_t rows = 10000000;
+    const auto solution = -(var("y") * var("y") - constant(3) * var("y")) / (var("y") + constant(10));
+    std::vector<double> y(rows);
+    for (size_t r = 0; r < rows; ++r) {
+        y[r] = static_cast<double>(r);
+    }
+    std::cout << "jit: " << solution << " over " << rows << " rows\n";
+
+    double sum = 0;
+    run("tree walk", rows, rows * 8, [&] {
+        for (size_t r = 0; r < rows; ++r) {
+            sum += tree_eval(*solution, y[r]);
+        }
+    });
+    const eval::program p{*solution, {"y"}};
+    run("program per row", rows, rows * 8, [&] {
+        for (size_t r = 0; r < rows; ++r) {
+            sum += p(&y[r]);
+        }
+    });
+    const jit::function f{*solution, {"y"}};
+    run(f.native() ? "native" : "native (interpreted)", rows, rows * 8, [&] {
+        for (size_t r = 0; r < rows; ++r) {
+            sum += f(&y[r]);
+        }
+    });
+    if (sum == 42) std::cout << "";
+}
+
+// A formula fixed in the code, solved on each call or by the compiler
+void static_solve_bench() {
+    const size_t rows = 10000000;
+    namespace ss = static_solve;
+    constexpr auto x = ss::var<'x'>();
+    constexpr auto y = ss::var<'y'>();
+    constexpr auto lhs = (x + ss::constant(3)) * ss::constant(4) - ss::constant(2);
+    constexpr auto solution = ss::solve(x, lhs, y);
+    std::cout << "static solve: " << solution.to_expr() << " over " << rows << " rows\n";
+
+    solve_options options;
+    options.trace = nullptr;
+    const auto l = lhs.to_expr(), r = y.to_expr();
+    double sum = 0;
+    run("solve and tree walk", 1, 0, [&] {
+        sum += tree_eval(*solver::solve("x", *l, *r, options).solution, 1);
+    });
+    std::vector<double> ys(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        ys[i] = static_cast<double>(i);
+    }
+    run("static eval", rows, rows * 8, [&] {
+        for (size_t i = 0; i < rows; ++i) {
+            sum += solution.eval(y.is(ys[i]));
+        }
+    });
+    if (sum == 42) std::cout << "";
+}
+
+// A chain x0*x0 = p, x(i)*x(i) = x(i-1) + p re-solved for many p, the
+// Jacobian is compiled once
+void system_bench() {
+    const size_t n = 20, solves = 1000;
+    std::vector<equation_system::equation> equations;
+    std::vector<std::string> unknowns;
+    for (size_t i = 0; i < n; ++i) {
+        unknowns.push_back("x" + std::string(1, static_cast<char>('a' + i)));
+        const auto x = [&] { return var(unknowns.back()); };
+        equations.emplace_back(x() * x(), i ? var(unknowns[i - 1]) + var("p") : var("p"));
+    }
+    const auto start = std::chrono::steady_clock::now();
+    const equation_system system{equations, unknowns, {"p"}};
+    const double compile = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "system: " << n << " equations, " << system.jacobian_nonzeros() << " Jacobian nonzeros, compiled in " << compile * 1e3 << " ms\n";
+
+    unsigned iterations = 0, converged = 0;
+    run("newton solve", solves, 0, [&] {
+        iterations = converged = 0;
+        for (size_t i = 0; i < solves; ++i) {
+            const auto r = system.solve(std::vector<double>(n, 1), {1 + i / 100.0});
+            iterations += r.iterations;
+            converged += r.converged;
+        }
+    });
+    std::cout << "  " << converged << "/" << solves << " converged, " << static_cast<double>(iterations) / solves << " iterations per solve\n";
+}
+
+// Requests over the socket: one at a time from one client, then pipelined
+// from several so the workers get batches
+void server_bench() {
+    const std::string path = "/tmp/solve_bench." + std::to_string(getpid()) + ".sock";
+    server_options options;
+    options.workers = std::max(1u, std::thread::hardware_concurrency());
+    solve_server server{path, options};
+    std::thread serving{&solve_server::run, &server};
+    std::cout << "server: " << options.workers << " workers\n";
+
+    const size_t lines = 256, clients = 8;
+    std::vector<std::string> requests;
+    for (size_t i = 0; i < lines; ++i) {
+        requests.push_back("X*" + std::to_string(i % 17 + 2) + "+3=" + std::to_string(i));
+    }
+    size_t sink = 0;
+    {
+        server_client client{path};
+        run("one at a time", lines, 0, [&] {
+            for (const auto& r : requests) sink += client.request(r).size();
+        });
+    }
+    std::vector<std::unique_ptr<server_client>> connections;
+    for (size_t c = 0; c < clients; ++c) {
+        connections.emplace_back(new server_client{path});
+    }
+    const size_t before = server.requests(), batches_before = server.batches();
+    run("pipelined, 8 clients", lines * clients, 0, [&] {
+        std::vector<std::thread> threads;
+        for (auto& c : connections) {
+            threads.emplace_back([&] { c->request(requests); });
+        }
+        for (auto& t : threads) t.join();
+    });
+    std::cout << "  " << static_cast<double>(server.requests() - before) / (server.batches() - batches_before) << " requests per batch\n";
+    if (sink == 42) std::cout << "";
+    connections.clear();
+    server.stop();
+    serving.join();
+}
+
+class counting_allocator : public expr_allocator {
+public:
+    counting_allocator() : allocations(0) {}
+    virtual void* allocate(size_t size) override { ++allocations; return ::operator new(size); }
+    virtual void deallocate(void* p, size_t) override { ::operator delete(p); }
+    size_t allocations;
+};
+
+// Best first searches that take a while to isolate the variable: how many
+// expression nodes each solve allocates
+std::vector<job_type> search_equations() {
+    std::vector<job_type> equations;
+    equations.emplace_back(var("a") * var("b") + var("c") * var("d") - var("e") / var("f"), var("g") + var("h") * var("i"));
+    equations.emplace_back((var("x") + constant(3)) * (var("y") - constant(2)) / var("z"), var("w") * constant(4) + constant(1));
+    equations.emplace_back(-(var("p") - var("q") * constant(2)) / (var("r") + constant(1)), constant(7) - var("s") * var("t"));
+    equations.emplace_back(((var("k") + var("l")) * var("m") - var("n")) / (var("o") + var("u") * (var("v") - var("j"))), (var("A") - var("B")) * var("C"));
+    return equations;
+}
+
+void search_bench() {
+    const auto equations = search_equations();
+    size_t solves = 0;
+    for (const auto& eq : equations) {
+        for (const auto* side : { &eq.first, &eq.second }) {
+            const auto vars = find_vars_in_expr(**side);
+            solves += vars.size();
+        }
+    }
+    solve_options quiet;
+    quiet.trace = nullptr;
+    counting_allocator counter;
+    size_t expanded = 0, solved = 0;
+    std::cout << "search: " << solves << " best first solves\n";
+    run("solve", solves, 0, [&] {
+        expr_allocator::scope scope{&counter};
+        counter.allocations = expanded = solved = 0;
+        for (const auto& eq : equations) {
+            for (const auto* side : { &eq.first, &eq.second }) {
+                for (const auto& v : find_vars_in_expr(**side)) {
+                    const auto r = solver::solve(v, *eq.first, *eq.second, quiet);
+                    expanded += r.expanded;
+                    solved += r.status == solve_status::solved;
+                }
+            }
+        }
+    });
+    std::cout << "  " << solved << " solved, " << expanded / solves << " jobs expanded and " << counter.allocations / solves << " nodes allocated per solve\n";
+}
+
+// The search with a profile trained on the same equations, saved and
+// loaded the way a production run would start
+void profile_bench() {
+    const auto equations = search_equations();
+    auto solve_each = [&](const solve_options& options, size_t& expanded, size_t& solved) {
+        expanded = solved = 0;
+        for (const auto& eq : equations) {
+            for (const auto* side : { &eq.first, &eq.second }) {
+                for (const auto& v : find_vars_in_expr(**side)) {
+                    const auto r = solver::solve(v, *eq.first, *eq.second, options);
+                    expanded += r.expanded;
+                    solved += r.status == solve_status::solved;
+                }
+            }
+        }
+    };
+    solve_options options;
+    options.trace = nullptr;
+    size_t expanded, solved;
+    rule_profile trained;
+    options.profile = &trained;
+    solve_each(options, expanded, solved);
+    std::stringstream saved;
+    trained.save(saved);
+    std::cout << "profile: trained on " << trained.solves() << " solves\n";
+
+    for (const bool use : { false, true }) {
+        rule_profile loaded;
+        loaded.load(saved);
+        saved.clear();
+        saved.seekg(0);
+        options.profile = use ? &loaded : nullptr;
+        run(use ? "with profile" : "without profile", trained.solves(), 0, [&] { solve_each(options, expanded, solved); });
+        std::cout << "  " << solved << " solved, " << double(expanded) / trained.solves() << " jobs expanded per solve\n";
+    }
+}
+
+// An equation in dozens of variables solved for all of them
+void solve_all_bench() {
+    const size_t n = 24;
+    expr_ptr lhs;
+    for (size_t i = 0; i + 1 < n; i += 2) {
+        auto term = var("v" + std::to_string(i)) * var("v" + std::to_string(i + 1));
+        lhs = lhs ? std::move(lhs) + std::move(term) : std::move(term);
+    }
+    const auto rhs = var("w") + constant(1);
+    std::cout << "solve_all: " << n + 1 << " variables, " << std::thread::hardware_concurrency() << " cores\n";
+    size_t solved = 0;
+    run("sequential", n + 1, 0, [&] { solved = solver::solve_all(*lhs, *rhs, nullptr).size(); });
+    std::cout << "  " << solved << " solved\n";
+    run("parallel, 1 thread", n + 1, 0, [&] { solved = solver::solve_all_parallel(*lhs, *rhs, 1).size(); });
+    run("parallel, 1 per core", n + 1, 0, [&] { solved = solver::solve_all_parallel(*lhs, *rhs).size(); });
+    std::cout << "  " << solved << " solved\n";
+}
+
+// Easy equations queued among hard ones on one thread: latency of the easy
+// ones from submission to completion under each policy
+void scheduler_bench() {
+    const size_t easy = 200, hard_every = 10;
+    std::cout << "scheduler: " << easy << " easy solves, a hard one before every " << hard_every << "\n";
+    const std::pair<schedule_policy, const char*> policies[] = {
+        { schedule_policy::in_order, "in order" },
+        { schedule_policy::least_expanded, "least expanded" },
+    };
+    for (const auto& p : policies) {
+        scheduler_options options;
+        options.policy = p.first;
+        solve_scheduler scheduler{options};
+        solve_options quiet;
+        quiet.trace = nullptr;
+        solve_options hard = quiet;
+        hard.max_jobs = 500;
+        std::vector<bool> is_easy;
+        std::vector<double> latencies;
+        const auto start = std::chrono::steady_clock::now();
+        const auto done = [&](size_t id, solve_result&) {
+            if (is_easy[id]) latencies.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        };
+        for (size_t i = 0; i < easy; ++i) {
+            if (i % hard_every == 0) {
+                scheduler.submit("x", *(var("x") * var("y") + var("y") * var("x") * var("x")), *constant(10), hard, done);
+                is_easy.push_back(false);
+            }
+            scheduler.submit("x", *(var("x") * constant(i + 2.0) + var("y")), *var("z"), quiet, done);
+            is_easy.push_back(true);
+        }
+        scheduler.run();
+        const double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::sort(latencies.begin(), latencies.end());
+        std::ostringstream os;
+        os << std::left << std::setw(28) << p.second << std::right << std::fixed << std::setprecision(2);
+        os << "p50 " << latencies[latencies.size() / 2] * 1e3 << " ms, p99 " << latencies[latencies.size() * 99 / 100] * 1e3 << " ms, all done in " << total * 1e3 << " ms\n";
+        std::cout << os.str();
+    }
+}
+
+// do_file's steps on a machine generated line
+size_t solve_line(const std::string& line) {
+    source::file src{"<stress>", line};
+    const auto eq = parse_equation(src);
+    std::ostringstream out;
+    auto old = std::cout.rdbuf(out.rdbuf());
+    for (const auto& s : solver::solve_all(*eq.first, *eq.second)) {
+        out << s.first << " = " << s.second << "\n";
+    }
+    std::cout.rdbuf(old);
+    return out.str().size();
+}
+
+// Huge expressions must take linear time, and the passes must not recurse
+// (this runs on a thread with a small stack)
+void stress_bench() {
+    for (const size_t n : { 100000, 1000000 }) {
+        std::string chain = "x*3";
+        for (size_t i = 1; i < n; ++i) {
+            chain += " + " + std::to_string(i % 10);
+        }
+        chain += " = 0";
+        std::string nested(n, '(');
+        nested += "x";
+        for (size_t i = 0; i < n; ++i) {
+            nested += i % 2 ? " - 1)" : " + 1)";
+        }
+        nested += " = -5";
+        std::cout << "stress: " << n << " terms\n";
+
+        size_t sink = 0;
+        run("do_file chain", n, chain.size(), [&] { sink += solve_line(chain); });
+        run("do_file nested", n, nested.size(), [&] { sink += solve_line(nested); });
+
+        source::file src{"<stress>", chain};
+        const auto e = parse_equation(src).first;
+        const size_t nodes = node_count(*e);
+        run("clone and destroy", nodes, 0, [&] { sink += !!e->clone(); });
+        const auto copy = e->clone();
+        run("equal", nodes, 0, [&] { sink += e->equal(*copy); });
+        run("hash", nodes, 0, [&] { sink += e->hash(); });
+        run("print", nodes, 0, [&] { std::ostringstream os; os << e; sink += os.str().size(); });
+        run("simplify", nodes, 0, [&] { sink += !!simplify(*e); });
+        run("depth", nodes, 0, [&] { sink += depth(*e); });
+        run("find vars", nodes, 0, [&] { sink += find_vars_in_expr(*e).size(); });
+        if (sink == 42) std::cout << "";
+    }
+}
+
+void* stress_thread(void*) {
+    stress_bench();
+    return nullptr;
+}
+
+} // unnamed namespace
+
+int main() {
+    serialize_bench();
+    parse_bench();
+    eval_bench();
+    jit_bench();
+    static_solve_bench();
+    system_bench();
+    server_bench();
+    scheduler_bench();
+    solve_all_bench();
+    search_bench();
+    profile_bench();
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 1 << 20);
+    pthread_t stress;
+    if (pthread_create(&stress, &attr, stress_thread, nullptr) == 0) {
+        pthread_join(stress, nullptr);
+    }
+    pthread_attr_destroy(&attr);
+}
@@ -0,0 +1,227 @@
+#include "cache.h"
+#include <stdexcept>
+#include <vector>
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+
+const char     magic[8] = { 'S', 'O', 'L', 'V', 'C', 'A', 'C', 'H' };
+const uint32_t version  = 1;
+
+// magic, version, reserved
+const size_t header_size = sizeof(magic) + 2 * sizeof(uint32_t);
+// key length, value length, checksum of key and value
+const size_t record_header_size = 2 * sizeof(uint32_t) + sizeof(uint64_t);
+
+// FNV-1a
+uint64_t checksum(const char* data, size_t length, uint64_t h = 14695981039346656037ULL) {
+    for (size_t i = 0; i < length; ++i) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+uint64_t record_checksum(const char* key, size_t key_length, const char* value, size_t value_length) {
+    return checksum(value, value_length, checksum(key, key_length));
+}
+
+template<typename T>
+T read_raw(const char* p) {
+    T x;
+    memcpy(&x, p, sizeof(T));
+    return x;
+}
+
+template<typename T>
+void append_raw(std::vector<char>& buf, T x) {
+    const char* p = reinterpret_cast<const char*>(&x);
+    buf.insert(buf.end(), p, p + sizeof(T));
+}
+
+std::runtime_error system_error(const std::string& what, const std::string& filename) {
+    return std::runtime_error(what + " failed for " + filename + ": " + strerror(errno));
+}
+
+class file_lock {
+public:
+    file_lock(int fd, int operation) : fd_(fd) {
+        while (flock(fd_, operation) != 0) {
+            if (errno != EINTR) {
+                throw std::runtime_error(std::string("flock failed: ") + strerror(errno));
+            }
+        }
+    }
+    ~file_lock() {
+        flock(fd_, LOCK_UN);
+    }
+private:
+    int fd_;
+    file_lock(const file_lock&) = delete;
+    file_lock& operator=(const file_lock&) = delete;
+};
+
+} // unnamed namespace
+
+namespace cache {
+
+store::store(const std::string& filename) : filename_(filename), fd_(-1), map_(nullptr), map_length_(0), valid_length_(header_size) {
+    fd_ = open(filename.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        throw system_error("open", filename);
+    }
+    try {
+        file_lock lock{fd_, LOCK_EX};
+        struct stat st;
+        if (fstat(fd_, &st) != 0) {
+            throw system_error("fstat", filename);
+        }
+        if (st.st_size == 0) {
+            std::vector<char> header(magic, magic + sizeof(magic));
+            append_raw(header, version);
+            append_raw(header, uint32_t(0));
+            if (write(fd_, header.data(), header.size()) != static_cast<ssize_t>(header.size())) {
+                throw system_error("write", filename);
+            }
+        } else if (static_cast<size_t>(st.st_size) < header_size) {
+            throw std::runtime_error(filename + " is not a solution cache (too short)");
+        }
+        remap(header_size);
+        if (memcmp(map_, magic, sizeof(magic)) != 0) {
+            throw std::runtime_error(filename + " is not a solution cache (bad magic)");
+        }
+        if (read_raw<uint32_t>(map_ + sizeof(magic)) != version) {
+            throw std::runtime_error(filename + " has an unsupported solution cache version");
+        }
+    } catch (...) {
+        if (map_) munmap(const_cast<char*>(map_), map_length_);
+        close(fd_);
+        throw;
+    }
+    refresh();
+}
+
+store::~store() {
+    if (map_) {
+        munmap(const_cast<char*>(map_), map_length_);
+    }
+    close(fd_);
+}
+
+bool store::find(const std::string& key, std::string& value) {
+    if (lookup(key, value)) {
+        return true;
+    }
+    refresh();
+    return lookup(key, value);
+}
+
+void store::insert(const std::string& key, const std::string& value) {
+    std::vector<char> record;
+    record.reserve(record_header_size + key.size() + value.size());
+    append_raw(record, static_cast<uint32_t>(key.size()));
+    append_raw(record, static_cast<uint32_t>(value.size()));
+    append_raw(record, record_checksum(key.data(), key.size(), value.data(), value.size()));
+    record.insert(record.end(), key.begin(), key.end());
+    record.insert(record.end(), value.begin(), value.end());
+
+    file_lock lock{fd_, LOCK_EX};
+    scan();
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        throw system_error("fstat", filename_);
+    }
+    if (static_cast<size_t>(st.st_size) > valid_length_) {
+        // A writer died half way through a record. Readers only scan
+        // under a shared lock and never touch bytes past the last valid
+        // record, so the torn tail can be dropped.
+        if (ftruncate(fd_, valid_length_) != 0) {
+            throw system_error("ftruncate", filename_);
+        }
+    }
+    for (size_t written = 0; written < record.size();) {
+        const auto res = write(fd_, record.data() + written, record.size() - written);
+        if (res < 0) {
+            if (errno == EINTR) continue;
+            throw system_error("write", filename_);
+        }
+        written += res;
+    }
+    scan();
+}
+
+void store::remap(size_t length) {
+    if (length <= map_length_) {
+        return;
+    }
+    if (map_) {
+        munmap(const_cast<char*>(map_), map_length_);
+        map_ = nullptr;
+        map_length_ = 0;
+    }
+    void* p = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd_, 0);
+    if (p == MAP_FAILED) {
+        throw system_error("mmap", filename_);
+    }
+    map_ = static_cast<const char*>(p);
+    map_length_ = length;
+}
+
+void store::refresh() {
+    file_lock lock{fd_, LOCK_SH};
+    scan();
+}
+
+// Index the complete records appended since the last scan. Must be called
+// with the file locked.
+void store::scan() {
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        throw system_error("fstat", filename_);
+    }
+    const size_t length = st.st_size;
+    if (length <= valid_length_) {
+        return;
+    }
+    remap(length);
+    while (valid_length_ + record_header_size <= length) {
+        const char* const rec = map_ + valid_length_;
+        const size_t key_length   = read_raw<uint32_t>(rec);
+        const size_t value_length = read_raw<uint32_t>(rec + sizeof(uint32_t));
+        const size_t total        = record_header_size + key_length + value_length;
+        if (total > length - valid_length_) {
+            break;
+        }
+        const char* const key = rec + record_header_size;
+        if (read_raw<uint64_t>(rec + 2 * sizeof(uint32_t)) != record_checksum(key, key_length, key + key_length, value_length)) {
+            break;
+        }
+        index_[checksum(key, key_length)] = valid_length_;
+        valid_length_ += total;
+    }
+}
+
+bool store::lookup(const std::string& key, std::string& value) const {
+    auto it = index_.find(checksum(key.data(), key.size()));
+    if (it == index_.end()) {
+        return false;
+    }
+    const char* const rec = map_ + it->second;
+    const size_t key_length   = read_raw<uint32_t>(rec);
+    const size_t value_length = read_raw<uint32_t>(rec + sizeof(uint32_t));
+    const char* const k = rec + record_header_size;
+    if (key_length != key.size() || memcmp(k, key.data(), key_length) != 0) {
+        return false;
+    }
+    value.assign(k + key_length, value_length);
+    return true;
+}
+
+} // namespace cache
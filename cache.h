@@ -0,0 +1,54 @@
+#ifndef SOLVE_CACHE_H
+#define SOLVE_CACHE_H
+
+#include <string>
+#include <unordered_map>
+#include <stdint.h>
+
+namespace cache {
+
+// Persistent key/value store backed by an append-only file.
+//
+// Any number of processes may open the same file. Records are appended
+// under an exclusive flock() and each carries its length and a checksum,
+// readers map the file and index new records under a shared lock, so a
+// reader never sees a partially written record. Inserting an existing key
+// appends a new record which shadows the old one. Records appended by
+// others are picked up on a failed lookup or an explicit refresh().
+class store {
+public:
+    explicit store(const std::string& filename);
+    ~store();
+
+    const std::string& filename() const { return filename_; }
+
+    // Number of records indexed so far
+    size_t size() const { return index_.size(); }
+
+    // Look up key, picking up records appended by others if necessary
+    bool find(const std::string& key, std::string& value);
+
+    void insert(const std::string& key, const std::string& value);
+
+    // Index records appended by others
+    void refresh();
+
+private:
+    const std::string                      filename_;
+    int                                    fd_;
+    const char*                            map_;
+    size_t                                 map_length_;
+    size_t                                 valid_length_; // end of the last valid record
+    std::unordered_map<uint64_t, size_t>   index_;        // key hash -> record offset
+
+    void remap(size_t length);
+    void scan();
+    bool lookup(const std::string& key, std::string& value) const;
+
+    store(const store&) = delete;
+    store& operator=(const store&) = delete;
+};
+
+} // namespace cache
+
+#endif
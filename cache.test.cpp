@@ -0,0 +1,91 @@
+#include "cache.h"
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace {
+
+std::string temp_filename() {
+    char name[] = "/tmp/solve_cache_test_XXXXXX";
+    const int fd = mkstemp(name);
+    assert(fd >= 0);
+    close(fd);
+    unlink(name);
+    return name;
+}
+
+void expect_value(cache::store& s, const std::string& key, const char* expected) {
+    std::string value;
+    const bool found = s.find(key, value);
+    if (expected ? found && value == expected : !found) {
+        return;
+    }
+    std::cerr << "Cache lookup of '" << key << "' in " << s.filename() << " failed.\n";
+    std::cerr << "Expected: " << (expected ? expected : "<missing>") << "\n";
+    std::cerr << "Got: " << (found ? value : "<missing>") << std::endl;
+    assert(false);
+}
+
+} // unnamed namespace
+
+void cache_test() {
+    const auto filename = temp_filename();
+    {
+        cache::store a{filename};
+        expect_value(a, "x", nullptr);
+        a.insert("x", "42");
+        a.insert("empty", "");
+        a.insert(std::string("nul\0key", 7), "v");
+        expect_value(a, "x", "42");
+        expect_value(a, "empty", "");
+        expect_value(a, std::string("nul\0key", 7), "v");
+        expect_value(a, "nul", nullptr);
+
+        // A second writer on the same file
+        cache::store b{filename};
+        expect_value(b, "x", "42");
+        b.insert("y", "hello");
+        expect_value(a, "y", "hello");
+
+        // Newer records shadow older ones
+        a.insert("x", "43");
+        expect_value(a, "x", "43");
+        expect_value(b, "x", "42");
+        b.refresh();
+        expect_value(b, "x", "43");
+    }
+    {
+        // A writer died half way through a record
+        std::ofstream f{filename, std::ios::app | std::ios::binary};
+        f.write("\x05\0\0\0\x05\0\0\0garbage", 15);
+    }
+    {
+        cache::store a{filename};
+        expect_value(a, "x", "43");
+        expect_value(a, "y", "hello");
+        assert(a.size() == 4);
+        a.insert("z", "after torn record");
+        expect_value(a, "z", "after torn record");
+    }
+    {
+        cache::store a{filename};
+        expect_value(a, "z", "after torn record");
+    }
+    unlink(filename.c_str());
+
+    {
+        std::ofstream f{filename};
+        f << "not a cache file";
+    }
+    bool thrown = false;
+    try {
+        cache::store a{filename};
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+    unlink(filename.c_str());
+}
@@ -0,0 +1,142 @@
+#include "cse.h"
+#include <tuple>
+#include <stdexcept>
+#include <string.h>
+
+namespace {
+
+const size_t none = static_cast<size_t>(-1);
+
+// Structurally equal subexpressions get the same number, children are
+// numbered before their parents
+class value_numbering {
+public:
+    struct node {
+        const expr* e;
+        size_t      lhs;   // or the operand of a negation, none for leaves
+        size_t      rhs;
+    };
+    const std::vector<node>& nodes() const { return nodes_; }
+
+    size_t number(const expr& e) {
+        key k{0, 0, none, none, 0, std::string{}};
+        if (auto c = expr_cast<const_expr>(e)) {
+            const double value = c->value();
+            memcpy(&std::get<4>(k), &value, sizeof(value));
+        } else if (auto v = expr_cast<var_expr>(e)) {
+            std::get<0>(k) = 1;
+            std::get<5>(k) = v->name();
+        } else if (auto ne = expr_cast<negation_expr>(e)) {
+            std::get<0>(k) = 2;
+            std::get<2>(k) = number(ne->e());
+        } else if (auto be = expr_cast<bin_op_expr>(e)) {
+            std::get<0>(k) = 3;
+            std::get<1>(k) = be->op();
+            std::get<2>(k) = number(be->lhs());
+            std::get<3>(k) = number(be->rhs());
+        } else {
+            throw std::logic_error("Unknown expression type in cse");
+        }
+        auto res = numbers_.emplace(k, nodes_.size());
+        if (res.second) {
+            nodes_.push_back(node{&e, std::get<2>(k), std::get<3>(k)});
+        }
+        return res.first->second;
+    }
+
+private:
+    // kind, operator, children, constant bits, variable name
+    typedef std::tuple<int, char, size_t, size_t, uint64_t, std::string> key;
+    std::map<key, size_t> numbers_;
+    std::vector<node>     nodes_;
+};
+
+} // unnamed namespace
+
+namespace cse {
+
+dag::dag(const std::map<std::string, expr_ptr>& solutions) {
+    value_numbering vn;
+    std::vector<size_t> roots;
+    std::set<std::string> inputs;
+    for (const auto& s : solutions) {
+        roots.push_back(vn.number(*s.second));
+        const auto vars = find_vars_in_expr(*s.second);
+        inputs.insert(vars.begin(), vars.end());
+    }
+    inputs_.assign(inputs.begin(), inputs.end());
+    const auto& nodes = vn.nodes();
+
+    // Count the uses of each node in the DAG, the children of a shared
+    // node are only used once by it however often it occurs
+    std::vector<unsigned> uses(nodes.size());
+    std::function<void (size_t)> count = [&](size_t id) {
+        if (uses[id]++ == 0) {
+            if (nodes[id].lhs != none) count(nodes[id].lhs);
+            if (nodes[id].rhs != none) count(nodes[id].rhs);
+        }
+    };
+    for (const auto r : roots) {
+        count(r);
+    }
+
+    std::vector<std::string> names(nodes.size());
+    std::function<expr_ptr (size_t)> body;
+    auto build = [&](size_t id) -> expr_ptr {
+        return names[id].empty() ? body(id) : var(names[id]);
+    };
+    body = [&](size_t id) -> expr_ptr {
+        const auto& n = nodes[id];
+        if (expr_cast<negation_expr>(*n.e)) {
+            return -build(n.lhs);
+        } else if (auto be = expr_cast<bin_op_expr>(*n.e)) {
+            auto l = build(n.lhs);
+            return do_op(be->op(), std::move(l), build(n.rhs));
+        }
+        return n.e->clone();
+    };
+
+    // Numbering is bottom up, so temporaries come out in dependency order
+    std::vector<std::string> slots = inputs_;
+    for (size_t id = 0; id < nodes.size(); ++id) {
+        if (uses[id] < 2 || nodes[id].lhs == none) {
+            continue;
+        }
+        temporaries_.push_back(assignment{"_t" + std::to_string(temporaries_.size()), body(id)});
+        names[id] = temporaries_.back().name;
+        slots.push_back(names[id]);
+        programs_.emplace_back(*temporaries_.back().value, slots);
+    }
+    size_t i = 0;
+    for (const auto& s : solutions) {
+        solutions_.push_back(assignment{s.first, build(roots[i++])});
+        programs_.emplace_back(*solutions_.back().value, slots);
+    }
+}
+
+std::vector<double> dag::evaluate(const std::vector<double>& values) const {
+    if (values.size() != inputs_.size()) {
+        throw std::runtime_error("Expected " + std::to_string(inputs_.size()) + " input values, got " + std::to_string(values.size()));
+    }
+    std::vector<double> slots = values;
+    for (size_t i = 0; i < temporaries_.size(); ++i) {
+        slots.push_back(programs_[i](slots.data()));
+    }
+    std::vector<double> res;
+    for (size_t i = temporaries_.size(); i < programs_.size(); ++i) {
+        res.push_back(programs_[i](slots.data()));
+    }
+    return res;
+}
+
+std::ostream& operator<<(std::ostream& os, const dag& d) {
+    for (const auto& t : d.temporaries()) {
+        os << t.name << " = " << t.value << "\n";
+    }
+    for (const auto& s : d.solutions()) {
+        os << s.name << " = " << s.value << "\n";
+    }
+    return os;
+}
+
+} // namespace cse
@@ -0,0 +1,47 @@
+#ifndef SOLVE_CSE_H
+#define SOLVE_CSE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <ostream>
+#include "expr.h"
+#include "eval.h"
+
+namespace cse {
+
+struct assignment {
+    std::string name;
+    expr_ptr    value;
+};
+
+// A set of solutions where every subexpression that is used more than
+// once, within one solution or across several, is computed once into a
+// named temporary. Temporaries are called _t0, _t1, ... which can't clash
+// with parsed variable names.
+class dag {
+public:
+    explicit dag(const std::map<std::string, expr_ptr>& solutions);
+
+    // In dependency order, values refer to inputs and earlier temporaries
+    const std::vector<assignment>& temporaries() const { return temporaries_; }
+    // The solutions in terms of inputs and temporaries, ordered by name
+    const std::vector<assignment>& solutions() const { return solutions_; }
+    // The free variables, the order of the values passed to evaluate
+    const std::vector<std::string>& inputs() const { return inputs_; }
+
+    // Values of all solutions, computing each temporary once
+    std::vector<double> evaluate(const std::vector<double>& values) const;
+
+private:
+    std::vector<assignment>    temporaries_;
+    std::vector<assignment>    solutions_;
+    std::vector<std::string>   inputs_;
+    std::vector<eval::program> programs_; // temporaries followed by solutions
+};
+
+std::ostream& operator<<(std::ostream& os, const dag& d);
+
+} // namespace cse
+
+#endif
@@ -0,0 +1,75 @@
+#include "cse.h"
+#include <iostream>
+#include <sstream>
+#include <assert.h>
+
+namespace {
+
+void test_cse(const std::map<std::string, expr_ptr>& solutions, const std::string& expected) {
+    const cse::dag d{solutions};
+    std::ostringstream oss;
+    oss << d;
+    if (oss.str() != expected) {
+        std::cout << "Common subexpression elimination failed.\n";
+        std::cout << "Expected:\n" << expected;
+        std::cout << "Got:\n" << oss.str() << std::endl;
+        assert(false);
+    }
+
+    // Evaluating the DAG gives the same values as each solution on its own
+    std::vector<double> values;
+    for (size_t i = 0; i < d.inputs().size(); ++i) {
+        values.push_back(i * 1.25 + 3);
+    }
+    const auto res = d.evaluate(values);
+    size_t i = 0;
+    for (const auto& s : solutions) {
+        const auto expected_value = eval::program{*s.second, d.inputs()}(values.data());
+        assert(res[i++] == expected_value);
+    }
+}
+
+} // unnamed namespace
+
+void cse_test() {
+    const auto a = [] { return var("a"); };
+    const auto b = [] { return var("b"); };
+    const auto c = [] { return var("c"); };
+
+    std::map<std::string, expr_ptr> s;
+    s["X"] = (a() + b()) * (a() + b()) + (a() + b());
+    test_cse(s,
+        "_t0 = (a + b)\n"
+        "X = ((_t0 * _t0) + _t0)\n");
+
+    // Shared across solutions
+    s["X"] = a() * b() + c();
+    s["Y"] = c() - a() * b();
+    test_cse(s,
+        "_t0 = (a * b)\n"
+        "X = (_t0 + c)\n"
+        "Y = (c - _t0)\n");
+    s.clear();
+
+    // Only the outermost of a repeated subtree is a temporary
+    s["X"] = (a() + b()) * c() / ((a() + b()) * c() - constant(1));
+    test_cse(s,
+        "_t0 = ((a + b) * c)\n"
+        "X = (_t0 / (_t0 - 1))\n");
+    // But the inner one too if it's also used on its own
+    s["X"] = (a() + b()) * c() / ((a() + b()) * c() - (a() + b()));
+    test_cse(s,
+        "_t0 = (a + b)\n"
+        "_t1 = (_t0 * c)\n"
+        "X = (_t1 / (_t1 - _t0))\n");
+
+    // Whole solutions, negations and constants
+    s["X"] = -(a() / constant(2));
+    s["Y"] = -(a() / constant(2));
+    s["Z"] = a() + a() - constant(2);
+    test_cse(s,
+        "_t0 = -((a / 2))\n"
+        "X = _t0\n"
+        "Y = _t0\n"
+        "Z = ((a + a) - 2)\n");
+}
@@ -0,0 +1,146 @@
+#include "equations.h"
+#include "numeric.h"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <math.h>
+
+equation_system::equation_system(const std::vector<equation>& equations, const std::vector<std::string>& unknowns, const std::vector<std::string>& parameters)
+    : unknowns_(unknowns)
+    , parameters_(parameters) {
+    if (equations.size() != unknowns.size()) {
+        throw std::runtime_error("A system of " + std::to_string(equations.size()) + " equations needs as many unknowns, got " + std::to_string(unknowns.size()));
+    }
+    auto inputs = unknowns;
+    inputs.insert(inputs.end(), parameters.begin(), parameters.end());
+    for (const auto& eq : equations) {
+        lhs_.emplace_back(new jit::function{*eq.first, inputs});
+        rhs_.emplace_back(new jit::function{*eq.second, inputs});
+        const auto residual = eq.first->clone() - eq.second->clone();
+        for (const auto& u : unknowns) {
+            const auto d = numeric::derivative(*residual, u);
+            auto c = expr_cast<const_expr>(*d);
+            jacobian_.emplace_back(c && c->value() == 0 ? nullptr : new jit::function{*d, inputs});
+        }
+    }
+}
+
+size_t equation_system::jacobian_nonzeros() const {
+    return std::count_if(jacobian_.begin(), jacobian_.end(), [](const function_ptr& f) { return f != nullptr; });
+}
+
+double equation_system::residuals(const std::vector<double>& inputs, std::vector<double>& f) const {
+    double worst = 0;
+    f.resize(lhs_.size());
+    for (size_t i = 0; i < lhs_.size(); ++i) {
+        const double l = (*lhs_[i])(inputs.data());
+        const double r = (*rhs_[i])(inputs.data());
+        f[i] = l - r;
+        const double relative = fabs(f[i]) / std::max(1.0, std::max(fabs(l), fabs(r)));
+        if (!(relative <= worst)) {
+            worst = relative; // also propagates NaN
+        }
+    }
+    return worst;
+}
+
+newton_result equation_system::solve(std::vector<double> guess, const std::vector<double>& parameters, const newton_options& options) const {
+    typedef std::chrono::steady_clock clock;
+    const auto start = clock::now();
+    const size_t n = unknowns_.size();
+    if (guess.size() != n || parameters.size() != parameters_.size()) {
+        throw std::runtime_error("Expected " + std::to_string(n) + " initial values and " + std::to_string(parameters_.size()) + " parameters");
+    }
+
+    auto inputs = std::move(guess);
+    inputs.insert(inputs.end(), parameters.begin(), parameters.end());
+    std::vector<double> f, trial_f, jacobian(n * n), step(n), trial;
+    double error = residuals(inputs, f);
+    auto norm = [](const std::vector<double>& v) {
+        double s = 0;
+        for (const auto x : v) s += x * x;
+        return s;
+    };
+
+    unsigned iterations = 0;
+    while (iterations < options.max_iterations && !(error <= options.tolerance)) {
+        ++iterations;
+        for (size_t i = 0; i < n * n; ++i) {
+            jacobian[i] = jacobian_[i] ? (*jacobian_[i])(inputs.data()) : 0;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            step[i] = -f[i];
+        }
+        if (!lu_solve(jacobian, step)) {
+            break;
+        }
+
+        // Halve the step until the sum of squared residuals decreases
+        const double current = norm(f);
+        bool improved = false;
+        double t = 1;
+        for (int halvings = 0; halvings < 30 && !improved; ++halvings, t /= 2) {
+            trial = inputs;
+            for (size_t j = 0; j < n; ++j) {
+                trial[j] += t * step[j];
+            }
+            const double trial_error = residuals(trial, trial_f);
+            if (norm(trial_f) < current) {
+                inputs.swap(trial);
+                f.swap(trial_f);
+                error = trial_error;
+                improved = true;
+            }
+        }
+        if (!improved) {
+            break;
+        }
+    }
+
+    double largest = 0;
+    for (const auto r : f) {
+        largest = std::max(largest, fabs(r));
+    }
+    inputs.resize(n);
+    return newton_result{error <= options.tolerance, inputs, iterations, largest, std::chrono::duration<double>(clock::now() - start).count()};
+}
+
+bool lu_solve(std::vector<double>& a, std::vector<double>& b) {
+    const size_t n = b.size();
+    assert(a.size() == n * n);
+    double scale = 0;
+    for (const auto x : a) {
+        scale = std::max(scale, fabs(x));
+    }
+    for (size_t k = 0; k < n; ++k) {
+        size_t pivot = k;
+        for (size_t i = k + 1; i < n; ++i) {
+            if (fabs(a[i * n + k]) > fabs(a[pivot * n + k])) {
+                pivot = i;
+            }
+        }
+        if (!(fabs(a[pivot * n + k]) > 1e-13 * scale)) {
+            return false;
+        }
+        if (pivot != k) {
+            std::swap_ranges(&a[k * n], &a[k * n] + n, &a[pivot * n]);
+            std::swap(b[k], b[pivot]);
+        }
+        for (size_t i = k + 1; i < n; ++i) {
+            const double m = a[i * n + k] / a[k * n + k];
+            if (m == 0) continue;
+            for (size_t j = k + 1; j < n; ++j) {
+                a[i * n + j] -= m * a[k * n + j];
+            }
+            b[i] -= m * b[k];
+        }
+    }
+    for (size_t k = n; k--;) {
+        double s = b[k];
+        for (size_t j = k + 1; j < n; ++j) {
+            s -= a[k * n + j] * b[j];
+        }
+        b[k] = s / a[k * n + k];
+    }
+    return true;
+}
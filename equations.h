@@ -0,0 +1,61 @@
+#ifndef SOLVE_EQUATIONS_H
+#define SOLVE_EQUATIONS_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "expr.h"
+#include "jit.h"
+
+struct newton_options {
+    newton_options() : max_iterations(50), tolerance(1e-10) {}
+
+    unsigned max_iterations;
+    double   tolerance;      // on the largest residual, relative to the size of each side
+};
+
+struct newton_result {
+    bool                converged;
+    std::vector<double> x;          // the unknowns, in order
+    unsigned            iterations;
+    double              residual;   // largest |lhs - rhs| at x
+    double              seconds;
+};
+
+// A square system of nonlinear equations in some unknowns, any other
+// variables are parameters given with each solve. The residuals and the
+// Jacobian (by symbolic differentiation) are compiled once up front, so
+// solving again for other parameters only costs the Newton iterations.
+class equation_system {
+public:
+    typedef std::pair<expr_ptr, expr_ptr> equation;
+
+    // Throws std::runtime_error unless there are as many unknowns as
+    // equations and every variable is an unknown or a parameter
+    equation_system(const std::vector<equation>& equations, const std::vector<std::string>& unknowns, const std::vector<std::string>& parameters = {});
+
+    const std::vector<std::string>& unknowns() const { return unknowns_; }
+    const std::vector<std::string>& parameters() const { return parameters_; }
+    size_t jacobian_nonzeros() const;
+
+    // Damped Newton from guess with a dense LU solve for each step
+    newton_result solve(std::vector<double> guess, const std::vector<double>& parameters = {}, const newton_options& options = newton_options{}) const;
+
+private:
+    typedef std::unique_ptr<jit::function> function_ptr;
+
+    std::vector<std::string>  unknowns_;
+    std::vector<std::string>  parameters_;
+    std::vector<function_ptr> lhs_;
+    std::vector<function_ptr> rhs_;
+    std::vector<function_ptr> jacobian_;  // row major, null where the derivative is 0
+
+    // Largest residual relative to the size of the sides, fills f
+    double residuals(const std::vector<double>& inputs, std::vector<double>& f) const;
+};
+
+// Solve A x = b in place by LU decomposition with partial pivoting, a is
+// n x n row major. Returns false if A is singular.
+bool lu_solve(std::vector<double>& a, std::vector<double>& b);
+
+#endif
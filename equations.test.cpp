@@ -0,0 +1,95 @@
+#include "equations.h"
+#include <iostream>
+#include <math.h>
+#include <assert.h>
+
+namespace {
+
+void test_newton(const equation_system& s, const std::vector<double>& guess, const std::vector<double>& parameters, const std::vector<double>& expected) {
+    const auto r = s.solve(guess, parameters);
+    bool ok = r.converged == !expected.empty();
+    for (size_t i = 0; ok && i < expected.size(); ++i) {
+        ok = fabs(r.x[i] - expected[i]) <= 1e-8 * std::max(1.0, fabs(expected[i]));
+    }
+    if (ok) {
+        return;
+    }
+    std::cout << "Newton solve of system in";
+    for (const auto& u : s.unknowns()) std::cout << " " << u;
+    std::cout << " failed after " << r.iterations << " iterations, residual " << r.residual << "\n";
+    std::cout << "Expected:";
+    for (const auto x : expected) std::cout << " " << x;
+    std::cout << "\nGot:";
+    for (const auto x : r.x) std::cout << " " << x;
+    std::cout << std::endl;
+    assert(false);
+}
+
+
+} // unnamed namespace
+
+void equations_test() {
+    std::vector<double> a{2, 1, 1, 4, 1, 0, -2, 2, 1}, b{5, 6, 3};
+    assert(lu_solve(a, b));
+    assert(fabs(b[0] - 1) < 1e-12 && fabs(b[1] - 2) < 1e-12 && fabs(b[2] - 1) < 1e-12);
+    a = {1, 2, 2, 4};
+    b = {1, 1};
+    assert(!lu_solve(a, b));
+
+    std::vector<equation_system::equation> eqs;
+    eqs.emplace_back(var("x") + var("y"), constant(3));
+    eqs.emplace_back(var("x") * var("y"), constant(2));
+    const equation_system pair{eqs, {"x", "y"}};
+    assert(pair.jacobian_nonzeros() == 4);
+    test_newton(pair, {0, 5}, {}, {1, 2});
+    test_newton(pair, {5, 0}, {}, {2, 1});
+
+    // The same compiled system for several parameter values
+    eqs.clear();
+    eqs.emplace_back(var("x") * var("x") + var("y") * var("y"), var("r"));
+    eqs.emplace_back(var("x") - var("y"), constant(0));
+    const equation_system circle{eqs, {"x", "y"}, {"r"}};
+    test_newton(circle, {3, 1}, {2}, {1, 1});
+    test_newton(circle, {3, 1}, {8}, {2, 2});
+    test_newton(circle, {3, 1}, {-1}, {});
+
+    // A sparse chain: x0 = 1 and x(i)^3 + x(i) = x(i-1) + 1
+    eqs.clear();
+    std::vector<std::string> unknowns;
+    for (int i = 0; i < 20; ++i) {
+        unknowns.push_back("x" + std::to_string(i));
+        if (i == 0) {
+            eqs.emplace_back(var("x0"), constant(1));
+        } else {
+            const auto xi = [&] { return var(unknowns[i]); };
+            eqs.emplace_back(xi() * xi() * xi() + xi(), var(unknowns[i - 1]) + constant(1));
+        }
+    }
+    const equation_system chain{eqs, unknowns};
+    assert(chain.jacobian_nonzeros() == 39);
+    std::vector<double> expected{1};
+    for (int i = 1; i < 20; ++i) {
+        // Solve x^3 + x = c by bisection for the expected value
+        double lo = -10, hi = 10, c = expected.back() + 1;
+        for (int k = 0; k < 200; ++k) {
+            const double m = (lo + hi) / 2;
+            (m * m * m + m < c ? lo : hi) = m;
+        }
+        expected.push_back(lo);
+    }
+    test_newton(chain, std::vector<double>(20, 0), {}, expected);
+
+    // Singular Jacobian everywhere
+    eqs.clear();
+    eqs.emplace_back(var("x") + var("y"), constant(1));
+    eqs.emplace_back(constant(2) * var("x") + constant(2) * var("y"), constant(3));
+    test_newton(equation_system{eqs, {"x", "y"}}, {0, 0}, {}, {});
+
+    bool thrown = false;
+    try {
+        equation_system{eqs, {"x"}};
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+}
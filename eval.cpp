@@ -0,0 +1,296 @@
+#include "eval.h"
+#include <algorithm>
+#include <unordered_map>
+#include <stdexcept>
+#include <ostream>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SOLVE_EVAL_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+typedef void (*unary_kernel)(double* dst, const double* a, size_t n);
+typedef void (*binary_kernel)(double* dst, const double* a, const double* b, size_t n);
+
+struct kernel_set {
+    unary_kernel  neg;
+    binary_kernel add;
+    binary_kernel sub;
+    binary_kernel mul;
+    binary_kernel div;
+};
+
+void neg_scalar(double* dst, const double* a, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = -a[i];
+    }
+}
+
+#define SCALAR_KERNEL(name, op)                                                       \
+    void name##_scalar(double* dst, const double* a, const double* b, size_t n) {     \
+        for (size_t i = 0; i < n; ++i) {                                              \
+            dst[i] = a[i] op b[i];                                                    \
+        }                                                                             \
+    }
+SCALAR_KERNEL(add, +)
+SCALAR_KERNEL(sub, -)
+SCALAR_KERNEL(mul, *)
+SCALAR_KERNEL(div, /)
+#undef SCALAR_KERNEL
+
+const kernel_set scalar_kernels = { neg_scalar, add_scalar, sub_scalar, mul_scalar, div_scalar };
+
+#ifdef SOLVE_EVAL_X86
+// SSE2 is part of x86-64, the AVX kernels are compiled for it separately
+// and only used when the CPU reports support for it. AVX is enough for
+// double precision + - * /, AVX2 only adds integer operations.
+
+void neg_sse2(double* dst, const double* a, size_t n) {
+    const __m128d sign = _mm_set1_pd(-0.0);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(dst + i, _mm_xor_pd(_mm_loadu_pd(a + i), sign));
+    }
+    for (; i < n; ++i) {
+        dst[i] = -a[i];
+    }
+}
+
+__attribute__((target("avx")))
+void neg_avx(double* dst, const double* a, size_t n) {
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(dst + i, _mm256_xor_pd(_mm256_loadu_pd(a + i), sign));
+    }
+    for (; i < n; ++i) {
+        dst[i] = -a[i];
+    }
+}
+
+#define VECTOR_KERNELS(name, op, sse2_op, avx_op)                                     \
+    void name##_sse2(double* dst, const double* a, const double* b, size_t n) {       \
+        size_t i = 0;                                                                 \
+        for (; i + 2 <= n; i += 2) {                                                  \
+            _mm_storeu_pd(dst + i, sse2_op(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));\
+        }                                                                             \
+        for (; i < n; ++i) {                                                          \
+            dst[i] = a[i] op b[i];                                                    \
+        }                                                                             \
+    }                                                                                 \
+    __attribute__((target("avx")))                                                    \
+    void name##_avx(double* dst, const double* a, const double* b, size_t n) {        \
+        size_t i = 0;                                                                 \
+        for (; i + 4 <= n; i += 4) {                                                  \
+            _mm256_storeu_pd(dst + i, avx_op(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));\
+        }                                                                             \
+        for (; i < n; ++i) {                                                          \
+            dst[i] = a[i] op b[i];                                                    \
+        }                                                                             \
+    }
+VECTOR_KERNELS(add, +, _mm_add_pd, _mm256_add_pd)
+VECTOR_KERNELS(sub, -, _mm_sub_pd, _mm256_sub_pd)
+VECTOR_KERNELS(mul, *, _mm_mul_pd, _mm256_mul_pd)
+VECTOR_KERNELS(div, /, _mm_div_pd, _mm256_div_pd)
+#undef VECTOR_KERNELS
+
+const kernel_set sse2_kernels = { neg_sse2, add_sse2, sub_sse2, mul_sse2, div_sse2 };
+const kernel_set avx_kernels  = { neg_avx, add_avx, sub_avx, mul_avx, div_avx };
+#endif
+
+const kernel_set& kernels_for(eval::isa which) {
+    if (which == eval::isa::best) {
+        which = eval::supported(eval::isa::avx) ? eval::isa::avx : eval::supported(eval::isa::sse2) ? eval::isa::sse2 : eval::isa::scalar;
+    }
+    if (!eval::supported(which)) {
+        throw std::runtime_error("Unsupported instruction set for evaluation");
+    }
+    switch (which) {
+#ifdef SOLVE_EVAL_X86
+    case eval::isa::sse2: return sse2_kernels;
+    case eval::isa::avx:  return avx_kernels;
+#endif
+    default:              return scalar_kernels;
+    }
+}
+
+// Registers needed to evaluate each node when the child needing the most
+// is evaluated first (Sethi-Ullman numbering)
+unsigned register_need(const expr& e, std::unordered_map<const expr*, unsigned>& need) {
+    unsigned n = 1;
+    if (auto ne = expr_cast<negation_expr>(e)) {
+        n = register_need(ne->e(), need);
+    } else if (auto be = expr_cast<bin_op_expr>(e)) {
+        const auto l = register_need(be->lhs(), need);
+        const auto r = register_need(be->rhs(), need);
+        n = l == r ? l + 1 : std::max(l, r);
+    }
+    need[&e] = n;
+    return n;
+}
+
+} // unnamed namespace
+
+namespace eval {
+
+bool supported(isa which) {
+    switch (which) {
+    case isa::scalar:
+    case isa::best:
+        return true;
+#ifdef SOLVE_EVAL_X86
+    case isa::sse2:
+        return true;
+    case isa::avx:
+        return __builtin_cpu_supports("avx");
+#endif
+    default:
+        return false;
+    }
+}
+
+std::ostream& operator<<(std::ostream& os, isa which) {
+    switch (which) {
+    case isa::scalar: return os << "scalar";
+    case isa::sse2:   return os << "sse2";
+    case isa::avx:    return os << "avx";
+    case isa::best:   return os << "best";
+    }
+    return os;
+}
+
+constexpr size_t program::block_size;
+
+program::program(const expr& e, const std::vector<std::string>& inputs) : register_count_(0), input_count_(inputs.size()) {
+    std::unordered_map<const expr*, unsigned> need;
+    register_need(e, need);
+    compile(e, inputs, need, 0);
+
+    // The last instruction writes straight to the output, which is the
+    // register after the scratch registers
+    const auto output = static_cast<uint32_t>(register_count_);
+    if (code_.back().op == opcode::load_var || code_.back().op == opcode::load_const) {
+        code_.push_back(instruction{opcode::copy, output, code_.back().dst, 0, 0});
+    } else {
+        code_.back().dst = output;
+    }
+}
+
+void program::emit(opcode op, uint32_t dst, uint32_t a, uint32_t b, uint32_t index) {
+    code_.push_back(instruction{op, dst, a, b, index});
+    register_count_ = std::max<size_t>(register_count_, std::max(dst, std::max(a, b)) + 1);
+}
+
+// Evaluate e into register dst using only registers from dst and up. The
+// more demanding child of a binary operation is evaluated first so that its
+// result only holds one register while the other child is evaluated.
+void program::compile(const expr& e, const std::vector<std::string>& inputs, const std::unordered_map<const expr*, unsigned>& need, uint32_t dst) {
+    if (auto c = expr_cast<const_expr>(e)) {
+        constants_.push_back(c->value());
+        emit(opcode::load_const, dst, 0, 0, static_cast<uint32_t>(constants_.size() - 1));
+    } else if (auto v = expr_cast<var_expr>(e)) {
+        const auto it = std::find(inputs.begin(), inputs.end(), v->name());
+        if (it == inputs.end()) {
+            throw std::runtime_error("Variable " + v->name() + " is not an input of the evaluated expression");
+        }
+        emit(opcode::load_var, dst, 0, 0, static_cast<uint32_t>(it - inputs.begin()));
+    } else if (auto ne = expr_cast<negation_expr>(e)) {
+        compile(ne->e(), inputs, need, dst);
+        emit(opcode::neg, dst, dst);
+    } else if (auto be = expr_cast<bin_op_expr>(e)) {
+        opcode op;
+        switch (be->op()) {
+        case '+': op = opcode::add; break;
+        case '-': op = opcode::sub; break;
+        case '*': op = opcode::mul; break;
+        case '/': op = opcode::div; break;
+        default: throw std::logic_error(std::string("Unknown operator '") + be->op() + "' in eval");
+        }
+        if (need.at(&be->rhs()) > need.at(&be->lhs())) {
+            compile(be->rhs(), inputs, need, dst);
+            compile(be->lhs(), inputs, need, dst + 1);
+            emit(op, dst, dst + 1, dst);
+        } else {
+            compile(be->lhs(), inputs, need, dst);
+            compile(be->rhs(), inputs, need, dst + 1);
+            emit(op, dst, dst, dst + 1);
+        }
+    } else {
+        throw std::logic_error("Unknown expression type in eval");
+    }
+}
+
+void program::run(const double* const* columns, size_t rows, double* out, isa which) const {
+    const auto& k = kernels_for(which);
+    const size_t stride = std::min(rows, block_size);
+    std::vector<double> scratch(register_count_ * stride);
+    std::vector<double> constant_blocks(constants_.size() * stride);
+    for (size_t i = 0; i < constants_.size(); ++i) {
+        std::fill_n(&constant_blocks[i * stride], stride, constants_[i]);
+    }
+    std::vector<const double*> regs(register_count_ + 1);
+
+    for (size_t offset = 0; offset < rows; offset += stride) {
+        const size_t n = std::min(stride, rows - offset);
+        for (const auto& ins : code_) {
+            double* const dst = ins.dst == register_count_ ? out + offset : &scratch[ins.dst * stride];
+            switch (ins.op) {
+            case opcode::load_var:   regs[ins.dst] = columns[ins.index] + offset; continue;
+            case opcode::load_const: regs[ins.dst] = &constant_blocks[ins.index * stride]; continue;
+            case opcode::copy:       memmove(dst, regs[ins.a], n * sizeof(double)); break;
+            case opcode::neg:        k.neg(dst, regs[ins.a], n); break;
+            case opcode::add:        k.add(dst, regs[ins.a], regs[ins.b], n); break;
+            case opcode::sub:        k.sub(dst, regs[ins.a], regs[ins.b], n); break;
+            case opcode::mul:        k.mul(dst, regs[ins.a], regs[ins.b], n); break;
+            case opcode::div:        k.div(dst, regs[ins.a], regs[ins.b], n); break;
+            }
+            regs[ins.dst] = dst;
+        }
+    }
+}
+
+double program::operator()(const double* values) const {
+    // Registers hold values here, no blocks needed for a single row
+    double small[32] = {};
+    std::vector<double> large;
+    double* regs = small;
+    if (register_count_ + 1 > sizeof(small) / sizeof(*small)) {
+        large.resize(register_count_ + 1);
+        regs = large.data();
+    }
+    for (const auto& ins : code_) {
+        double& dst = regs[ins.dst];
+        switch (ins.op) {
+        case opcode::load_var:   dst = values[ins.index]; break;
+        case opcode::load_const: dst = constants_[ins.index]; break;
+        case opcode::copy:       dst = regs[ins.a]; break;
+        case opcode::neg:        dst = -regs[ins.a]; break;
+        case opcode::add:        dst = regs[ins.a] + regs[ins.b]; break;
+        case opcode::sub:        dst = regs[ins.a] - regs[ins.b]; break;
+        case opcode::mul:        dst = regs[ins.a] * regs[ins.b]; break;
+        case opcode::div:        dst = regs[ins.a] / regs[ins.b]; break;
+        }
+    }
+    return regs[register_count_];
+}
+
+std::ostream& operator<<(std::ostream& os, const program& p) {
+    static const char* const names[] = { "load_var", "load_const", "copy", "neg", "add", "sub", "mul", "div" };
+    for (const auto& ins : p.instructions()) {
+        os << names[static_cast<int>(ins.op)] << " r" << ins.dst;
+        switch (ins.op) {
+        case opcode::load_var:   os << ", in" << ins.index; break;
+        case opcode::load_const: os << ", " << p.constants()[ins.index]; break;
+        case opcode::copy:
+        case opcode::neg:        os << ", r" << ins.a; break;
+        default:                 os << ", r" << ins.a << ", r" << ins.b; break;
+        }
+        os << "\n";
+    }
+    return os;
+}
+
+} // namespace eval
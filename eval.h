@@ -0,0 +1,79 @@
+#ifndef SOLVE_EVAL_H
+#define SOLVE_EVAL_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include "expr.h"
+
+namespace eval {
+
+// Instruction sets the kernels are available for
+enum class isa {
+    scalar,
+    sse2,
+    avx,
+    best,   // the best one supported by the running CPU
+};
+
+bool supported(isa which);
+std::ostream& operator<<(std::ostream& os, isa which);
+
+enum class opcode : uint8_t {
+    load_var,   // dst = column[index]
+    load_const, // dst = constants[index]
+    copy,       // dst = a
+    neg,        // dst = -a
+    add,        // dst = a + b
+    sub,        // dst = a - b
+    mul,        // dst = a * b
+    div,        // dst = a / b
+};
+
+struct instruction {
+    opcode   op;
+    uint32_t dst;
+    uint32_t a;
+    uint32_t b;
+    uint32_t index;
+};
+
+// A solved expression compiled to a flat list of register instructions
+// that is executed over blocks of rows at a time. Loads don't copy, they
+// point the register at the input column or a broadcast constant, so
+// only the arithmetic touches memory.
+class program {
+public:
+    // inputs names the columns in the order they are passed to run, throws
+    // std::runtime_error if e has a variable that isn't among them
+    explicit program(const expr& e, const std::vector<std::string>& inputs);
+
+    static constexpr size_t block_size = 256;
+
+    const std::vector<instruction>& instructions() const { return code_; }
+    const std::vector<double>&      constants() const { return constants_; }
+    size_t                          register_count() const { return register_count_; }
+    size_t                          input_count() const { return input_count_; }
+
+    // out[r] = e(columns[0][r], columns[1][r], ...) for r < rows
+    void run(const double* const* columns, size_t rows, double* out, isa which = isa::best) const;
+
+    // Evaluate a single row
+    double operator()(const double* values) const;
+
+private:
+    std::vector<instruction> code_;
+    std::vector<double>      constants_;
+    size_t                   register_count_;
+    size_t                   input_count_;
+
+    void emit(opcode op, uint32_t dst, uint32_t a = 0, uint32_t b = 0, uint32_t index = 0);
+    void compile(const expr& e, const std::vector<std::string>& inputs, const std::unordered_map<const expr*, unsigned>& need, uint32_t dst);
+};
+
+std::ostream& operator<<(std::ostream& os, const program& p);
+
+} // namespace eval
+
+#endif
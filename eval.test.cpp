@@ -0,0 +1,90 @@
+#include "eval.h"
+#include <iostream>
+#include <vector>
+#include <map>
+#include <math.h>
+#include <assert.h>
+
+namespace {
+
+double tree_eval(const expr& e, const std::map<std::string, double>& values) {
+    if (auto c = expr_cast<const_expr>(e)) return c->value();
+    if (auto v = expr_cast<var_expr>(e)) return values.at(v->name());
+    if (auto ne = expr_cast<negation_expr>(e)) return -tree_eval(ne->e(), values);
+    auto be = expr_cast<bin_op_expr>(e);
+    assert(be);
+    const auto l = tree_eval(be->lhs(), values), r = tree_eval(be->rhs(), values);
+    switch (be->op()) {
+    case '+': return l + r;
+    case '-': return l - r;
+    case '*': return l * r;
+    case '/': return l / r;
+    }
+    assert(false);
+    return 0;
+}
+
+bool same(double a, double b) {
+    return a == b || (isnan(a) && isnan(b));
+}
+
+// Evaluate over a number of rows that isn't a multiple of the block size
+// or vector width, with every instruction set against the tree walk
+void test_eval(const expr_ptr& e, const std::vector<std::string>& inputs) {
+    const size_t rows = eval::program::block_size * 3 + 7;
+    std::vector<std::vector<double>> columns(inputs.size(), std::vector<double>(rows));
+    std::vector<const double*> column_ptrs;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        for (size_t r = 0; r < rows; ++r) {
+            columns[i][r] = static_cast<double>(r) * (i + 1) - 100.5;
+        }
+        column_ptrs.push_back(columns[i].data());
+    }
+    const eval::program p{*e, inputs};
+    for (auto which : { eval::isa::scalar, eval::isa::sse2, eval::isa::avx, eval::isa::best }) {
+        if (!eval::supported(which)) continue;
+        std::vector<double> out(rows);
+        p.run(column_ptrs.data(), rows, out.data(), which);
+        for (size_t r = 0; r < rows; ++r) {
+            std::map<std::string, double> values;
+            std::vector<double> row;
+            for (size_t i = 0; i < inputs.size(); ++i) {
+                values[inputs[i]] = columns[i][r];
+                row.push_back(columns[i][r]);
+            }
+            const auto expected = tree_eval(*e, values);
+            if (!same(out[r], expected) || !same(p(row.data()), expected)) {
+                std::cout << "Evaluation of " << e << " using " << which << " failed in row " << r << ".\n" << p;
+                std::cout << "Expected: " << expected << "\n";
+                std::cout << "Got: " << out[r] << " and " << p(row.data()) << std::endl;
+                assert(false);
+            }
+        }
+    }
+}
+
+} // unnamed namespace
+
+void eval_test() {
+    test_eval((var("y") - constant(10)) / constant(4), {"y"});
+    test_eval(var("y"), {"x", "y"});
+    test_eval(constant(42), {});
+    test_eval(-(var("a") * var("b")) + var("a") / (var("b") - constant(0.5)), {"a", "b"});
+    test_eval(constant(1) / (var("x") - var("x")), {"x"});
+
+    // Right leaning chains need more registers unless the rhs goes first
+    auto chain = var("x");
+    for (int i = 0; i < 50; ++i) {
+        chain = var("y") - std::move(chain);
+    }
+    test_eval(chain, {"x", "y"});
+    assert(eval::program(*chain, {"x", "y"}).register_count() == 2);
+
+    bool thrown = false;
+    try {
+        eval::program p{*(var("x") + var("z")), {"x"}};
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+}
@@ -0,0 +1,466 @@
+#include "expr.h"
+#include "rules.h"
+#include <algorithm>
+#include <numeric>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+thread_local expr_allocator* current_allocator = nullptr;
+
+// Each node is preceded by the allocator it came from
+const size_t allocation_header = sizeof(expr_allocator*);
+static_assert(alignof(bin_op_expr) <= allocation_header && alignof(const_expr) <= allocation_header
+        && alignof(var_expr) <= allocation_header && alignof(negation_expr) <= allocation_header,
+        "The allocation header must keep nodes aligned");
+
+} // unnamed namespace
+
+expr_allocator* expr_allocator::current() {
+    return current_allocator;
+}
+
+expr_allocator::scope::scope(expr_allocator* a) : previous_(current_allocator) {
+    current_allocator = a;
+}
+
+expr_allocator::scope::~scope() {
+    current_allocator = previous_;
+}
+
+void* expr::operator new(size_t size) {
+    expr_allocator* const a = current_allocator;
+    void* const p = a ? a->allocate(size + allocation_header) : ::operator new(size + allocation_header);
+    *static_cast<expr_allocator**>(p) = a;
+    return static_cast<char*>(p) + allocation_header;
+}
+
+void expr::operator delete(void* p, size_t size) {
+    if (!p) {
+        return;
+    }
+    char* const block = static_cast<char*>(p) - allocation_header;
+    expr_allocator* const a = *reinterpret_cast<expr_allocator**>(block);
+    if (a) {
+        a->deallocate(block, size + allocation_header);
+    } else {
+        ::operator delete(block);
+    }
+}
+
+void expr::destroy_operands(expr_ptr* operands, size_t n) {
+    auto deep = [](const expr_ptr& e) { return e && e->operand_count(); };
+    if (std::none_of(operands, operands + n, deep)) {
+        return;
+    }
+    small_stack<expr_ptr> pending;
+    for (size_t i = 0; i < n; ++i) {
+        if (deep(operands[i])) {
+            pending.push(std::move(operands[i]));
+        }
+    }
+    while (!pending.empty()) {
+        // Once its deeper operands are moved out, e is destroyed without
+        // nesting more than one level
+        expr_ptr e = pending.pop();
+        e->release_operands(pending);
+    }
+}
+
+namespace {
+
+expr_ptr clone_expr(const expr& root) {
+    return fold_expr<expr_ptr>(root, [](const expr& e, expr_ptr* operands) { return e.rebuild(operands); });
+}
+
+size_t hash_expr(const expr& root) {
+    return fold_expr<size_t>(root, [](const expr& e, const size_t* operands) { return e.combine_hash(operands); });
+}
+
+// Compares the nodes of two expressions pairwise
+bool equal_exprs(const expr& a, const expr& b) {
+    small_stack<std::pair<const expr*, const expr*>> stack;
+    stack.push(std::make_pair(&a, &b));
+    while (!stack.empty()) {
+        const auto p = stack.pop();
+        const expr& x = *p.first;
+        const expr& y = *p.second;
+        if (!x.same_node(y)) {
+            return false;
+        }
+        const size_t n = x.operand_count();
+        for (size_t i = n; i--;) {
+            stack.push(std::make_pair(&x.operand(i), &y.operand(i)));
+        }
+    }
+    return true;
+}
+
+} // unnamed namespace
+
+expr_ptr negation_expr::clone() const {
+    return clone_expr(*this);
+}
+
+size_t negation_expr::hash() const {
+    return hash_expr(*this);
+}
+
+bool negation_expr::equal(const expr& other) const {
+    return equal_exprs(*this, other);
+}
+
+void negation_expr::print(std::ostream& os) const {
+    print_expr(os, *this);
+}
+
+void negation_expr::release_operands(small_stack<expr_ptr>& pending) {
+    if (e_->operand_count()) {
+        pending.push(std::move(e_));
+    }
+}
+
+expr_ptr bin_op_expr::clone() const {
+    return clone_expr(*this);
+}
+
+size_t bin_op_expr::hash() const {
+    return hash_expr(*this);
+}
+
+bool bin_op_expr::equal(const expr& e) const {
+    return equal_exprs(*this, e);
+}
+
+void bin_op_expr::print(std::ostream& os) const {
+    print_expr(os, *this);
+}
+
+void bin_op_expr::release_operands(small_stack<expr_ptr>& pending) {
+    for (auto& o : operands_) {
+        if (o->operand_count()) {
+            pending.push(std::move(o));
+        }
+    }
+}
+
+void print_expr(std::ostream& os, const expr& root) {
+    struct frame {
+        const expr* e;
+        size_t      next;
+    };
+    small_stack<frame> stack;
+    stack.push(frame{&root, 0});
+    while (!stack.empty()) {
+        frame& f = stack.top();
+        const auto be = expr_cast<bin_op_expr>(*f.e);
+        const size_t n = f.e->operand_count();
+        if (!n) {
+            os << *f.e;
+            stack.pop();
+            continue;
+        }
+        if (f.next == n) {
+            os << ")";
+            stack.pop();
+            continue;
+        }
+        if (f.next == 0) {
+            os << (be ? "(" : "-(");
+        } else {
+            os << " " << be->op() << " ";
+        }
+        const expr* child = &f.e->operand(f.next++);
+        stack.push(frame{child, 0});
+    }
+}
+
+bool const_expr::equal(const expr& e) const {
+    auto ep = expr_cast<const_expr>(e);
+    if (!ep) {
+        return false;
+    }
+    // Exact and inexact never match, or 1/10 would equal 0.1 and 0.1 would
+    // equal 0.1 + 1e-18 while 1/10 doesn't
+    if (exact_ != ep->exact_) {
+        return false;
+    }
+    return exact_ ? exact_value_ == ep->exact_value_ : value_ == ep->value_;
+}
+
+expr_ptr constant(double d) { return expr_ptr{new const_expr{d}}; }
+expr_ptr constant(const rational& r) { return expr_ptr{new const_expr{r}}; }
+expr_ptr var(const std::string& n) { return expr_ptr{new var_expr{n}}; }
+
+expr_ptr operator-(expr_ptr e) {
+    return expr_ptr{new negation_expr{std::move(e)}};
+}
+
+expr_ptr operator+(expr_ptr a, expr_ptr b) {
+    return expr_ptr{new bin_op_expr{std::move(a), std::move(b), '+'}};
+}
+
+expr_ptr operator-(expr_ptr a, expr_ptr b) {
+    return expr_ptr{new bin_op_expr{std::move(a), std::move(b), '-'}};
+}
+
+expr_ptr operator*(expr_ptr a, expr_ptr b) {
+    return expr_ptr{new bin_op_expr{std::move(a), std::move(b), '*'}};
+}
+
+expr_ptr operator/(expr_ptr a, expr_ptr b) {
+    return expr_ptr{new bin_op_expr{std::move(a), std::move(b), '/'}};
+}
+
+expr_ptr do_op(char op, expr_ptr a, expr_ptr b) {
+    return expr_ptr{new bin_op_expr{std::move(a), std::move(b), op}};
+}
+
+expr_ptr fold_constants(char op, const const_expr& l, const const_expr& r) {
+    if (l.exact() && r.exact() && !(op == '/' && r.exact_value().zero())) {
+        const rational& a = l.exact_value();
+        const rational& b = r.exact_value();
+        switch (op) {
+        case '+': return constant(a + b);
+        case '-': return constant(a - b);
+        case '*': return constant(a * b);
+        case '/': return constant(a / b);
+        }
+    } else {
+        const double a = l.value();
+        const double b = r.value();
+        switch (op) {
+        case '+': return constant(a + b);
+        case '-': return constant(a - b);
+        case '*': return constant(a * b);
+        case '/': return constant(a / b);
+        }
+    }
+    throw std::logic_error(std::string("Don't know how to handle ") + op);
+}
+
+expr_ptr negate_constant(const const_expr& c) {
+    return c.exact() ? constant(-c.exact_value()) : constant(-c.value());
+}
+
+std::ostream& operator<<(std::ostream& os, const expr_ptr& e) {
+    os << *e;
+    return os;
+}
+
+bool match_const(const expr& e, const double& v) {
+    auto cp = expr_cast<const_expr>(e);
+    return cp && cp->value() == v;
+}
+
+bool extract_const(const expr& e, double& v) {
+    if (auto cp = expr_cast<const_expr>(e)) {
+        v = cp->value();
+        return true;
+    }
+    v = 0;
+    return false;
+}
+
+bool match_var(const expr& e, const std::string& v) {
+    auto vp = expr_cast<var_expr>(e);
+    return vp && vp->name() == v;
+}
+
+////////////////////////////
+// SIMPLIFY
+////////////////////////////
+
+namespace {
+
+// The identities for a binary operation with simplified operands, the
+// first rule that matches applies. Folding two constants is arithmetic
+// and stays in simplify_bin_op.
+const rule_set& identities() {
+    static const rule_set rules = [] {
+        const auto a = var("a"), x = var("x");
+        rule_set r;
+        r.add(*(constant(0) + *a), *a);
+        r.add(*(constant(0) - *a), *-*a);
+        r.add(*(constant(0) * *a), *constant(0));
+        r.add(*(constant(1) * *a), *a);
+        r.add(*(constant(0) / *a), *constant(0));
+        r.add(*(*x + *x), *(constant(2) * *x));
+        r.add(*(*x - *x), *constant(0));
+        r.add(*(*x / *x), *constant(1));
+        r.add(*(*a + constant(0)), *a);
+        r.add(*(*a - constant(0)), *a);
+        r.add(*(*a * constant(0)), *constant(0));
+        r.add(*(*a * constant(1)), *a);
+        return r;
+    }();
+    return rules;
+}
+
+// Builds an identity's result, taking the operands it keeps rather than
+// copying them, which would make simplifying a long chain quadratic
+struct operand_builder {
+    const rule_set::bindings& b;
+    expr_ptr&                 lhs;
+    expr_ptr&                 rhs;
+
+    expr_ptr capture(size_t i) {
+        if (lhs && &b[i] == lhs.get()) return std::move(lhs);
+        if (rhs && &b[i] == rhs.get()) return std::move(rhs);
+        return b[i].clone();
+    }
+    expr_ptr extra(size_t) { throw std::logic_error("Identities have no extra names"); }
+    expr_ptr constant(double v) { return ::constant(v); }
+    expr_ptr negate(expr_ptr a) { return -std::move(a); }
+    expr_ptr binary(char op, expr_ptr a, expr_ptr b) { return do_op(op, std::move(a), std::move(b)); }
+};
+
+// The operands have already been simplified
+expr_ptr simplify_bin_op(char op, expr_ptr lhs, expr_ptr rhs) {
+    auto l = expr_cast<const_expr>(*lhs);
+    auto r = expr_cast<const_expr>(*rhs);
+    if (l && r) {
+        return fold_constants(op, *l, *r);
+    }
+    const rule_set& rules = identities();
+    rule_set::bindings b;
+    const size_t i = rules.first(op, *lhs, *rhs, b);
+    if (i < rules.size()) {
+        operand_builder builder{b, lhs, rhs};
+        return rules.build<expr_ptr>(i, 0, builder);
+    }
+    // Keep the simplified operands even if the operation itself can't be simplified
+    return do_op(op, std::move(lhs), std::move(rhs));
+}
+
+// What simplify builds the result for e from: nothing for leaves and
+// negated constants, and for a double negation the inner operand, which
+// the result is then just passed through from
+size_t simplify_operands(const expr& e, const expr* out[2]) {
+    if (auto ne = expr_cast<negation_expr>(e)) {
+        if (expr_cast<const_expr>(ne->e())) {
+            return 0;
+        }
+        auto inner = expr_cast<negation_expr>(ne->e());
+        out[0] = inner ? &inner->e() : &ne->e();
+        return 1;
+    } else if (auto be = expr_cast<bin_op_expr>(e)) {
+        out[0] = &be->lhs();
+        out[1] = &be->rhs();
+        return 2;
+    }
+    return 0;
+}
+
+} // unnamed namespace
+
+expr_ptr simplify(const expr& root) {
+    struct frame {
+        const expr* e;
+        const expr* operands[2];
+        size_t      n;
+        size_t      next;
+    };
+    small_stack<frame> stack;
+    small_stack<expr_ptr> results;
+    auto push = [&stack](const expr& e) {
+        frame f{&e, {nullptr, nullptr}, 0, 0};
+        f.n = simplify_operands(e, f.operands);
+        stack.push(f);
+    };
+    push(root);
+    while (!stack.empty()) {
+        frame& f = stack.top();
+        if (f.next < f.n) {
+            push(*f.operands[f.next++]);
+            continue;
+        }
+        const expr& e = *f.e;
+        const size_t n = f.n;
+        stack.pop();
+        expr_ptr* operands = results.end() - n;
+        expr_ptr res;
+        if (auto ne = expr_cast<negation_expr>(e)) {
+            if (auto c = expr_cast<const_expr>(ne->e())) {
+                res = negate_constant(*c);
+            } else if (expr_cast<negation_expr>(ne->e())) {
+                res = std::move(operands[0]);
+            } else {
+                res = -std::move(operands[0]);
+            }
+        } else if (auto be = expr_cast<bin_op_expr>(e)) {
+            res = simplify_bin_op(be->op(), std::move(operands[0]), std::move(operands[1]));
+        } else {
+            res = e.clone();
+        }
+        results.pop(n);
+        results.push(std::move(res));
+    }
+    return results.pop();
+}
+
+////////////////////////////
+// ANALYSIS
+////////////////////////////
+
+size_t node_count(const expr& e) {
+    return fold_expr<size_t>(e, [](const expr& n, const size_t* operands) {
+        return std::accumulate(operands, operands + n.operand_count(), size_t(1));
+    });
+}
+
+unsigned depth(const expr& e) {
+    return fold_expr<unsigned>(e, [](const expr& n, const unsigned* operands) {
+        return 1 + std::accumulate(operands, operands + n.operand_count(), 0u, [](unsigned a, unsigned b) { return std::max(a, b); });
+    });
+}
+
+void do_find_vars_in_expr(const expr& e, std::set<std::string>& vars) {
+    small_stack<const expr*> stack;
+    stack.push(&e);
+    while (!stack.empty()) {
+        const expr& n = *stack.pop();
+        if (auto ve = expr_cast<var_expr>(n)) {
+            vars.insert(ve->name());
+        }
+        for (size_t i = n.operand_count(); i--;) {
+            stack.push(&n.operand(i));
+        }
+    }
+}
+
+std::set<std::string> find_vars_in_expr(const expr& e) {
+    std::set<std::string> vars;
+    do_find_vars_in_expr(e, vars);
+    return vars;
+}
+
+bool expr_has_var(const expr& e, const std::string& v) {
+    auto vars = find_vars_in_expr(e);
+    return vars.find(v) != vars.end();
+}
+
+void do_find_var_occurrences(const expr& e, const std::string& v, size_t d, var_occurrences& occ) {
+    small_stack<std::pair<const expr*, size_t>> stack;
+    stack.push(std::make_pair(&e, d));
+    while (!stack.empty()) {
+        const auto p = stack.pop();
+        const expr& n = *p.first;
+        if (auto ve = expr_cast<var_expr>(n)) {
+            if (ve->name() == v) {
+                occ.count++;
+                occ.depth_sum += p.second;
+            }
+        }
+        for (size_t i = n.operand_count(); i--;) {
+            stack.push(std::make_pair(&n.operand(i), p.second + 1));
+        }
+    }
+}
+
+var_occurrences find_var_occurrences(const expr& e, const std::string& v) {
+    var_occurrences occ{0, 0};
+    do_find_var_occurrences(e, v, 0, occ);
+    return occ;
+}
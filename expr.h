@@ -0,0 +1,438 @@
+#ifndef SOLVE_EXPR_H
+#define SOLVE_EXPR_H
+
+#include <memory>
+#include <string>
+#include <set>
+#include <ostream>
+#include <tuple>
+#include <type_traits>
+#include <functional>
+#include <vector>
+#include <assert.h>
+#include "rational.h"
+
+
+inline size_t hash_combine(size_t a, size_t b) {
+    // boost::hash_combine, order dependent unlike a plain xor
+    return a ^ (b + 0x9e3779b9 + (a << 6) + (a >> 2));
+}
+
+
+// Explicit stack for the traversals that can't recurse, the first N
+// entries live inline so small expressions don't allocate
+template<typename T, size_t N = 32>
+class small_stack {
+public:
+    small_stack() : data_(inline_), size_(0), capacity_(N) {}
+    small_stack(const small_stack&) = delete;
+    small_stack& operator=(const small_stack&) = delete;
+
+    bool   empty() const { return size_ == 0; }
+    size_t size() const { return size_; }
+    T&     top() { assert(size_); return data_[size_ - 1]; }
+    T*     end() { return data_ + size_; }
+
+    void push(T t) {
+        if (size_ == capacity_) {
+            std::vector<T> grown(capacity_ * 2);
+            std::move(data_, data_ + size_, grown.begin());
+            heap_.swap(grown);
+            data_ = heap_.data();
+            capacity_ = heap_.size();
+        }
+        data_[size_++] = std::move(t);
+    }
+
+    T pop() {
+        assert(size_);
+        return std::move(data_[--size_]);
+    }
+
+    void pop(size_t n) {
+        assert(n <= size_);
+        for (; n; --n) {
+            data_[--size_] = T{};
+        }
+    }
+
+private:
+    T              inline_[N];
+    std::vector<T> heap_;
+    T*             data_;
+    size_t         size_;
+    size_t         capacity_;
+};
+
+// Where expression nodes get their memory. Every node remembers the
+// allocator it came from, so trees may outlive the scope that installed it.
+// Memory must be aligned for any scalar type, like operator new's.
+class expr_allocator {
+public:
+    virtual ~expr_allocator() {}
+    virtual void* allocate(size_t size) = 0;
+    virtual void  deallocate(void* p, size_t size) = 0;
+
+    // The one installed on this thread, nullptr for operator new
+    static expr_allocator* current();
+
+    // Nodes made on this thread use a (operator new if null) until the
+    // scope ends
+    class scope {
+    public:
+        explicit scope(expr_allocator* a);
+        ~scope();
+    private:
+        expr_allocator* previous_;
+
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+    };
+};
+
+class expr {
+public:
+    virtual ~expr() {}
+
+    static void* operator new(size_t size);
+    static void  operator delete(void* p, size_t size);
+
+    virtual std::unique_ptr<expr> clone() const = 0;
+    virtual size_t hash() const = 0;
+    virtual bool equal(const expr& e) const = 0;
+
+    // Operands in order, for traversals that walk the tree without
+    // recursing (deep expressions would overflow the call stack)
+    virtual size_t operand_count() const { return 0; }
+    virtual const expr& operand(size_t) const { assert(false); return *this; }
+
+    // This node's part of clone, hash and equal given the results for the
+    // operands, the same as those for leaves
+    virtual std::unique_ptr<expr> rebuild(std::unique_ptr<expr>*) const { return clone(); }
+    virtual size_t combine_hash(const size_t*) const { return hash(); }
+    virtual bool same_node(const expr& e) const { return equal(e); }
+
+    operator std::unique_ptr<expr>() const {
+        return clone();
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const expr& e) {
+        e.print(os);
+        return os;
+    }
+
+protected:
+    expr() {}
+
+    // Destroys the operands without nested destructor calls
+    static void destroy_operands(std::unique_ptr<expr>* operands, size_t n);
+
+private:
+    virtual void print(std::ostream& os) const = 0;
+    // Moves operands that have operands of their own to pending
+    virtual void release_operands(small_stack<std::unique_ptr<expr>>&) {}
+};
+
+typedef std::unique_ptr<expr> expr_ptr;
+
+// Post-order fold without recursion. combine(e, results) gets each node and
+// the results for its operands, and returns the result for the node.
+template<typename T, typename F>
+T fold_expr(const expr& root, F combine) {
+    struct frame {
+        const expr* e;
+        size_t      next;
+    };
+    small_stack<frame> stack;
+    small_stack<T> results;
+    stack.push(frame{&root, 0});
+    while (!stack.empty()) {
+        frame& f = stack.top();
+        const size_t n = f.e->operand_count();
+        if (f.next < n) {
+            const expr* child = &f.e->operand(f.next++);
+            stack.push(frame{child, 0});
+            continue;
+        }
+        T res = combine(*f.e, results.end() - n);
+        results.pop(n);
+        results.push(std::move(res));
+        stack.pop();
+    }
+    return results.pop();
+}
+
+template<typename T, typename E>
+const T* expr_cast(const E& e) {
+    return dynamic_cast<const T*>(&e);
+}
+
+
+// A number. It's exact when it comes from a decimal literal, from folding
+// exact constants or from a double rational::from_double takes exactly.
+// Exact constants compare as rationals, inexact ones as doubles, and an exact
+// constant never equals an inexact one, which keeps equal() transitive.
+// value() is for evaluation and printing either way.
+class const_expr : public expr {
+public:
+    explicit const_expr(double value) : value_(value), exact_(rational::from_double(value, exact_value_)) {}
+    explicit const_expr(const rational& value) : value_(value.to_double()), exact_value_(value), exact_(true) {}
+    virtual std::unique_ptr<expr> clone() const override { return std::unique_ptr<expr>{new const_expr{value_, exact_value_, exact_}}; }
+    double value() const { return value_; }
+    bool exact() const { return exact_; }
+    const rational& exact_value() const { assert(exact_); return exact_value_; }
+    // Equal exact values have equal doubles, so this agrees with equal()
+    virtual size_t hash() const override { return std::hash<double>()(value_); }
+    virtual bool equal(const expr& e) const override;
+private:
+    double   value_;
+    rational exact_value_;
+    bool     exact_;
+    const_expr(double value, const rational& exact_value, bool exact) : value_(value), exact_value_(exact_value), exact_(exact) {}
+    virtual void print(std::ostream& os) const override {
+        os << value_;
+    }
+};
+
+class var_expr : public expr {
+public:
+    explicit var_expr(const std::string& name) : name_(name) {}
+    const std::string& name() const { return name_; }
+    virtual std::unique_ptr<expr> clone() const override { return std::unique_ptr<expr>{new var_expr{name_}}; }
+    virtual size_t hash() const override { return std::hash<std::string>()(name_); }
+    virtual bool equal(const expr& e) const override { auto ep = expr_cast<var_expr>(e); return ep && ep->name() == name(); }
+private:
+    std::string name_;
+    virtual void print(std::ostream& os) const override {
+        os << name_;
+    }
+};
+
+class negation_expr : public expr {
+public:
+    explicit negation_expr(expr_ptr e) : e_(std::move(e)) {
+    }
+    virtual ~negation_expr() { destroy_operands(&e_, 1); }
+    const expr& e() const { return *e_; }
+    virtual std::unique_ptr<expr> clone() const override;
+    virtual size_t hash() const override;
+    virtual bool equal(const expr& other) const override;
+    virtual size_t operand_count() const override { return 1; }
+    virtual const expr& operand(size_t) const override { return *e_; }
+    virtual expr_ptr rebuild(expr_ptr* operands) const override { return expr_ptr{new negation_expr{std::move(operands[0])}}; }
+    virtual size_t combine_hash(const size_t* operands) const override { return hash_combine('-', operands[0]); }
+    virtual bool same_node(const expr& e) const override { return expr_cast<negation_expr>(e) != nullptr; }
+private:
+    expr_ptr e_;
+    virtual void print(std::ostream& os) const override;
+    virtual void release_operands(small_stack<expr_ptr>& pending) override;
+};
+
+class bin_op_expr : public expr {
+public:
+    bin_op_expr(expr_ptr lhs, expr_ptr rhs, char op) : operands_{std::move(lhs), std::move(rhs)}, op_(op) {}
+    virtual ~bin_op_expr() { destroy_operands(operands_, 2); }
+    const expr& lhs() const { return *operands_[0]; }
+    const expr& rhs() const { return *operands_[1]; }
+    char op() const { return op_; }
+    virtual std::unique_ptr<expr> clone() const override;
+    virtual size_t hash() const override;
+    virtual bool equal(const expr& e) const override;
+    virtual size_t operand_count() const override { return 2; }
+    virtual const expr& operand(size_t i) const override { return *operands_[i]; }
+    virtual expr_ptr rebuild(expr_ptr* operands) const override { return expr_ptr{new bin_op_expr{std::move(operands[0]), std::move(operands[1]), op_}}; }
+    virtual size_t combine_hash(const size_t* operands) const override { return hash_combine(hash_combine(op(), operands[0]), operands[1]); }
+    virtual bool same_node(const expr& e) const override { auto ep = expr_cast<bin_op_expr>(e); return ep && ep->op() == op(); }
+private:
+    expr_ptr operands_[2];
+    char op_;
+    virtual void print(std::ostream& os) const override;
+    virtual void release_operands(small_stack<expr_ptr>& pending) override;
+};
+
+// Prints without recursing, this is what operator<< ends up in for
+// negations and binary operations
+void print_expr(std::ostream& os, const expr& e);
+
+expr_ptr constant(double d);
+expr_ptr constant(const rational& r);
+expr_ptr var(const std::string& n);
+
+expr_ptr operator-(expr_ptr e);
+expr_ptr operator+(expr_ptr a, expr_ptr b);
+expr_ptr operator-(expr_ptr a, expr_ptr b);
+expr_ptr operator*(expr_ptr a, expr_ptr b);
+expr_ptr operator/(expr_ptr a, expr_ptr b);
+expr_ptr do_op(char op, expr_ptr a, expr_ptr b);
+
+// l op r and -c as constants, exact when the operands are (and it isn't a
+// division by zero)
+expr_ptr fold_constants(char op, const const_expr& l, const const_expr& r);
+expr_ptr negate_constant(const const_expr& c);
+
+std::ostream& operator<<(std::ostream& os, const expr_ptr& e);
+
+bool match_const(const expr& e, const double& v);
+bool extract_const(const expr& e, double& v);
+bool match_var(const expr& e, const std::string& v);
+
+////////////////////////////
+// MATCHING
+////////////////////////////
+
+#include <tuple>
+#include <type_traits>
+#include <functional>
+
+template<typename T>
+struct binder {
+    binder(T& x) : x_(&x), bound_(false) {
+    }
+    bool operator()(const T& x) {
+        assert(!bound_);
+        *x_ = x;
+        bound_ = true;
+        return true;
+    }
+    bool bound() const { return bound_; }
+private:
+    T*   x_;
+    bool bound_;
+};
+template<typename T>
+binder<T> binder_m(T& x) { return binder<T>(x); }
+
+template<typename A>
+struct const_matcher {
+public:
+    typedef typename std::result_of<A(double)>::type result_type;
+    const_matcher(const A& a) : a_(a) {}
+    result_type operator()(const expr& e) {
+        if (auto ce = expr_cast<const_expr>(e)) {
+            return a_(ce->value());
+        }
+        return result_type{};
+    }
+private:
+    A a_;
+};
+template<typename A>
+const_matcher<A> const_m(const A& a) { return const_matcher<A>(a); }
+
+template<typename A>
+struct neg_matcher {
+    typedef typename std::result_of<A(const expr&)>::type result_type;
+    neg_matcher(const A& a) : a_(a) {}
+    result_type operator()(const expr& e) {
+        if (auto ne = expr_cast<negation_expr>(e)) {
+            return a_(ne->e());
+        }
+        return result_type{};
+    }
+private:
+    A a_;
+};
+template<typename A>
+neg_matcher<A> neg_m(const A& a) { return neg_matcher<A>(a); }
+
+template<typename A>
+struct var_matcher {
+    typedef typename std::result_of<A(const std::string&)>::type result_type;
+    var_matcher(const A& a) : a_(a) {}
+    result_type operator()(const expr& e) {
+        if (auto ve = expr_cast<var_expr>(e)) {
+            return a_(ve->name());
+        }
+        return result_type{};
+    }
+private:
+    A a_;
+};
+template<typename A>
+var_matcher<A> var_m(const A& a) { return var_matcher<A>(a); }
+
+template<typename A>
+struct exact_var_matcher {
+    typedef typename std::result_of<A()>::type result_type;
+    exact_var_matcher(const A& a, const std::string& v) : a_(a), v_(v) {}
+    result_type operator()(const expr& e) {
+        if (auto ve = expr_cast<var_expr>(e)) {
+            if (ve->name() == v_) {
+                return a_();
+            }
+        }
+        return result_type{};
+    }
+private:
+    A a_;
+    std::string v_;
+};
+template<typename A>
+exact_var_matcher<A> exact_var_m(const std::string& v, const A& a) { return exact_var_matcher<A>(a, v); }
+
+template<typename A>
+struct bin_op_matcher {
+    typedef typename std::result_of<A(char, const expr&, const expr&)>::type result_type;
+    bin_op_matcher(const A& a) : a_(a) {}
+    result_type operator()(const expr& e) {
+        if (auto be = expr_cast<bin_op_expr>(e)) {
+            return a_(be->op(), be->lhs(), be->rhs());
+        }
+        return result_type{};
+    }
+private:
+    A a_;
+};
+template<typename A>
+bin_op_matcher<A> bin_op_m(const A& a) { return bin_op_matcher<A>(a); }
+
+template<typename A, typename... As>
+struct or_matcher {
+    typedef typename std::result_of<A(const expr&)>::type result_type;
+
+    or_matcher(const A& a, const As&... as) : as_(a, as...) {
+    }
+
+    result_type operator()(const expr& e) {
+        return iter_helper<0>(as_, e);
+    }
+
+private:
+    typedef std::tuple<A, As...> tuple_type;
+    tuple_type as_;
+
+    template<int N>
+    static typename std::enable_if<N < std::tuple_size<tuple_type>::value, result_type>::type
+    iter_helper(tuple_type& t, const expr& e) {
+        auto& a = std::get<N>(t);
+        if (auto res = a(e)) {
+            return res;
+        }
+        return iter_helper<N+1>(t, e);
+    }
+    template<int N>
+    static typename std::enable_if<N == std::tuple_size<tuple_type>::value, result_type>::type
+    iter_helper(tuple_type&, const expr&) {
+        return result_type{};
+    }
+};
+template<typename A, typename... As>
+or_matcher<A, As...> or_m(const A& a, const As&... as) {
+    return or_matcher<A, As...>(a, as...);
+}
+
+expr_ptr simplify(const expr& e);
+
+unsigned depth(const expr& e);
+size_t node_count(const expr& e);
+
+std::set<std::string> find_vars_in_expr(const expr& e);
+bool expr_has_var(const expr& e, const std::string& v);
+
+struct var_occurrences {
+    size_t count;     // number of times the variable occurs
+    size_t depth_sum; // sum of the depths (root is 0) of those occurrences
+};
+var_occurrences find_var_occurrences(const expr& e, const std::string& v);
+
+#endif
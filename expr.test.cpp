@@ -0,0 +1,158 @@
+#include "expr.h"
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <assert.h>
+
+namespace {
+
+std::ostream& operator<<(std::ostream& os, const std::set<std::string>& ss) {
+    os << "{";
+    for (const auto& s : ss) {
+        os << " " << s;
+    }
+    os << " }";
+    return os;
+}
+
+void test_find_vars_in_expr(const expr_ptr& e, const std::set<std::string>& expected) {
+    auto res = find_vars_in_expr(*e);
+    if (res != expected) {
+        std::cout << "find_vars_in_expr failed for " << *e << std::endl;
+        std::cout << "Expected: " << expected << std::endl;
+        std::cout << "Got: " << res << std::endl;
+        assert(false);
+    }
+    for (const auto& var : expected) {
+        assert(expr_has_var(*e, var));
+    }
+}
+
+void test_depth(const expr_ptr& e, unsigned expected_depth)
+{
+    auto d = depth(*e);
+    if (d != expected_depth) {
+        std::cout << "Wrong depth for " << e << "\n";
+        std::cout << "Expected: " << expected_depth << std::endl;
+        std::cout << "Got: " << d << std::endl;
+        assert(false);
+    }
+}
+
+void test_simplify(const expr_ptr& e, const expr_ptr& expected) {
+    auto simplified = simplify(*e);
+    if (!simplified->equal(*expected)) {
+        std::cerr << "Simplification of " << *e << " failed.\n";
+        std::cerr << "Expected: " << *expected << "\n";
+        std::cerr << "Got: " << *simplified << "\n";
+        assert(false);
+    }
+}
+
+void simplify_test()
+{
+    const std::pair<expr_ptr,expr_ptr> simplification_tests[] = {
+        // Identity
+        { constant(2), constant(2) },
+        { var("x"), var("x") },
+        // Negation
+        { -constant(2), constant(-2) },
+        { -(-var("x")), var("x") },
+        // Constant binary expressions
+        { constant(4) + constant(2), constant(6) },
+        { constant(3) - constant(5), constant(-2) },
+        { constant(10) * constant(2), constant(20) },
+        { constant(30) / constant(5), constant(6) },
+        // Various identities
+        { constant(0) + var("x"), var("x") },
+        { var("x") + constant(0), var("x") },
+        { var("x") + var("x"), constant(2) * var("x") },
+        { constant(0) - var("x"), -var("x") },
+        { var("x") - constant(0), var("x") },
+        { var("x") - var("x"), constant(0) },
+        { constant(0) * var("x"), constant(0) },
+        { var("x") * constant(0), constant(0) },
+        { constant(1) * var("x"), var("x") },
+        { var("x") * constant(1), var("x") },
+        { constant(0) / var("x"), constant(0) },
+        { var("x") / var("x"), constant(1) },
+        // Some combined tests
+        { constant(0) + var("x") * constant(1), var("x") },
+        { var("y") / (constant(3) - constant(5)), var("y") / constant(-2) },
+        { -(var("x") + constant(0)), -var("x") },
+    };
+    for (const auto& test : simplification_tests) {
+        test_simplify(test.first, test.second);
+    }
+}
+
+// Folding exact constants stays exact, so equal values dedup as such
+void exact_test()
+{
+    const auto tenth = constant(rational(1, 10));
+    const auto sum = simplify(*(tenth->clone() + constant(rational(2, 10))));
+    assert(sum->equal(*constant(rational(3, 10))) && sum->hash() == constant(rational(3, 10))->hash());
+    assert(!simplify(*(constant(0.1) + constant(0.2)))->equal(*constant(0.3)));
+    assert(simplify(*(constant(rational(1, 3)) * constant(3)))->equal(*constant(1)));
+    assert(simplify(*-constant(rational(1, 3)))->equal(*constant(rational(-1, 3))));
+
+    // Small dyadic doubles are exact, other doubles only equal their own
+    // value, and never an exact constant even if it rounds to the same double
+    assert(expr_cast<const_expr>(*constant(0.75))->exact() && !expr_cast<const_expr>(*constant(0.1))->exact());
+    assert(constant(0.75)->equal(*constant(rational(3, 4))));
+    assert(!constant(0.1)->equal(*tenth) && !tenth->equal(*constant(0.1)) && constant(0.1)->equal(*constant(0.1)));
+    assert(!constant(rational(1, 3))->equal(*constant(rational(1, 3) + rational(1, INT64_MAX))));
+
+    // Dividing by zero falls back to doubles
+    const auto inf = simplify(*(constant(1) / constant(0)));
+    assert(std::isinf(expr_cast<const_expr>(*inf)->value()) && !expr_cast<const_expr>(*inf)->exact());
+}
+
+// Deep enough to overflow the call stack if any pass recursed
+void deep_test()
+{
+    const unsigned n = 20000;
+    expr_ptr chain = var("x");
+    expr_ptr nested = var("x");
+    for (unsigned i = 0; i < n; ++i) {
+        chain = std::move(chain) + constant(1);
+        nested = i % 4 < 2 ? -std::move(nested) : constant(2) * std::move(nested);
+    }
+    for (const auto* e : { &chain, &nested }) {
+        auto copy = (*e)->clone();
+        assert(copy->equal(**e) && copy->hash() == (*e)->hash());
+        assert(node_count(*copy) == (e == &chain ? 2 * n + 1 : n + n / 2 + 1));
+        assert(depth(*copy) == n + 1);
+        assert(find_vars_in_expr(*copy) == std::set<std::string>{"x"});
+        assert(find_var_occurrences(*copy, "x").depth_sum == n);
+    }
+    // Double negations cancel
+    assert(depth(*simplify(*nested)) == n / 2 + 1);
+    auto different = chain->clone() * constant(1);
+    assert(!different->equal(*chain) && !chain->equal(*nested));
+
+    std::ostringstream os;
+    os << chain;
+    assert(os.str().size() == n * 6 + 1 && os.str().compare(n - 3, 9, "(((x + 1)") == 0);
+}
+
+} // unnamed namespace
+
+void expr_test()
+{
+    simplify_test();
+    exact_test();
+
+    test_find_vars_in_expr(constant(0), {});
+    test_find_vars_in_expr(var("x"), {"x"});
+    test_find_vars_in_expr(-var("x"), {"x"});
+    test_find_vars_in_expr(var("x")+var("x"), {"x"});
+    test_find_vars_in_expr(var("x")+var("y"), {"x","y"});
+
+    test_depth(constant(0), 1);
+    test_depth(-var("zz"), 2);
+    test_depth(constant(0)+constant(1), 2);
+    test_depth(constant(0)+constant(1)*constant(2), 3);
+
+    deep_test();
+}
@@ -0,0 +1,169 @@
+#include "jit.h"
+#include <stdexcept>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__unix__)
+#define SOLVE_JIT_X86_64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef SOLVE_JIT_X86_64
+
+// xmm15 is kept free as a temporary, the rest hold the program registers
+// with the output register last
+const unsigned temp_xmm = 15;
+
+class assembler {
+public:
+    const std::string& code() const { return code_; }
+
+    // op xmm_d, xmm_s for the scalar double arithmetic (F2 0F xx) and
+    // packed logic/moves (66 0F xx)
+    void sse(uint8_t prefix, uint8_t opcode, unsigned d, unsigned s) {
+        byte(prefix);
+        rex(false, d, s);
+        byte(0x0f);
+        byte(opcode);
+        byte(0xc0 | (d & 7) << 3 | (s & 7));
+    }
+
+    void movsd_load(unsigned d, uint32_t displacement) {  // movsd xmm_d, [rdi + displacement]
+        byte(0xf2);
+        rex(false, d, 0);
+        byte(0x0f);
+        byte(0x10);
+        byte(0x80 | (d & 7) << 3 | 7);
+        for (int i = 0; i < 4; ++i) {
+            byte(static_cast<uint8_t>(displacement >> (8 * i)));
+        }
+    }
+
+    void load_imm(unsigned d, double value) {             // mov rax, imm64; movq xmm_d, rax
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        byte(0x48);
+        byte(0xb8);
+        for (int i = 0; i < 8; ++i) {
+            byte(static_cast<uint8_t>(bits >> (8 * i)));
+        }
+        byte(0x66);
+        rex(true, d, 0);
+        byte(0x0f);
+        byte(0x6e);
+        byte(0xc0 | (d & 7) << 3);
+    }
+
+    void movapd(unsigned d, unsigned s) {
+        if (d != s) sse(0x66, 0x28, d, s);
+    }
+
+    void ret() { byte(0xc3); }
+
+private:
+    std::string code_;
+
+    void byte(uint8_t b) { code_ += static_cast<char>(b); }
+
+    void rex(bool w, unsigned reg, unsigned rm) {
+        const uint8_t r = 0x40 | (w ? 8 : 0) | (reg >= 8 ? 4 : 0) | (rm >= 8 ? 1 : 0);
+        if (r != 0x40) byte(r);
+    }
+};
+
+uint8_t arithmetic_opcode(eval::opcode op) {
+    switch (op) {
+    case eval::opcode::add: return 0x58;
+    case eval::opcode::mul: return 0x59;
+    case eval::opcode::sub: return 0x5c;
+    case eval::opcode::div: return 0x5e;
+    default:                break;
+    }
+    throw std::logic_error("Not an arithmetic opcode in jit");
+}
+
+// Returns an empty string if the program doesn't fit in the registers
+std::string assemble(const eval::program& p) {
+    if (p.register_count() + 1 > temp_xmm) {
+        return std::string{};
+    }
+    assembler a;
+    for (const auto& ins : p.instructions()) {
+        switch (ins.op) {
+        case eval::opcode::load_var:
+            a.movsd_load(ins.dst, ins.index * sizeof(double));
+            break;
+        case eval::opcode::load_const:
+            a.load_imm(ins.dst, p.constants()[ins.index]);
+            break;
+        case eval::opcode::copy:
+            a.movapd(ins.dst, ins.a);
+            break;
+        case eval::opcode::neg:
+            a.load_imm(temp_xmm, -0.0);
+            a.movapd(ins.dst, ins.a);
+            a.sse(0x66, 0x57, ins.dst, temp_xmm);           // xorpd
+            break;
+        default: {
+            // Two operand form, dst = a op b
+            const auto opcode = arithmetic_opcode(ins.op);
+            const bool commutative = ins.op == eval::opcode::add || ins.op == eval::opcode::mul;
+            if (ins.dst == ins.a) {
+                a.sse(0xf2, opcode, ins.dst, ins.b);
+            } else if (ins.dst != ins.b) {
+                a.movapd(ins.dst, ins.a);
+                a.sse(0xf2, opcode, ins.dst, ins.b);
+            } else if (commutative) {
+                a.sse(0xf2, opcode, ins.dst, ins.a);
+            } else {
+                a.movapd(temp_xmm, ins.a);
+                a.sse(0xf2, opcode, temp_xmm, ins.b);
+                a.movapd(ins.dst, temp_xmm);
+            }
+        }
+        }
+    }
+    a.movapd(0, static_cast<unsigned>(p.register_count()));
+    a.ret();
+    return a.code();
+}
+
+#endif
+
+} // unnamed namespace
+
+namespace jit {
+
+function::function(const expr& e, const std::vector<std::string>& inputs) : program_(e, inputs), code_(nullptr), code_size_(0) {
+#ifdef SOLVE_JIT_X86_64
+    const auto code = assemble(program_);
+    if (code.empty()) {
+        return;
+    }
+    const size_t page = sysconf(_SC_PAGESIZE);
+    const size_t size = (code.size() + page - 1) / page * page;
+    void* const mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        return;
+    }
+    memcpy(mem, code.data(), code.size());
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, size);
+        return;
+    }
+    code_ = reinterpret_cast<native_function>(mem);
+    code_size_ = size;
+#endif
+}
+
+function::~function() {
+#ifdef SOLVE_JIT_X86_64
+    if (code_) {
+        munmap(reinterpret_cast<void*>(code_), code_size_);
+    }
+#endif
+}
+
+} // namespace jit
@@ -0,0 +1,40 @@
+#ifndef SOLVE_JIT_H
+#define SOLVE_JIT_H
+
+#include <string>
+#include <vector>
+#include "eval.h"
+
+namespace jit {
+
+// A solved expression compiled to straight-line x86-64 SSE2 code in an
+// executable mapping. Elsewhere, or when the expression needs more xmm
+// registers than there are, calls go to the eval::program interpreter.
+class function {
+public:
+    typedef double (*native_function)(const double* values);
+
+    // inputs gives the order of the variables in the array passed when
+    // calling, throws std::runtime_error like eval::program
+    explicit function(const expr& e, const std::vector<std::string>& inputs);
+    ~function();
+
+    function(const function&) = delete;
+    function& operator=(const function&) = delete;
+
+    bool native() const { return code_ != nullptr; }
+    size_t code_size() const { return code_size_; }     // bytes mapped, 0 when interpreted
+
+    double operator()(const double* values) const {
+        return code_ ? code_(values) : program_(values);
+    }
+
+private:
+    eval::program   program_;
+    native_function code_;
+    size_t          code_size_;
+};
+
+} // namespace jit
+
+#endif
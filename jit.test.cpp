@@ -0,0 +1,56 @@
+#include "jit.h"
+#include <iostream>
+#include <assert.h>
+
+namespace {
+
+void test_jit(const expr_ptr& e, const std::vector<std::string>& inputs, bool expect_native) {
+    const jit::function f{*e, inputs};
+    const eval::program p{*e, inputs};
+    if (f.native() != expect_native) {
+        std::cout << "Expected " << e << (expect_native ? "" : " not") << " to be compiled natively" << std::endl;
+        assert(false);
+    }
+    std::vector<double> values(inputs.size());
+    for (int row = 0; row < 100; ++row) {
+        for (size_t i = 0; i < values.size(); ++i) {
+            values[i] = row * (i + 1.5) - 42;
+        }
+        const auto expected = p(values.data()), got = f(values.data());
+        if (!(got == expected || (got != got && expected != expected))) {
+            std::cout << "Native evaluation of " << e << " failed in row " << row << ".\n" << p;
+            std::cout << "Expected: " << expected << "\n";
+            std::cout << "Got: " << got << std::endl;
+            assert(false);
+        }
+    }
+}
+
+expr_ptr balanced(int depth, int& next) {
+    if (depth == 0) {
+        return var("x" + std::to_string(next++ % 3));
+    }
+    auto l = balanced(depth - 1, next);
+    return std::move(l) - balanced(depth - 1, next);
+}
+
+} // unnamed namespace
+
+void jit_test() {
+#if defined(__x86_64__) && defined(__unix__)
+    const bool native = true;
+#else
+    const bool native = false;
+#endif
+    test_jit((var("y") - constant(10)) / constant(4), {"y"}, native);
+    test_jit(var("b"), {"a", "b"}, native);
+    test_jit(constant(-0.25), {}, native);
+    test_jit(-(var("a") * var("b")) + var("a") / (constant(0.5) - -var("b")), {"a", "b"}, native);
+    test_jit(constant(10) / (var("a") - (var("b") - (var("a") / var("b")))), {"a", "b"}, native);
+
+    // Uses all 15 xmm registers available
+    int next = 0;
+    test_jit(balanced(13, next), {"x0", "x1", "x2"}, native);
+    // Doesn't fit in the registers, interpreted
+    test_jit(balanced(14, next), {"x0", "x1", "x2"}, false);
+}
@@ -16,15 +16,32 @@ size_t try_parse(lex::token_type t, const char* text, size_t length) {
         }
         return l;
     } else if (t == lex::token_type::literal) {
-        std::istringstream iss{std::string{text, text+length}};
-        assert(iss.tellg() == 0);
-        double value;
-        if (iss >> value) {
-            const auto l = iss.eof() ? length : static_cast<size_t>(iss.tellg());
-            assert(l != 0);
-            assert(l <= length);
-            return l;
+        // Digits with an optional fraction and exponent, scanned in place
+        size_t l = 0, digits = 0;
+        for (; l < length && isdigit(static_cast<unsigned char>(text[l])); ++l) {
+            ++digits;
         }
+        if (l < length && text[l] == '.') {
+            for (++l; l < length && isdigit(static_cast<unsigned char>(text[l])); ++l) {
+                ++digits;
+            }
+        }
+        if (!digits) {
+            return 0;
+        }
+        if (l < length && (text[l] == 'e' || text[l] == 'E')) {
+            size_t e = l + 1;
+            if (e < length && (text[e] == '+' || text[e] == '-')) {
+                ++e;
+            }
+            if (e < length && isdigit(static_cast<unsigned char>(text[e]))) {
+                while (e < length && isdigit(static_cast<unsigned char>(text[e]))) {
+                    ++e;
+                }
+                l = e;
+            }
+        }
+        return l;
     } else if (length ==1 && static_cast<unsigned char>(*text) == static_cast<unsigned>(t)) {
         return 1;
     } else {
@@ -47,6 +64,8 @@ std::ostream& operator<<(std::ostream& os, token_type t) {
     HANDLE_TOKEN_TYPE(op_sub);
     HANDLE_TOKEN_TYPE(op_div);
     HANDLE_TOKEN_TYPE(op_eq);
+    HANDLE_TOKEN_TYPE(lparen);
+    HANDLE_TOKEN_TYPE(rparen);
     HANDLE_TOKEN_TYPE(identifier);
     HANDLE_TOKEN_TYPE(literal);
     HANDLE_TOKEN_TYPE(separator);
@@ -104,7 +123,7 @@ void tokenizer::next_token() {
         }
 
         // Handle operators
-        for (const auto& op : "*+-/=") {
+        for (const auto& op : "*+-/=()") {
             if (*text == op) {
                 current_ = token{static_cast<token_type>(*text), position_, 1};
                 position_ = position_.advanced_n(1);
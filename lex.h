@@ -13,6 +13,8 @@ enum class token_type {
     op_sub = '-',
     op_div = '/',
     op_eq  = '=',
+    lparen = '(',
+    rparen = ')',
 
     identifier = 256,
     literal,
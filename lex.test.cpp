@@ -67,6 +67,8 @@ void lex_test() {
     test_tokenizer("\thello 42", { identifier("hello", 1, 8), literal("42"), eof() });
     test_tokenizer("\nx + 1e3 = 20", { sep(), identifier("x"), op("+"), literal("1e3", 2, 5), op("="), literal("20"), eof() });
     test_tokenizer("1+2", { literal("1"), op("+"), literal("2"), eof()});
+    test_tokenizer("-(x)", { op("-"), op("("), identifier("x"), op(")"), eof()});
+    test_tokenizer(".5 2. 1E-3 4e", { literal(".5"), literal("2."), literal("1E-3"), literal("4"), identifier("e"), eof()});
 
     const char* const program = R"(
         vals       = 2000
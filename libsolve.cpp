@@ -0,0 +1,52 @@
+#include "libsolve.h"
+#include "parse.h"
+#include "numeric.h"
+#include <ostream>
+#include <stdexcept>
+
+namespace libsolve {
+
+equation context::parse(const std::string& text, const std::string& name) const {
+    expr_allocator::scope s{options_.allocator};
+    source::file src{name, text};
+    return parse_equation(src);
+}
+
+solve_result context::solve(const std::string& v, const expr& lhs, const expr& rhs, solve_options options) const {
+    expr_allocator::scope s{options_.allocator};
+    options.trace = options_.trace;
+    if (!options.profile) {
+        options.profile = options_.profile;
+    }
+    return solver::solve(v, lhs, rhs, options);
+}
+
+solution_map context::solve_all(const expr& lhs, const expr& rhs, solve_status* status) const {
+    expr_allocator::scope s{options_.allocator};
+    return solver::solve_all(lhs, rhs, options_.trace, options_.profile, status);
+}
+
+double context::evaluate(const expr& e, const std::map<std::string, double>& values) const {
+    expr_allocator::scope s{options_.allocator};
+    const auto bound = numeric::bind(e, values);
+    if (auto c = expr_cast<const_expr>(*bound)) {
+        return c->value();
+    }
+    const auto vars = find_vars_in_expr(*bound);
+    throw std::runtime_error("No value for " + (vars.empty() ? std::string{"variable"} : *vars.begin()));
+}
+
+size_t context::solve_line(const std::string& line, std::ostream& out) const {
+    const auto eq = parse(line);
+    solve_status status;
+    const auto solutions = solve_all(*eq.first, *eq.second, &status);
+    for (const auto& s : solutions) {
+        out << s.first << " = " << *s.second << "\n";
+    }
+    if (status == solve_status::no_solution || status == solve_status::any_value) {
+        out << status << "\n";
+    }
+    return solutions.size();
+}
+
+} // namespace libsolve
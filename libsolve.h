@@ -0,0 +1,62 @@
+#ifndef SOLVE_LIBSOLVE_H
+#define SOLVE_LIBSOLVE_H
+
+#include <iosfwd>
+#include <map>
+#include <string>
+#include "expr.h"
+#include "solver.h"
+
+// Entry points for embedding the solver in another program. Nothing is
+// written anywhere but the sinks passed in and no self-tests run; errors
+// are reported by throwing std::runtime_error. Link with libsolve.a or
+// libsolve.so (make lib).
+namespace libsolve {
+
+struct options {
+    options() : trace(nullptr), allocator(nullptr), profile(nullptr) {}
+
+    std::ostream*   trace;     // search steps, nullptr for nowhere
+    expr_allocator* allocator; // expression nodes, nullptr for operator new
+    // Learned from and used by the context's searches, nullptr for none.
+    // Keep it across runs with rule_profile::load_file and save_file.
+    rule_profile*   profile;
+};
+
+typedef std::pair<expr_ptr, expr_ptr> equation;
+typedef std::map<std::string, expr_ptr> solution_map;
+
+// Every call makes its nodes with the allocator in options, which must
+// outlive the expressions returned. A context may be used by one thread at
+// a time, use one per thread to solve in parallel.
+class context {
+public:
+    explicit context(const options& opts = options{}) : options_(opts) {}
+
+    const options& settings() const { return options_; }
+
+    // "lhs = rhs"
+    equation parse(const std::string& text, const std::string& name = "<input>") const;
+
+    // options.trace is replaced by the one of the context, and so is a null
+    // options.profile
+    solve_result solve(const std::string& v, const expr& lhs, const expr& rhs, solve_options options = solve_options{}) const;
+
+    // status as for solver::solve_all
+    solution_map solve_all(const expr& lhs, const expr& rhs, solve_status* status = nullptr) const;
+
+    // Value of e, throws if it has a variable not in values
+    double evaluate(const expr& e, const std::map<std::string, double>& values) const;
+
+    // Parses and solves a line of input for all of its variables, writing
+    // "v = solution" lines to out, or "no solution" or "any value". Returns
+    // the number of solutions.
+    size_t solve_line(const std::string& line, std::ostream& out) const;
+
+private:
+    options options_;
+};
+
+} // namespace libsolve
+
+#endif
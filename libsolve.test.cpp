@@ -0,0 +1,137 @@
+#include "libsolve.h"
+#include "rule_profile.h"
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <assert.h>
+
+namespace {
+
+class counting_allocator : public expr_allocator {
+public:
+    counting_allocator() : allocations(0), live_bytes(0) {}
+
+    virtual void* allocate(size_t size) override {
+        ++allocations;
+        live_bytes += size;
+        return ::operator new(size);
+    }
+    virtual void deallocate(void* p, size_t size) override {
+        assert(live_bytes >= size);
+        live_bytes -= size;
+        ::operator delete(p);
+    }
+
+    size_t allocations;
+    size_t live_bytes;
+};
+
+// Runs f with std::cout captured, returns what was written to it
+template<typename F>
+std::string captured_cout(F f) {
+    std::ostringstream captured;
+    auto old = std::cout.rdbuf(captured.rdbuf());
+    try {
+        f();
+    } catch (...) {
+        std::cout.rdbuf(old);
+        throw;
+    }
+    std::cout.rdbuf(old);
+    return captured.str();
+}
+
+void test_quiet() {
+    const libsolve::context ctx;
+    std::ostringstream out;
+    const auto written = captured_cout([&] {
+        assert(ctx.solve_line("X*42+300=0-200", out) == 1);
+        const auto eq = ctx.parse("2*A+B=7");
+        assert(ctx.solve_all(*eq.first, *eq.second).size() == 2);
+        bool thrown = false;
+        try {
+            ctx.parse("2*A+");
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        assert(thrown);
+    });
+    if (!written.empty()) {
+        std::cout << "libsolve wrote to std::cout:\n" << written << std::endl;
+        assert(false);
+    }
+    assert(out.str().compare(0, 4, "X = ") == 0);
+
+    // Equations without solution expressions say why
+    std::ostringstream verdicts;
+    assert(ctx.solve_line("X+1=X", verdicts) == 0);
+    assert(ctx.solve_line("X=X", verdicts) == 0);
+    assert(verdicts.str() == "no solution\nany value\n");
+}
+
+void test_trace() {
+    std::ostringstream trace;
+    libsolve::options opts;
+    opts.trace = &trace;
+    const libsolve::context ctx{opts};
+    std::ostringstream out;
+    const auto written = captured_cout([&] { ctx.solve_line("Y+Z=500", out); });
+    assert(written.empty());
+    assert(!trace.str().empty());
+    assert(out.str().find("Y = ") != std::string::npos && out.str().find("Z = ") != std::string::npos);
+}
+
+void test_profile() {
+    rule_profile profile;
+    libsolve::options opts;
+    opts.trace = nullptr;
+    opts.profile = &profile;
+    const libsolve::context ctx{opts};
+    const auto eq = ctx.parse("(V+1)*U=7");
+    const auto r = ctx.solve("V", *eq.first, *eq.second);
+    assert(r.status == solve_status::solved);
+    assert(profile.solves() == 1);
+    std::ostringstream out;
+    ctx.solve_line("A*B+C=9", out);
+    assert(profile.solves() == 2);
+}
+
+void test_allocator() {
+    counting_allocator a;
+    libsolve::options opts;
+    opts.allocator = &a;
+    {
+        const libsolve::context ctx{opts};
+        const auto eq = ctx.parse("-(W+2)*3=W-10");
+        const size_t after_parse = a.allocations;
+        assert(after_parse > 0 && a.live_bytes > 0);
+        const auto r = ctx.solve("W", *eq.first, *eq.second);
+        assert(r.status == solve_status::solved);
+        assert(a.allocations > after_parse);
+        assert(ctx.evaluate(*r.solution, {}) == 1);
+
+        // Nodes made outside the context don't touch the allocator
+        const size_t before = a.allocations;
+        const auto e = var("x") * constant(2);
+        assert(a.allocations == before);
+        assert(ctx.evaluate(*e, {{"x", 4}}) == 8);
+        bool thrown = false;
+        try {
+            ctx.evaluate(*e, {});
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+    // Everything from the context has been freed through it
+    assert(a.live_bytes == 0);
+}
+
+} // unnamed namespace
+
+void libsolve_test() {
+    test_quiet();
+    test_trace();
+    test_profile();
+    test_allocator();
+}
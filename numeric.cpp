@@ -0,0 +1,202 @@
+#include "numeric.h"
+#include "eval.h"
+#include <algorithm>
+#include <vector>
+#include <stdexcept>
+#include <math.h>
+
+namespace {
+
+// Steps stop when they get this small relative to x, and a root must make
+// lhs and rhs agree to this relative to their size
+const double step_tolerance = 1e-13;
+const double root_tolerance = 1e-9;
+
+bool close(double a, double b) {
+    return isfinite(a) && isfinite(b) && fabs(a - b) <= root_tolerance * std::max(1.0, std::max(fabs(a), fabs(b)));
+}
+
+expr_ptr do_derivative(const expr& e, const std::string& v) {
+    if (expr_cast<const_expr>(e)) {
+        return constant(0);
+    } else if (auto ve = expr_cast<var_expr>(e)) {
+        return constant(ve->name() == v ? 1 : 0);
+    } else if (auto ne = expr_cast<negation_expr>(e)) {
+        return -do_derivative(ne->e(), v);
+    } else if (auto be = expr_cast<bin_op_expr>(e)) {
+        const auto& a = be->lhs();
+        const auto& b = be->rhs();
+        switch (be->op()) {
+        case '+': return do_derivative(a, v) + do_derivative(b, v);
+        case '-': return do_derivative(a, v) - do_derivative(b, v);
+        case '*': return do_derivative(a, v) * b + a * do_derivative(b, v);
+        case '/': return (do_derivative(a, v) * b - a * do_derivative(b, v)) / (b * b);
+        }
+    }
+    throw std::logic_error("Unknown expression type in derivative");
+}
+
+expr_ptr do_bind(const expr& e, const std::map<std::string, double>& values) {
+    if (auto ve = expr_cast<var_expr>(e)) {
+        auto it = values.find(ve->name());
+        return it != values.end() ? constant(it->second) : e.clone();
+    } else if (auto ne = expr_cast<negation_expr>(e)) {
+        return -do_bind(ne->e(), values);
+    } else if (auto be = expr_cast<bin_op_expr>(e)) {
+        auto l = do_bind(be->lhs(), values);
+        return do_op(be->op(), std::move(l), do_bind(be->rhs(), values));
+    }
+    return e.clone();
+}
+
+class root_finder {
+public:
+    root_finder(const std::string& v, const expr& lhs, const expr& rhs, unsigned max_steps)
+        : lhs_(lhs, {v})
+        , rhs_(rhs, {v})
+        , f_(*simplify(*(lhs.clone() - rhs.clone())), {v})
+        , df_(*numeric::derivative(*(lhs.clone() - rhs.clone()), v), {v})
+        , max_steps_(max_steps)
+        , steps_(0) {
+    }
+
+    unsigned steps() const { return steps_; }
+
+    bool is_root(double x) const {
+        return close(lhs_(&x), rhs_(&x));
+    }
+
+    double f(double x) {
+        ++steps_;
+        return f_(&x);
+    }
+
+    double df(double x) const {
+        return df_(&x);
+    }
+
+    bool exhausted() const {
+        return steps_ >= max_steps_;
+    }
+
+    // Newton's method, halving steps that don't decrease |f|
+    bool newton(double& x) {
+        double fx = f(x);
+        while (!exhausted() && isfinite(fx) && fx != 0) {
+            const double d = df(x);
+            if (!isfinite(d) || d == 0) {
+                return false;
+            }
+            double step = fx / d, nx = x, nf = fx;
+            for (int halvings = 0;; ++halvings) {
+                if (halvings == 50 || exhausted()) {
+                    return false;
+                }
+                nx = x - step;
+                nf = f(nx);
+                if (isfinite(nf) && fabs(nf) < fabs(fx)) {
+                    break;
+                }
+                step /= 2;
+            }
+            const bool converged = fabs(nx - x) <= step_tolerance * std::max(1.0, fabs(nx));
+            x = nx;
+            fx = nf;
+            if (converged) {
+                break;
+            }
+        }
+        return is_root(x);
+    }
+
+    // f(a) and f(b) have different signs, take Newton steps while they stay
+    // inside the bracket and shrink it fast enough, bisect otherwise
+    bool bracketed(double a, double fa, double b, double& x) {
+        x = (a + b) / 2;
+        double last_width = fabs(b - a) * 2;
+        while (!exhausted()) {
+            const double fx = f(x);
+            if (fx == 0 || !isfinite(fx)) {
+                break;
+            }
+            if ((fx < 0) == (fa < 0)) {
+                a = x;
+                fa = fx;
+            } else {
+                b = x;
+            }
+            const double width = fabs(b - a);
+            if (width <= step_tolerance * std::max(1.0, fabs(x))) {
+                break;
+            }
+            const double n = x - fx / df(x);
+            if (isfinite(n) && n > std::min(a, b) && n < std::max(a, b) && width < last_width / 2) {
+                x = n;
+            } else {
+                x = (a + b) / 2;
+            }
+            last_width = width;
+        }
+        return is_root(x);
+    }
+
+private:
+    eval::program lhs_;
+    eval::program rhs_;
+    eval::program f_;
+    eval::program df_;
+    unsigned      max_steps_;
+    unsigned      steps_;
+};
+
+} // unnamed namespace
+
+namespace numeric {
+
+expr_ptr derivative(const expr& e, const std::string& v) {
+    return simplify(*do_derivative(e, v));
+}
+
+expr_ptr bind(const expr& e, const std::map<std::string, double>& values) {
+    return simplify(*do_bind(e, values));
+}
+
+root find_root(const std::string& v, const expr& lhs, const expr& rhs, unsigned max_steps) {
+    root_finder rf{v, lhs, rhs, max_steps};
+    double x = 1;
+    if (rf.newton(x)) {
+        return root{true, x, rf.steps()};
+    }
+
+    // Look for sign changes at 0 and +-2^k, nearest to 1 first
+    std::vector<double> xs{0};
+    for (int k = -8; k <= 64; ++k) {
+        xs.push_back(ldexp(1.0, k));
+        xs.push_back(-ldexp(1.0, k));
+    }
+    std::sort(xs.begin(), xs.end());
+    std::vector<double> fs;
+    for (const auto s : xs) {
+        fs.push_back(rf.f(s));
+        if (fs.back() == 0 && rf.is_root(s)) {
+            return root{true, s, rf.steps()};
+        }
+    }
+    std::vector<size_t> brackets;
+    for (size_t i = 0; i + 1 < xs.size(); ++i) {
+        if (isfinite(fs[i]) && isfinite(fs[i + 1]) && (fs[i] < 0) != (fs[i + 1] < 0)) {
+            brackets.push_back(i);
+        }
+    }
+    std::sort(brackets.begin(), brackets.end(), [&](size_t a, size_t b) {
+        return std::min(fabs(xs[a] - 1), fabs(xs[a + 1] - 1)) < std::min(fabs(xs[b] - 1), fabs(xs[b + 1] - 1));
+    });
+    for (const auto i : brackets) {
+        if (rf.bracketed(xs[i], fs[i], xs[i + 1], x)) {
+            return root{true, x, rf.steps()};
+        }
+    }
+    return root{false, NAN, rf.steps()};
+}
+
+} // namespace numeric
@@ -0,0 +1,30 @@
+#ifndef SOLVE_NUMERIC_H
+#define SOLVE_NUMERIC_H
+
+#include <string>
+#include <map>
+#include "expr.h"
+
+namespace numeric {
+
+// d e / d v, simplified
+expr_ptr derivative(const expr& e, const std::string& v);
+
+// e with the variables in values replaced by constants, simplified
+expr_ptr bind(const expr& e, const std::map<std::string, double>& values);
+
+struct root {
+    bool     found;
+    double   x;
+    unsigned steps;  // evaluations of lhs - rhs
+};
+
+// A root of "lhs = rhs" where v is the only variable. Damped Newton from
+// x = 1 first, then a scan for a sign change followed by Newton steps
+// safeguarded by bisection. Roots are checked against lhs and rhs, so a
+// sign change across a pole isn't mistaken for one.
+root find_root(const std::string& v, const expr& lhs, const expr& rhs, unsigned max_steps = 500);
+
+} // namespace numeric
+
+#endif
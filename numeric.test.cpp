@@ -0,0 +1,71 @@
+#include "numeric.h"
+#include "eval.h"
+#include <iostream>
+#include <math.h>
+#include <assert.h>
+
+namespace {
+
+void test_derivative(const expr_ptr& e, const std::string& v, const expr_ptr& expected) {
+    auto d = numeric::derivative(*e, v);
+    if (!d->equal(*expected)) {
+        std::cout << "Derivative of " << e << " with respect to " << v << " failed.\n";
+        std::cout << "Expected: " << expected << "\n";
+        std::cout << "Got: " << d << std::endl;
+        assert(false);
+    }
+}
+
+// Compare with a central difference
+void test_derivative_value(const expr_ptr& e) {
+    const eval::program f{*e, {"x"}}, df{*numeric::derivative(*e, "x"), {"x"}};
+    for (double x : { -2.5, 0.5, 3.0 }) {
+        const double h = 1e-6, lo = x - h, hi = x + h;
+        const double estimate = (f(&hi) - f(&lo)) / (2 * h);
+        if (fabs(estimate - df(&x)) > 1e-5 * (1 + fabs(estimate))) {
+            std::cout << "Derivative of " << e << " at " << x << " is wrong.\n";
+            std::cout << "Expected: " << estimate << "\n";
+            std::cout << "Got: " << df(&x) << std::endl;
+            assert(false);
+        }
+    }
+}
+
+void test_root(const expr_ptr& lhs, const expr_ptr& rhs, bool expect_found) {
+    const auto r = numeric::find_root("x", *lhs, *rhs);
+    bool ok = r.found == expect_found;
+    if (ok && r.found) {
+        const eval::program l{*lhs, {"x"}}, rr{*rhs, {"x"}};
+        ok = fabs(l(&r.x) - rr(&r.x)) <= 1e-9 * (1 + fabs(l(&r.x)));
+    }
+    if (!ok) {
+        std::cout << "Numeric root of " << lhs << " = " << rhs << " failed.\n";
+        std::cout << "Expected: " << (expect_found ? "a root" : "no root") << "\n";
+        std::cout << "Got: " << (r.found ? "x = " + std::to_string(r.x) : "no root") << " after " << r.steps << " steps" << std::endl;
+        assert(false);
+    }
+}
+
+} // unnamed namespace
+
+void numeric_test() {
+    test_derivative(constant(42), "x", constant(0));
+    test_derivative(var("y"), "x", constant(0));
+    test_derivative(var("x") * var("x"), "x", constant(2) * var("x"));
+    test_derivative(var("x") * var("y") - var("y"), "x", var("y"));
+
+    test_derivative_value((var("x") * var("x") + constant(1)) / (var("x") + constant(3)));
+    test_derivative_value(-(var("x") * var("x") * var("x")) / (constant(10) - var("x")));
+
+    auto bound = numeric::bind(*(var("x") * var("y") + var("y")), {{"y", 2}});
+    assert(bound->equal(*(var("x") * constant(2) + constant(2))));
+
+    test_root(var("x") * var("x") * var("x"), constant(2), true);
+    test_root((var("x") * var("x") + constant(1)) / (var("x") + constant(3)), constant(5), true);
+    // Newton from x = 1 heads away from the root, which is found by bracketing
+    test_root(var("x") * var("x") * var("x") - constant(2) * var("x"), constant(-30), true);
+    test_root(constant(1) / (var("x") - constant(1e6)), constant(-1e-12), true);
+    // Sign change across the pole at 0.3 only
+    test_root((var("x") * var("x") + constant(1)) / (var("x") - constant(0.3)), constant(0), false);
+    test_root(var("x") / (var("x") * var("x") + constant(1)), constant(10), false);
+}
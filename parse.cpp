@@ -0,0 +1,104 @@
+#include "parse.h"
+#include <iostream>
+#include <stdexcept>
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+namespace {
+
+// Operators binding tighter than '=' make up each side of an equation
+const int arithmetic_bp = ast::find_operator(lex::token_type::op_eq)->left_bp + 1;
+
+// Makes solver expressions, folding operations on constants
+struct expr_builder {
+    expr_ptr leaf(const lex::token& tok) {
+        const char* const text = tok.position().data();
+        if (tok.type() == lex::token_type::identifier) {
+            return var(std::string(text, tok.length()));
+        }
+        rational exact;
+        if (rational::parse(text, tok.length(), exact)) {
+            return constant(exact);
+        }
+        // The source is nul terminated, so strtod can read it in place
+        char* end;
+        const double value = strtod(text, &end);
+        return constant(end == text + tok.length() ? value : std::stod(tok.str()));
+    }
+
+    expr_ptr prefix(const lex::token&, expr_ptr operand) {
+        if (auto c = expr_cast<const_expr>(*operand)) {
+            return negate_constant(*c);
+        }
+        return -std::move(operand);
+    }
+
+    expr_ptr infix(const lex::token& op, expr_ptr lhs, expr_ptr rhs) {
+        if (op.type() == lex::token_type::op_eq) {
+            throw ast::parse_error(op, "Unexpected '=' inside an expression");
+        }
+        const char c = static_cast<char>(op.type());
+        const auto l = expr_cast<const_expr>(*lhs);
+        const auto r = expr_cast<const_expr>(*rhs);
+        if (l && r) {
+            auto folded = fold_constants(c, *l, *r);
+            if (isfinite(expr_cast<const_expr>(*folded)->value())) {
+                return folded;
+            }
+        }
+        return do_op(c, std::move(lhs), std::move(rhs));
+    }
+};
+
+} // unnamed namespace
+
+void print_ast(const ast::expression& expr) {
+    std::cout << expr.start_token().position() << " ==> " << expr.repr() << std::endl;
+}
+
+expr_ptr ast_to_expr(const ast::expression& e)
+{
+    if (auto l = dynamic_cast<const ast::literal_expression*>(&e)) {
+        return constant(l->value());
+    } else if (auto a = dynamic_cast<const ast::atom_expression*>(&e)) {
+        return var(a->start_token().str());
+    } else if (auto u = dynamic_cast<const ast::unary_operation*>(&e)) {
+        return -ast_to_expr(u->operand());
+    } else if (auto b = dynamic_cast<const ast::binary_operation*>(&e)) {
+        // lazy error checking...
+        return do_op(b->op(), ast_to_expr(b->lhs()), ast_to_expr(b->rhs()));
+    }
+    throw std::logic_error("Don't know how to handle " + e.repr());
+}
+
+std::pair<expr_ptr, expr_ptr> expr_parser::parse_equation() {
+    skip_separators();
+    auto lhs = parse_expression();
+    if (tokenizer_.current().type() != lex::token_type::op_eq) {
+        throw ast::parse_error(tokenizer_.current(), "Expected '=' expression at top level");
+    }
+    tokenizer_.consume();
+    auto rhs = parse_expression();
+    skip_separators();
+    if (!eof()) {
+        throw ast::parse_error(tokenizer_.current(), "Expected end of line");
+    }
+    return std::make_pair(std::move(lhs), std::move(rhs));
+}
+
+expr_ptr expr_parser::parse_expression() {
+    expr_builder builder;
+    return ast::parse_operators(tokenizer_, arithmetic_bp, builder);
+}
+
+void expr_parser::skip_separators() {
+    while (tokenizer_.current().type() == lex::token_type::separator) {
+        tokenizer_.consume();
+    }
+}
+
+std::pair<expr_ptr, expr_ptr> parse_equation(const source::file& src)
+{
+    return expr_parser{src}.parse_equation();
+}
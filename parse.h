@@ -0,0 +1,39 @@
+#ifndef SOLVE_PARSE_H
+#define SOLVE_PARSE_H
+
+#include "ast.h"
+#include "expr.h"
+#include <utility>
+
+void print_ast(const ast::expression& expr);
+
+expr_ptr ast_to_expr(const ast::expression& e);
+
+// Builds solver expressions straight from the tokens by Pratt parsing,
+// folding operations on two constants as it goes. Unlike ast::parser no
+// syntax tree is kept, use that for diagnostics.
+class expr_parser {
+public:
+    explicit expr_parser(const source::file& src) : src_(src), tokenizer_(src_) {
+    }
+
+    bool eof() {
+        return tokenizer_.eof();
+    }
+
+    // "lhs = rhs" up to the end of the line, throws std::runtime_error otherwise
+    std::pair<expr_ptr, expr_ptr> parse_equation();
+
+    expr_ptr parse_expression();
+
+private:
+    const source::file& src_;
+    lex::tokenizer      tokenizer_;
+
+    void skip_separators();
+};
+
+// Parse a single "lhs = rhs", throws std::runtime_error otherwise
+std::pair<expr_ptr, expr_ptr> parse_equation(const source::file& src);
+
+#endif
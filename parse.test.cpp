@@ -0,0 +1,103 @@
+#include "parse.h"
+#include <iostream>
+#include <stdexcept>
+#include <assert.h>
+
+namespace {
+
+// The direct parser must agree with going through the ast, up to folding
+void test_same_as_ast(const char* text) {
+    source::file src{text, text};
+    const auto direct = parse_equation(src);
+    ast::parser p{src};
+    auto a = p.parse_expression();
+    auto top = dynamic_cast<const ast::binary_operation*>(&*a);
+    assert(top && top->op() == '=');
+    const auto lhs = simplify(*ast_to_expr(top->lhs()));
+    const auto rhs = simplify(*ast_to_expr(top->rhs()));
+    if (!simplify(*direct.first)->equal(*lhs) || !simplify(*direct.second)->equal(*rhs)) {
+        std::cout << "Direct parse of '" << text << "' failed.\n";
+        std::cout << "Expected: " << lhs << " = " << rhs << "\n";
+        std::cout << "Got: " << direct.first << " = " << direct.second << std::endl;
+        assert(false);
+    }
+}
+
+void test_parse(const char* text, const expr_ptr& lhs, const expr_ptr& rhs) {
+    source::file src{text, text};
+    const auto res = parse_equation(src);
+    if (!res.first->equal(*lhs) || !res.second->equal(*rhs)) {
+        std::cout << "Direct parse of '" << text << "' failed.\n";
+        std::cout << "Expected: " << lhs << " = " << rhs << "\n";
+        std::cout << "Got: " << res.first << " = " << res.second << std::endl;
+        assert(false);
+    }
+}
+
+void test_error(const char* text) {
+    source::file src{text, text};
+    try {
+        parse_equation(src);
+    } catch (const std::runtime_error&) {
+        return;
+    }
+    std::cout << "Expected '" << text << "' to be rejected" << std::endl;
+    assert(false);
+}
+
+// Nesting is handled with an explicit stack, not recursion
+void test_deep_nesting() {
+    const unsigned n = 20000;
+    std::string text(n, '(');
+    text += "x";
+    for (unsigned i = 0; i < n; ++i) {
+        text += "+1)";
+    }
+    text += "=";
+    expr_ptr lhs = var("x"), rhs = var("y");
+    for (unsigned i = 0; i < n; ++i) {
+        text += "-";
+        lhs = std::move(lhs) + constant(1);
+        rhs = -std::move(rhs);
+    }
+    text += "y";
+    test_parse(text.c_str(), lhs, rhs);
+}
+
+} // unnamed namespace
+
+void parse_test()
+{
+    test_same_as_ast("x=1+2*y");
+    test_same_as_ast("x=1+2-y/3");
+    test_same_as_ast("a*b-c/d+e=f");
+    test_same_as_ast("2/3*x-5+y=hello+4e3");
+    test_same_as_ast("X*42+300=0-200");
+    test_same_as_ast("-x*(y+2)=(3-z)/-(w)");
+
+    // Folding, also of leading constants left of a variable but not across it
+    test_parse("x=1+2*3", var("x"), constant(7));
+    test_parse("x=2*3*y", var("x"), constant(6) * var("y"));
+    test_parse("x=y*2*3", var("x"), var("y") * constant(2) * constant(3));
+    test_parse("\n  zzz = 20 - 4e1 / 8\n", var("zzz"), constant(15));
+    test_parse("x=1/0", var("x"), constant(1) / constant(0));
+    test_parse("x=0.5", var("x"), constant(0.5));
+    test_parse("x=0.1+0.2", var("x"), constant(rational(3, 10)));
+    test_parse("x=1/3*3", var("x"), constant(1));
+    test_parse("x=-(2*3)+(1+1)*y", var("x"), constant(-6) + constant(2) * var("y"));
+    test_parse("-x=--y", -var("x"), -(-var("y")));
+
+    test_error("x");
+    test_error("x=");
+    test_error("x+");
+    test_error("=x");
+    test_error("x=y z");
+    test_error("a=b=c");
+    test_error("x=(y");
+    test_error("x=y)");
+    test_error("(x=y)");
+    test_error("x=(y=2)");
+    test_error("x=()");
+
+    test_deep_nesting();
+}
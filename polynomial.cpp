@@ -0,0 +1,286 @@
+#include "polynomial.h"
+#include <algorithm>
+#include <stdexcept>
+#include <math.h>
+
+namespace {
+
+// Bound on the intermediate degree, e.g. of x*x*...*x / x
+const size_t extraction_degree_limit = 64;
+
+// A sum this much smaller than the terms that went into it is rounding
+// noise, e.g. x*x*0.1*3 - x*x*0.3
+const double negligible = 1e-12;
+
+typedef std::vector<double> poly;
+
+// A double coefficient along with the sum of the magnitudes of the terms
+// that make it up, so cancellation down to rounding noise shows and can be
+// taken for the zero it is
+struct rounded {
+    double value;
+    double size;
+
+    rounded(double v = 0) : value(v), size(fabs(v)) {}
+    rounded(double v, double s) : value(v), size(s) {}
+};
+
+rounded operator-(const rounded& a) { return rounded{-a.value, a.size}; }
+rounded operator+(const rounded& a, const rounded& b) {
+    const double value = a.value + b.value;
+    const double size = a.size + b.size;
+    return isfinite(size) && fabs(value) <= negligible * size ? rounded{0, 0} : rounded{value, size};
+}
+rounded operator-(const rounded& a, const rounded& b) { return a + -b; }
+rounded operator*(const rounded& a, const rounded& b) { return rounded{a.value * b.value, a.size * b.size}; }
+rounded operator/(const rounded& a, const rounded& b) { return rounded{a.value / b.value, a.size / fabs(b.value)}; }
+
+bool is_zero(double c) { return c == 0; }
+bool is_zero(const rounded& c) { return c.value == 0; }
+bool is_zero(const rational& c) { return c.zero(); }
+
+// The coefficient a constant contributes, exact ones only for rational. inf
+// and NaN aren't coefficients of anything.
+bool coefficient(const const_expr& c, rounded& out) {
+    if (!isfinite(c.value())) return false;
+    out = rounded{c.value()};
+    return true;
+}
+
+bool coefficient(const const_expr& c, rational& out) {
+    if (!c.exact()) return false;
+    out = c.exact_value();
+    return true;
+}
+
+template<typename T>
+void trim(std::vector<T>& p) {
+    while (p.size() > 1 && is_zero(p.back())) {
+        p.pop_back();
+    }
+}
+
+template<typename T>
+std::vector<T> add(const std::vector<T>& a, const std::vector<T>& b, bool subtract) {
+    std::vector<T> res(std::max(a.size(), b.size()));
+    for (size_t i = 0; i < a.size(); ++i) res[i] = a[i];
+    for (size_t i = 0; i < b.size(); ++i) res[i] = subtract ? res[i] - b[i] : res[i] + b[i];
+    trim(res);
+    return res;
+}
+
+template<typename T>
+std::vector<T> multiply(const std::vector<T>& a, const std::vector<T>& b) {
+    std::vector<T> res(a.size() + b.size() - 1);
+    for (size_t i = 0; i < a.size(); ++i) {
+        for (size_t j = 0; j < b.size(); ++j) {
+            res[i + j] = res[i + j] + a[i] * b[j];
+        }
+    }
+    trim(res);
+    return res;
+}
+
+// Folded bottom up, an empty poly marks a subexpression that isn't a
+// polynomial in v
+template<typename T>
+bool extract(const expr& e, const std::string& v, std::vector<T>& out) {
+    typedef std::vector<T> poly;
+    out = fold_expr<poly>(e, [&v](const expr& n, poly* operands) {
+        if (auto c = expr_cast<const_expr>(n)) {
+            T value;
+            return coefficient(*c, value) ? poly{value} : poly{};
+        } else if (auto ve = expr_cast<var_expr>(n)) {
+            return ve->name() == v ? poly{T(0), T(1)} : poly{};
+        }
+        for (size_t i = 0; i < n.operand_count(); ++i) {
+            if (operands[i].empty()) return poly{};
+        }
+        if (expr_cast<negation_expr>(n)) {
+            poly res = std::move(operands[0]);
+            for (auto& c : res) c = -c;
+            return res;
+        }
+        const auto& l = operands[0];
+        const auto& r = operands[1];
+        poly res;
+        switch (expr_cast<bin_op_expr>(n)->op()) {
+        case '+': res = add(l, r, false); break;
+        case '-': res = add(l, r, true); break;
+        case '*': res = multiply(l, r); break;
+        case '/':
+            if (r.size() != 1 || is_zero(r[0])) return poly{};
+            res = l;
+            for (auto& c : res) c = c / r[0];
+            break;
+        default:
+            return poly{};
+        }
+        return res.size() <= extraction_degree_limit + 1 ? res : poly{};
+    });
+    return !out.empty();
+}
+
+double evaluate(const poly& p, double x) {
+    double res = 0;
+    for (size_t i = p.size(); i--;) {
+        res = res * x + p[i];
+    }
+    return res;
+}
+
+double evaluate_derivative(const poly& p, double x) {
+    double res = 0;
+    for (size_t i = p.size(); --i;) {
+        res = res * x + i * p[i];
+    }
+    return res;
+}
+
+// A couple of Newton steps to clean up the rounding in the formulas,
+// kept only while they improve the residual
+double polish(const poly& p, double x) {
+    for (int i = 0; i < 3; ++i) {
+        const double d = evaluate_derivative(p, x);
+        if (d == 0) break;
+        const double nx = x - evaluate(p, x) / d;
+        if (!isfinite(nx) || fabs(evaluate(p, nx)) >= fabs(evaluate(p, x))) break;
+        x = nx;
+    }
+    return x;
+}
+
+// Monic quadratic x^2 + b x + c, avoiding cancellation between -b and the
+// square root of the discriminant
+void quadratic(double b, double c, std::vector<double>& out) {
+    const double d = b * b - 4 * c;
+    if (d < 0) return;
+    if (d == 0) {
+        out.push_back(-b / 2);
+        return;
+    }
+    const double q = -(b + (b < 0 ? -sqrt(d) : sqrt(d))) / 2;
+    out.push_back(q);
+    out.push_back(c / q);
+}
+
+// Monic cubic x^3 + a x^2 + b x + c
+void cubic(double a, double b, double c, std::vector<double>& out) {
+    const double q = (a * a - 3 * b) / 9;
+    const double r = (2 * a * a * a - 9 * a * b + 27 * c) / 54;
+    const double q3 = q * q * q;
+    if (r * r < q3) {
+        // Three real roots
+        const double theta = acos(std::max(-1.0, std::min(1.0, r / sqrt(q3))));
+        const double m = -2 * sqrt(q);
+        for (int k = 0; k < 3; ++k) {
+            out.push_back(m * cos((theta + 2 * M_PI * k) / 3) - a / 3);
+        }
+        return;
+    }
+    const double big = -(r < 0 ? -1 : 1) * cbrt(fabs(r) + sqrt(r * r - q3));
+    const double small = big == 0 ? 0 : q / big;
+    out.push_back(big + small - a / 3);
+    // A double root where the discriminant vanishes
+    if (big != 0 && fabs(big - small) <= 1e-12 * fabs(big)) {
+        out.push_back(-(big + small) / 2 - a / 3);
+    }
+}
+
+// Monic quartic x^4 + a x^3 + b x^2 + c x + d (Ferrari)
+void quartic(double a, double b, double c, double d, std::vector<double>& out) {
+    // y^4 + p y^2 + q y + r with x = y - a/4
+    const double a2 = a * a;
+    const double p = b - 3 * a2 / 8;
+    const double q = c - a * b / 2 + a2 * a / 8;
+    const double r = d - a * c / 4 + a2 * b / 16 - 3 * a2 * a2 / 256;
+    std::vector<double> ys;
+    if (fabs(q) <= 1e-14 * std::max(1.0, fabs(p) + fabs(r))) {
+        // Biquadratic
+        std::vector<double> zs;
+        quadratic(p, r, zs);
+        for (const auto z : zs) {
+            if (z >= 0) {
+                ys.push_back(sqrt(z));
+                ys.push_back(-sqrt(z));
+            }
+        }
+    } else {
+        // The resolvent cubic m^3 + p m^2 + (p^2/4 - r) m - q^2/8 has a
+        // positive root, which splits the quartic into two quadratics
+        std::vector<double> ms;
+        cubic(p, p * p / 4 - r, -q * q / 8, ms);
+        const double m = *std::max_element(ms.begin(), ms.end());
+        if (m <= 0) return;
+        const double s = sqrt(2 * m);
+        quadratic(-s, p / 2 + m + q / (2 * s), ys);
+        quadratic(s, p / 2 + m - q / (2 * s), ys);
+    }
+    for (const auto y : ys) {
+        out.push_back(y - a / 4);
+    }
+}
+
+} // unnamed namespace
+
+namespace polynomial {
+
+bool coefficients(const expr& e, const std::string& v, std::vector<double>& out) {
+    // Exact coefficients know their zeros for sure
+    std::vector<rational> exact;
+    if (extract(e, v, exact)) {
+        out.clear();
+        for (const auto& c : exact) {
+            out.push_back(c.to_double());
+        }
+    } else {
+        std::vector<rounded> approximate;
+        if (!extract(e, v, approximate)) {
+            return false;
+        }
+        out.clear();
+        for (const auto& c : approximate) {
+            out.push_back(c.value);
+        }
+    }
+    // Overflowed along the way
+    for (const auto c : out) {
+        if (!isfinite(c)) return false;
+    }
+    return true;
+}
+
+bool exact_coefficients(const expr& e, const std::string& v, std::vector<rational>& out) {
+    return extract(e, v, out);
+}
+
+std::vector<double> roots(const std::vector<double>& polynomial) {
+    poly coefficients = polynomial;
+    trim(coefficients);
+    if (coefficients.size() < 2 || coefficients.size() > max_degree + 1 || coefficients.back() == 0) {
+        throw std::logic_error("Closed form roots need a polynomial of degree 1 to " + std::to_string(max_degree));
+    }
+    poly m(coefficients.size());
+    for (size_t i = 0; i < m.size(); ++i) {
+        m[i] = coefficients[i] / coefficients.back();
+    }
+    std::vector<double> res;
+    switch (coefficients.size() - 1) {
+    case 1: res.push_back(-m[0]); break;
+    case 2: quadratic(m[1], m[0], res); break;
+    case 3: cubic(m[2], m[1], m[0], res); break;
+    case 4: quartic(m[3], m[2], m[1], m[0], res); break;
+    }
+    for (auto& x : res) {
+        x = polish(coefficients, x);
+        // No -0 from -m[0] and the like
+        if (x == 0) x = 0;
+    }
+    std::sort(res.begin(), res.end());
+    res.erase(std::unique(res.begin(), res.end(), [](double a, double b) {
+        return fabs(a - b) <= 1e-9 * std::max(1.0, fabs(a));
+    }), res.end());
+    return res;
+}
+
+} // namespace polynomial
@@ -0,0 +1,29 @@
+#ifndef SOLVE_POLYNOMIAL_H
+#define SOLVE_POLYNOMIAL_H
+
+#include <string>
+#include <vector>
+#include "expr.h"
+
+namespace polynomial {
+
+// Highest degree the closed form root formulas handle
+const size_t max_degree = 4;
+
+// Coefficients of e as a polynomial in v, lowest degree first and without
+// leading zeros. Sums that cancel down to rounding noise count as zero, small
+// coefficients that didn't cancel are kept. Returns false unless e is a
+// polynomial in v with finite constant coefficients (no other variables, only
+// divisions by constants).
+bool coefficients(const expr& e, const std::string& v, std::vector<double>& out);
+
+// Like coefficients, but exact: also false if a constant in e isn't exact
+bool exact_coefficients(const expr& e, const std::string& v, std::vector<rational>& out);
+
+// Distinct real roots in ascending order, for degree 1 to max_degree once
+// leading zeros are dropped
+std::vector<double> roots(const std::vector<double>& coefficients);
+
+} // namespace polynomial
+
+#endif
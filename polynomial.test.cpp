@@ -0,0 +1,77 @@
+#include "polynomial.h"
+#include <iostream>
+#include <math.h>
+#include <assert.h>
+
+namespace {
+
+std::ostream& operator<<(std::ostream& os, const std::vector<double>& v) {
+    os << "{";
+    for (const auto d : v) {
+        os << " " << d;
+    }
+    return os << " }";
+}
+
+void test_coefficients(const expr_ptr& e, const std::vector<double>& expected) {
+    std::vector<double> res;
+    const bool found = polynomial::coefficients(*e, "x", res);
+    if (expected.empty() ? !found : found && res == expected) {
+        return;
+    }
+    std::cout << "Polynomial coefficients of " << e << " failed.\n";
+    std::cout << "Expected: " << (expected.empty() ? "not a polynomial" : "") << expected << "\n";
+    std::cout << "Got: " << (found ? "" : "not a polynomial") << res << std::endl;
+    assert(false);
+}
+
+void test_roots(const std::vector<double>& coefficients, const std::vector<double>& expected) {
+    const auto res = polynomial::roots(coefficients);
+    bool ok = res.size() == expected.size();
+    for (size_t i = 0; ok && i < res.size(); ++i) {
+        ok = fabs(res[i] - expected[i]) <= 1e-9 * std::max(1.0, fabs(expected[i]));
+    }
+    if (!ok) {
+        std::cout << "Roots of polynomial " << coefficients << " failed.\n";
+        std::cout << "Expected: " << expected << "\n";
+        std::cout << "Got: " << res << std::endl;
+        assert(false);
+    }
+}
+
+} // unnamed namespace
+
+void polynomial_test() {
+    const auto x = [] { return var("x"); };
+    test_coefficients(constant(3), {3});
+    test_coefficients(x() * constant(2) - (x() - constant(1)), {1, 1});
+    test_coefficients(x() * x() - constant(4), {-4, 0, 1});
+    test_coefficients(-(x() * x() * x()) / constant(2) + x(), {0, 1, 0, -0.5});
+    test_coefficients(x() * x() - x() * x() + x(), {0, 1});
+    test_coefficients(x() / x(), {});
+    test_coefficients(x() * var("y"), {});
+    test_coefficients(x() / constant(0), {});
+    // 0.1*3 isn't quite 0.3, the x^2 term that's left is rounding noise
+    test_coefficients(x() * x() * constant(0.1) * constant(3) - x() * x() * constant(0.3) + x() - constant(2), {-2, 1});
+    // Small or large next to the rest isn't noise
+    test_coefficients(x() * x() - constant(1e13), {-1e13, 0, 1});
+    test_coefficients(x() * x() * constant(0.000000000001) + x() * constant(1000), {0, 1000, 1e-12});
+    test_coefficients(x() + constant(0) * constant(1.0 / 0.0), {});
+    test_coefficients(x() * constant(1e300) * constant(1e300), {});
+
+    test_roots({500, 42}, {-500.0 / 42});
+    test_roots({-4, 0, 1}, {-2, 2});
+    test_roots({1, -2, 1}, {1});
+    test_roots({1, 0, 1}, {});
+    test_roots({-6, 11, -6, 1}, {1, 2, 3});          // (x-1)(x-2)(x-3)
+    test_roots({-2, 0, 0, 1}, {cbrt(2.0)});
+    test_roots({-1, 3, -3, 1}, {1});                 // (x-1)^3
+    test_roots({24, -14, -13, 2, 1}, {-4, -2, 1, 3}); // (x-1)(x+2)(x-3)(x+4)
+    test_roots({4, 0, -5, 0, 1}, {-2, -1, 1, 2});
+    test_roots({1, 0, 0, 0, 1}, {});
+    test_roots({-3, 1, 0, 0, 2}, {-1.204094636854992, 1});
+    test_roots({-1e13, 0, 1}, {-sqrt(1e13), sqrt(1e13)});
+    test_roots({0, 1000, 1e-12}, {-1e15, 0});
+    test_roots({-2, 1, 0}, {2});
+    assert(!signbit(polynomial::roots({0, 0.1})[0]) && !signbit(polynomial::roots({0, -3, 1})[0]));
+}
@@ -0,0 +1,437 @@
+#include "rational.h"
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+#include <stdexcept>
+
+////////////////////////////
+// BIGINT
+////////////////////////////
+
+bigint::bigint(int64_t v) : negative_(v < 0) {
+    uint64_t m = v < 0 ? uint64_t(0) - uint64_t(v) : uint64_t(v);
+    while (m) {
+        magnitude_.push_back(static_cast<uint32_t>(m));
+        m >>= 32;
+    }
+}
+
+void bigint::trim() {
+    while (!magnitude_.empty() && !magnitude_.back()) {
+        magnitude_.pop_back();
+    }
+    if (magnitude_.empty()) {
+        negative_ = false;
+    }
+}
+
+size_t bigint::bits() const {
+    if (magnitude_.empty()) {
+        return 0;
+    }
+    return 32 * magnitude_.size() - __builtin_clz(magnitude_.back());
+}
+
+// Below 2^63 in magnitude, so INT64_MIN is left to bigint as well
+bool bigint::fits_int64() const {
+    return bits() <= 63;
+}
+
+int64_t bigint::to_int64() const {
+    uint64_t m = 0;
+    for (size_t i = std::min<size_t>(magnitude_.size(), 2); i-- > 0;) {
+        m = (m << 32) | magnitude_[i];
+    }
+    return negative_ ? -int64_t(m) : int64_t(m);
+}
+
+double bigint::to_double(int& exponent) const {
+    const size_t n = bits();
+    exponent = n > 64 ? static_cast<int>(n - 64) : 0;
+    uint64_t top = 0;
+    for (size_t bit = n; bit-- > static_cast<size_t>(exponent);) {
+        top = (top << 1) | ((magnitude_[bit / 32] >> (bit % 32)) & 1);
+    }
+    const double v = static_cast<double>(top);
+    return negative_ ? -v : v;
+}
+
+int bigint::compare_magnitude(const bigint& a, const bigint& b) {
+    if (a.magnitude_.size() != b.magnitude_.size()) {
+        return a.magnitude_.size() < b.magnitude_.size() ? -1 : 1;
+    }
+    for (size_t i = a.magnitude_.size(); i-- > 0;) {
+        if (a.magnitude_[i] != b.magnitude_[i]) {
+            return a.magnitude_[i] < b.magnitude_[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+bigint operator+(const bigint& a, const bigint& b) {
+    bigint r;
+    if (a.negative_ == b.negative_) {
+        r.negative_ = a.negative_;
+        uint64_t carry = 0;
+        for (size_t i = 0; i < std::max(a.magnitude_.size(), b.magnitude_.size()) || carry; ++i) {
+            const uint64_t sum = carry + (i < a.magnitude_.size() ? a.magnitude_[i] : 0) + (i < b.magnitude_.size() ? b.magnitude_[i] : 0);
+            r.magnitude_.push_back(static_cast<uint32_t>(sum));
+            carry = sum >> 32;
+        }
+    } else {
+        // Subtract the smaller magnitude from the larger
+        const bool a_larger = bigint::compare_magnitude(a, b) >= 0;
+        const bigint& big = a_larger ? a : b;
+        const bigint& small = a_larger ? b : a;
+        r.negative_ = big.negative_;
+        int64_t borrow = 0;
+        for (size_t i = 0; i < big.magnitude_.size(); ++i) {
+            int64_t diff = int64_t(big.magnitude_[i]) - borrow - (i < small.magnitude_.size() ? small.magnitude_[i] : 0);
+            borrow = diff < 0;
+            if (diff < 0) {
+                diff += int64_t(1) << 32;
+            }
+            r.magnitude_.push_back(static_cast<uint32_t>(diff));
+        }
+    }
+    r.trim();
+    return r;
+}
+
+bigint operator*(const bigint& a, const bigint& b) {
+    bigint r;
+    if (a.zero() || b.zero()) {
+        return r;
+    }
+    r.magnitude_.assign(a.magnitude_.size() + b.magnitude_.size(), 0);
+    for (size_t i = 0; i < a.magnitude_.size(); ++i) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < b.magnitude_.size() || carry; ++j) {
+            const uint64_t cur = r.magnitude_[i + j] + carry + (j < b.magnitude_.size() ? uint64_t(a.magnitude_[i]) * b.magnitude_[j] : 0);
+            r.magnitude_[i + j] = static_cast<uint32_t>(cur);
+            carry = cur >> 32;
+        }
+    }
+    r.negative_ = a.negative_ != b.negative_;
+    r.trim();
+    return r;
+}
+
+// Binary long division of the magnitudes, the signs follow int64_t's
+void bigint::divide(const bigint& a, const bigint& b, bigint& quotient, bigint& remainder) {
+    if (b.zero()) {
+        throw std::domain_error("bigint division by zero");
+    }
+    quotient = bigint{};
+    remainder = bigint{};
+    if (compare_magnitude(a, b) < 0) {
+        remainder = a;
+        return;
+    }
+    quotient.magnitude_.assign(a.magnitude_.size(), 0);
+    bigint divisor = b;
+    divisor.negative_ = false;
+    for (size_t bit = a.bits(); bit-- > 0;) {
+        // remainder = remainder * 2 + bit
+        uint32_t carry = (a.magnitude_[bit / 32] >> (bit % 32)) & 1;
+        for (auto& limb : remainder.magnitude_) {
+            const uint32_t next = limb >> 31;
+            limb = (limb << 1) | carry;
+            carry = next;
+        }
+        if (carry) {
+            remainder.magnitude_.push_back(carry);
+        }
+        if (compare_magnitude(remainder, divisor) >= 0) {
+            remainder = remainder - divisor;
+            quotient.magnitude_[bit / 32] |= uint32_t(1) << (bit % 32);
+        }
+    }
+    quotient.negative_ = a.negative_ != b.negative_;
+    quotient.trim();
+    remainder.negative_ = a.negative_;
+    remainder.trim();
+}
+
+bigint operator/(const bigint& a, const bigint& b) {
+    bigint q, r;
+    bigint::divide(a, b, q, r);
+    return q;
+}
+
+bigint operator%(const bigint& a, const bigint& b) {
+    bigint q, r;
+    bigint::divide(a, b, q, r);
+    return r;
+}
+
+bigint bigint::gcd(bigint a, bigint b) {
+    a.negative_ = b.negative_ = false;
+    while (!b.zero()) {
+        bigint r = a % b;
+        a = std::move(b);
+        b = std::move(r);
+    }
+    return a;
+}
+
+std::string bigint::str() const {
+    if (zero()) {
+        return "0";
+    }
+    std::string digits;
+    std::vector<uint32_t> m = magnitude_;
+    while (!m.empty()) {
+        // Divide by 10^9 and emit the remainder's nine digits
+        uint64_t rem = 0;
+        for (size_t i = m.size(); i-- > 0;) {
+            const uint64_t cur = (rem << 32) | m[i];
+            m[i] = static_cast<uint32_t>(cur / 1000000000);
+            rem = cur % 1000000000;
+        }
+        while (!m.empty() && !m.back()) {
+            m.pop_back();
+        }
+        for (int i = 0; i < 9 && (rem || !m.empty()); ++i) {
+            digits.push_back(static_cast<char>('0' + rem % 10));
+            rem /= 10;
+        }
+    }
+    if (negative_) {
+        digits.push_back('-');
+    }
+    std::reverse(digits.begin(), digits.end());
+    return digits;
+}
+
+////////////////////////////
+// RATIONAL
+////////////////////////////
+
+namespace {
+
+uint64_t gcd(uint64_t a, uint64_t b) {
+    while (b) {
+        const uint64_t r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+bigint pow10(unsigned n) {
+    bigint r{1};
+    for (; n; --n) {
+        r = r * bigint{10};
+    }
+    return r;
+}
+
+} // unnamed namespace
+
+rational::rational(int64_t n, int64_t d) : n_(n), d_(d) {
+    if (d == 0) {
+        throw std::domain_error("rational with a zero denominator");
+    }
+    if (n == INT64_MIN || d == INT64_MIN) {
+        promote(bigint(n), bigint(d));
+        return;
+    }
+    if (d < 0) {
+        n_ = -n;
+        d_ = -d;
+    }
+    const int64_t g = static_cast<int64_t>(gcd(n_ < 0 ? uint64_t(-n_) : uint64_t(n_), uint64_t(d_)));
+    n_ /= g;
+    d_ /= g;
+}
+
+rational::rational(const bigint& n, const bigint& d) : n_(0), d_(1) {
+    promote(n, d);
+}
+
+void rational::promote(bigint n, bigint d) {
+    if (d.zero()) {
+        throw std::domain_error("rational with a zero denominator");
+    }
+    if (d.negative()) {
+        n = -n;
+        d = -d;
+    }
+    const bigint g = bigint::gcd(n, d);
+    if (g != bigint(1)) {
+        n = n / g;
+        d = d / g;
+    }
+    if (n.fits_int64() && d.fits_int64()) {
+        n_ = n.to_int64();
+        d_ = d.to_int64();
+        big_.reset();
+    } else {
+        n_ = 0;
+        d_ = 1;
+        big_.reset(new parts{std::move(n), std::move(d)});
+    }
+}
+
+bool rational::from_double(double v, rational& out) {
+    const double limit = 4611686018427387904.0; // 2^62
+    if (!std::isfinite(v)) {
+        return false;
+    }
+    if (v == std::trunc(v) && std::fabs(v) < limit) {
+        out = rational(static_cast<int64_t>(v));
+        return true;
+    }
+    const double scaled = std::ldexp(v, 20);
+    if (scaled == std::trunc(scaled) && std::fabs(scaled) < limit) {
+        out = rational(static_cast<int64_t>(scaled), int64_t(1) << 20);
+        return true;
+    }
+    return false;
+}
+
+bool rational::parse(const char* text, size_t length, rational& out) {
+    const char* p = text;
+    const char* const end = text + length;
+    // Up to 18 digits are collected in an int64_t, more in a bigint
+    int64_t small = 0;
+    bigint big;
+    size_t digits = 0;
+    int exponent = 0;
+    bool point = false;
+    for (; p != end && (isdigit(static_cast<unsigned char>(*p)) || (*p == '.' && !point)); ++p) {
+        if (*p == '.') {
+            point = true;
+            continue;
+        }
+        const int digit = *p - '0';
+        if (digits == 18) {
+            big = bigint(small);
+        }
+        if (digits < 18) {
+            small = small * 10 + digit;
+        } else {
+            big = big * bigint{10} + bigint{digit};
+        }
+        ++digits;
+        exponent -= point;
+    }
+    if (!digits) {
+        return false;
+    }
+    if (p != end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        const bool negative = p != end && *p == '-';
+        if (p != end && (*p == '-' || *p == '+')) {
+            ++p;
+        }
+        if (p == end) {
+            return false;
+        }
+        int e = 0;
+        for (; p != end && isdigit(static_cast<unsigned char>(*p)) && e < 1000; ++p) {
+            e = e * 10 + (*p - '0');
+        }
+        exponent += negative ? -e : e;
+    }
+    // Beyond this the exact value isn't worth its size
+    if (p != end || exponent > 40 || exponent < -40) {
+        return false;
+    }
+    static const int64_t powers[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+        10000000000, 100000000000, 1000000000000, 10000000000000, 100000000000000, 1000000000000000,
+        10000000000000000, 100000000000000000, 1000000000000000000 };
+    const unsigned magnitude = exponent < 0 ? -exponent : exponent;
+    int64_t scaled;
+    if (digits <= 18 && magnitude <= 18 && (exponent <= 0 || !__builtin_mul_overflow(small, powers[magnitude], &scaled))) {
+        out = exponent <= 0 ? rational(small, powers[magnitude]) : rational(scaled);
+        return true;
+    }
+    const bigint n = digits <= 18 ? bigint(small) : big;
+    out = exponent <= 0 ? rational(n, pow10(magnitude)) : rational(n * pow10(magnitude), bigint(1));
+    return true;
+}
+
+double rational::to_double() const {
+    const int64_t exact = int64_t(1) << 53;
+    if (small() && n_ < exact && n_ > -exact && d_ < exact) {
+        return static_cast<double>(n_) / static_cast<double>(d_);
+    }
+    int en, ed;
+    const double n = numerator().to_double(en);
+    const double d = denominator().to_double(ed);
+    return std::ldexp(n / d, en - ed);
+}
+
+std::string rational::str() const {
+    if (integer()) {
+        return numerator().str();
+    }
+    return numerator().str() + "/" + denominator().str();
+}
+
+rational operator-(const rational& a) {
+    if (!a.small()) {
+        return rational(-a.big_->n, a.big_->d);
+    }
+    rational r;
+    r.n_ = -a.n_; // never INT64_MIN, so this can't overflow
+    r.d_ = a.d_;
+    return r;
+}
+
+rational operator+(const rational& a, const rational& b) {
+    if (a.small() && b.small()) {
+        int64_t x, y, n, d;
+        if (a.d_ == 1 && b.d_ == 1 && !__builtin_add_overflow(a.n_, b.n_, &n)) {
+            return rational(n);
+        }
+        if (!__builtin_mul_overflow(a.n_, b.d_, &x) && !__builtin_mul_overflow(b.n_, a.d_, &y)
+                && !__builtin_add_overflow(x, y, &n) && !__builtin_mul_overflow(a.d_, b.d_, &d)) {
+            return rational(n, d);
+        }
+    }
+    return rational(a.numerator() * b.denominator() + b.numerator() * a.denominator(), a.denominator() * b.denominator());
+}
+
+rational operator-(const rational& a, const rational& b) {
+    return a + -b;
+}
+
+rational operator*(const rational& a, const rational& b) {
+    if (a.small() && b.small()) {
+        int64_t n, d;
+        if (!__builtin_mul_overflow(a.n_, b.n_, &n) && !__builtin_mul_overflow(a.d_, b.d_, &d)) {
+            return rational(n, d);
+        }
+    }
+    return rational(a.numerator() * b.numerator(), a.denominator() * b.denominator());
+}
+
+rational operator/(const rational& a, const rational& b) {
+    if (b.zero()) {
+        throw std::domain_error("rational division by zero");
+    }
+    if (a.small() && b.small()) {
+        int64_t n, d;
+        if (!__builtin_mul_overflow(a.n_, b.d_, &n) && !__builtin_mul_overflow(a.d_, b.n_, &d)) {
+            return rational(n, d);
+        }
+    }
+    return rational(a.numerator() * b.denominator(), a.denominator() * b.numerator());
+}
+
+bool operator==(const rational& a, const rational& b) {
+    if (a.small() != b.small()) {
+        return false; // both are normalized, and a big one doesn't fit 64 bits
+    }
+    if (a.small()) {
+        return a.n_ == b.n_ && a.d_ == b.d_;
+    }
+    return a.big_->n == b.big_->n && a.big_->d == b.big_->d;
+}
+
+std::ostream& operator<<(std::ostream& os, const rational& r) {
+    return os << r.str();
+}
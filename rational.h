@@ -0,0 +1,107 @@
+#ifndef SOLVE_RATIONAL_H
+#define SOLVE_RATIONAL_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <iosfwd>
+
+// Arbitrary precision integer, just what rational needs when its 64-bit
+// numbers overflow
+class bigint {
+public:
+    bigint(int64_t v = 0);
+
+    bool negative() const { return negative_; }
+    bool zero() const { return magnitude_.empty(); }
+    bool fits_int64() const;
+    int64_t to_int64() const;
+    // v * 2^exponent, v holding the top 64 bits
+    double to_double(int& exponent) const;
+    size_t bits() const;
+    std::string str() const;
+
+    friend bigint operator-(bigint a) { if (!a.zero()) a.negative_ = !a.negative_; return a; }
+    friend bigint operator+(const bigint& a, const bigint& b);
+    friend bigint operator-(const bigint& a, const bigint& b) { return a + -b; }
+    friend bigint operator*(const bigint& a, const bigint& b);
+    // Truncates towards zero like int64_t division
+    friend bigint operator/(const bigint& a, const bigint& b);
+    friend bigint operator%(const bigint& a, const bigint& b);
+    friend bool operator==(const bigint& a, const bigint& b) { return a.negative_ == b.negative_ && a.magnitude_ == b.magnitude_; }
+    friend bool operator!=(const bigint& a, const bigint& b) { return !(a == b); }
+
+    static bigint gcd(bigint a, bigint b);
+
+private:
+    bool                  negative_;
+    std::vector<uint32_t> magnitude_; // little endian, no leading zeros
+
+    void trim();
+    static int compare_magnitude(const bigint& a, const bigint& b);
+    static void divide(const bigint& a, const bigint& b, bigint& quotient, bigint& remainder);
+};
+
+// An exact fraction in lowest terms with a positive denominator. Numbers
+// that fit in 64 bits are kept as such, and only promoted to bigints when an
+// operation overflows (and demoted again when the result fits).
+class rational {
+public:
+    rational(int64_t n = 0) : n_(n), d_(1) { if (n == INT64_MIN) promote(bigint(n), bigint(1)); }
+    // Throws std::domain_error if d is zero
+    rational(int64_t n, int64_t d);
+    rational(const bigint& n, const bigint& d);
+
+    rational(const rational& r) : n_(r.n_), d_(r.d_), big_(r.big_ ? new parts(*r.big_) : nullptr) {}
+    rational(rational&&) = default;
+    rational& operator=(const rational& r) { if (this != &r) { rational copy{r}; *this = std::move(copy); } return *this; }
+    rational& operator=(rational&&) = default;
+
+    // v exactly if it's an integer below 2^62 or has at most 20 binary
+    // digits after the point. Fails for the others, which are mostly
+    // rounded already.
+    static bool from_double(double v, rational& out);
+    // A decimal literal like 12, 0.1 or 2.5e-3. Fails for anything else.
+    static bool parse(const char* text, size_t length, rational& out);
+
+    // The nearest double, or close to it for numbers beyond 64 bits
+    double to_double() const;
+
+    bool small() const { return !big_; }
+    bool zero() const { return small() && n_ == 0; }
+    bool integer() const { return small() ? d_ == 1 : big_->d == bigint(1); }
+    bigint numerator() const { return small() ? bigint(n_) : big_->n; }
+    bigint denominator() const { return small() ? bigint(d_) : big_->d; }
+    // numerator() and denominator() when small()
+    int64_t small_numerator() const { return n_; }
+    int64_t small_denominator() const { return d_; }
+
+    std::string str() const;
+
+    friend rational operator-(const rational& a);
+    friend rational operator+(const rational& a, const rational& b);
+    friend rational operator-(const rational& a, const rational& b);
+    friend rational operator*(const rational& a, const rational& b);
+    // Throws std::domain_error when dividing by zero
+    friend rational operator/(const rational& a, const rational& b);
+    friend bool operator==(const rational& a, const rational& b);
+    friend bool operator!=(const rational& a, const rational& b) { return !(a == b); }
+
+private:
+    struct parts {
+        bigint n;
+        bigint d;
+    };
+
+    int64_t                n_; // when small()
+    int64_t                d_;
+    std::unique_ptr<parts> big_;
+
+    // Normalizes n / d and keeps it in 64 bits if it fits
+    void promote(bigint n, bigint d);
+};
+
+std::ostream& operator<<(std::ostream& os, const rational& r);
+
+#endif
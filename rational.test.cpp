@@ -0,0 +1,104 @@
+#include "rational.h"
+#include <stdexcept>
+#include <assert.h>
+
+namespace {
+
+rational parsed(const char* text) {
+    rational r;
+    const bool ok = rational::parse(text, std::char_traits<char>::length(text), r);
+    assert(ok);
+    (void)ok;
+    return r;
+}
+
+void test_bigint() {
+    const bigint a{INT64_MAX};
+    const bigint b = a * a * bigint{-3};
+    assert(b.str() == "-255211775190703847542190723352697503747");
+    assert(b / a == a * bigint{-3});
+    assert(b % a == bigint{0});
+    assert((b - bigint{7}) % a == bigint{-7});
+    assert((b - bigint{7}) / -a == a * bigint{3});
+    assert(b - b == bigint{0} && (b - b).str() == "0");
+    assert(bigint::gcd(b, a * bigint{6}) == a * bigint{3});
+    assert(!b.fits_int64() && a.fits_int64() && !bigint{INT64_MIN}.fits_int64());
+    assert(bigint{-42}.to_int64() == -42);
+    int e;
+    const double d = (a * bigint{4}).to_double(e);
+    assert(d * (1LL << e) == 4.0 * INT64_MAX);
+}
+
+void test_arithmetic() {
+    const rational third{1, 3}, sixth{-2, -12};
+    assert(third + sixth == rational(1, 2));
+    assert(third - sixth == sixth);
+    assert(third * sixth == rational(1, 18));
+    assert(third / sixth == rational(2));
+    assert(-third == rational(1, -3));
+    assert(rational(0, -5) == rational(0) && rational(0, -5).zero());
+    assert((third * rational(3)).integer() && !third.integer());
+    assert(third.str() == "1/3" && rational(-6, 4).str() == "-3/2");
+    assert(third.to_double() == 1.0 / 3);
+
+    bool threw = false;
+    try {
+        third / rational(0);
+    } catch (const std::domain_error&) {
+        threw = true;
+    }
+    assert(threw);
+}
+
+// Overflowing the 64-bit fast path promotes, and results that fit again demote
+void test_promotion() {
+    const rational big{INT64_MAX};
+    const rational square = big * big;
+    assert(!square.small());
+    assert(square / big == big && (square / big).small());
+    assert(square - square == rational(0) && (square - square).small());
+    assert(rational(INT64_MIN).str() == "-9223372036854775808" && !rational(INT64_MIN).small());
+    assert(rational(INT64_MIN) + rational(1) == rational(INT64_MIN + 1));
+    assert(rational(1, INT64_MAX) + rational(1, INT64_MAX - 1) != rational(0));
+    assert(std::abs(square.to_double() - 8.507059173023462e37) < 1e23);
+
+    // 1/2 + 1/3 + ... in a loop overflows quickly but stays exact
+    rational sum;
+    for (int64_t i = 2; i <= 60; ++i) {
+        sum = sum + rational(1, i);
+    }
+    for (int64_t i = 60; i >= 2; --i) {
+        sum = sum - rational(1, i);
+    }
+    assert(sum.zero() && sum.small());
+}
+
+void test_conversion() {
+    rational r;
+    assert(rational::from_double(0.5, r) && r == rational(1, 2));
+    assert(rational::from_double(-3, r) && r == rational(-3));
+    assert(rational::from_double(1e15, r) && r == rational(1000000000000000));
+    assert(!rational::from_double(0.1, r));
+    assert(!rational::from_double(1e300, r));
+
+    assert(parsed("0.1") == rational(1, 10));
+    assert(parsed("12") == rational(12));
+    assert(parsed("2.5e-3") == rational(1, 400));
+    assert(parsed("1.5E2") == rational(150));
+    assert(parsed("007.") == rational(7));
+    assert(parsed("123456789012345678901234567890").str() == "123456789012345678901234567890");
+    assert(parsed("1e30").str() == "1000000000000000000000000000000");
+    assert(parsed("0.000000000000000000001") == rational(1) / rational(parsed("1e21")));
+    for (const char* bad : { "", ".", "1e", "1e+", "x", "1.2.3", "1e999" }) {
+        assert(!rational::parse(bad, std::char_traits<char>::length(bad), r));
+    }
+}
+
+} // unnamed namespace
+
+void rational_test() {
+    test_bigint();
+    test_arithmetic();
+    test_promotion();
+    test_conversion();
+}
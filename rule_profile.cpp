@@ -0,0 +1,130 @@
+#include "rule_profile.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <stdio.h>
+
+void rule_profile::grow(size_t rules) {
+    if (built_.size() < rules) {
+        built_.resize(rules);
+        on_path_.resize(rules);
+    }
+}
+
+void rule_profile::record(const std::vector<size_t>& built, const std::vector<uint8_t>& path) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    ++solves_;
+    grow(built.size());
+    for (size_t i = 0; i < built.size(); ++i) {
+        built_[i] += built[i];
+    }
+    for (const auto rule : path) {
+        grow(rule + 1);
+        ++on_path_[rule];
+    }
+}
+
+std::vector<size_t> rule_profile::penalties() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    const uint64_t total_built = std::accumulate(built_.begin(), built_.end(), uint64_t(0));
+    const uint64_t total_on_path = std::accumulate(on_path_.begin(), on_path_.end(), uint64_t(0));
+    std::vector<size_t> penalties(built_.size());
+    if (!total_built) {
+        return penalties;
+    }
+    // Each rule's rate starts out at the overall one and moves towards its
+    // own as it gets used
+    const double overall = double(total_on_path) / total_built;
+    std::vector<double> rates(built_.size());
+    for (size_t i = 0; i < built_.size(); ++i) {
+        rates[i] = (on_path_[i] + prior_weight * overall) / (built_[i] + prior_weight);
+    }
+    const double best = *std::max_element(rates.begin(), rates.end());
+    if (best <= 0) {
+        return penalties;
+    }
+    for (size_t i = 0; i < rates.size(); ++i) {
+        penalties[i] = static_cast<size_t>(std::lround(max_penalty * (1 - rates[i] / best)));
+    }
+    return penalties;
+}
+
+size_t rule_profile::solves() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return solves_;
+}
+
+size_t rule_profile::built(size_t rule) const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return rule < built_.size() ? built_[rule] : 0;
+}
+
+size_t rule_profile::on_path(size_t rule) const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return rule < on_path_.size() ? on_path_[rule] : 0;
+}
+
+void rule_profile::save(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    out << "rule_profile " << format_version << " " << solves_ << "\n";
+    for (size_t i = 0; i < built_.size(); ++i) {
+        out << built_[i] << " " << on_path_[i] << "\n";
+    }
+}
+
+void rule_profile::load(std::istream& in) {
+    std::string magic;
+    uint32_t version = 0;
+    size_t solves = 0;
+    std::string line;
+    if (!std::getline(in, line) || !(std::istringstream{line} >> magic >> version >> solves) || magic != "rule_profile") {
+        throw std::runtime_error("Not a rule profile");
+    }
+    if (version != format_version) {
+        throw std::runtime_error("Unsupported rule profile version " + std::to_string(version));
+    }
+    std::vector<uint64_t> built, on_path;
+    while (std::getline(in, line)) {
+        uint64_t b, p;
+        if (!(std::istringstream{line} >> b >> p) || p > b) {
+            throw std::runtime_error("Bad rule profile line " + std::to_string(built.size() + 2) + ": " + line);
+        }
+        built.push_back(b);
+        on_path.push_back(p);
+    }
+    std::lock_guard<std::mutex> lock{mutex_};
+    solves_ = solves;
+    built_.swap(built);
+    on_path_.swap(on_path);
+}
+
+bool rule_profile::load_file(const std::string& path) {
+    std::ifstream in{path};
+    if (!in) {
+        return false;
+    }
+    load(in);
+    return true;
+}
+
+void rule_profile::save_file(const std::string& path) const {
+    const std::string temp = path + ".tmp";
+    {
+        std::ofstream out{temp};
+        save(out);
+        out.close();
+        if (!out) {
+            throw std::runtime_error("Could not write rule profile " + temp);
+        }
+    }
+    if (rename(temp.c_str(), path.c_str()) != 0) {
+        remove(temp.c_str());
+        throw std::runtime_error("Could not replace rule profile " + path);
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef SOLVE_RULE_PROFILE_H
+#define SOLVE_RULE_PROFILE_H
+
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// What best first searches have learned about the search's rewrite rules:
+// how many successors each rule built and how many of those were on the
+// derivation of a solution. A rule whose jobs are often expanded for
+// nothing gets a penalty added to the cost of the jobs it builds, so it's
+// tried later.
+// Shared by the solves of a batch (see solve_options::profile), from any
+// thread, and saved and loaded so a run can start from a tuned profile.
+//
+// The text format is a header line and then one line per rule, in
+// search rule order:
+//
+//   rule_profile 1 <solves>
+//   <built> <on path>
+class rule_profile {
+public:
+    static const uint32_t format_version = 1;
+
+    // The penalty for a rule that never helps, and none for the most
+    // successful one. Less than a level of depth in job_compare::cost, so
+    // the profile only reorders jobs the cost ranks (nearly) the same: the
+    // cost is the better guide, rule statistics alone lose sight of where
+    // the variable is.
+    static const size_t max_penalty = 5;
+
+    // Observations a rule needs before its own rate outweighs the overall one
+    static const size_t prior_weight = 50;
+
+    rule_profile() : solves_(0) {}
+
+    // One solve: the successors built per rule and the rules on the
+    // derivation of its solution, empty if there was none
+    void record(const std::vector<size_t>& built, const std::vector<uint8_t>& path);
+
+    // The cost each rule adds to the jobs it builds
+    std::vector<size_t> penalties() const;
+
+    size_t solves() const;
+    size_t built(size_t rule) const;
+    size_t on_path(size_t rule) const;
+
+    void save(std::ostream& out) const;
+    // Replaces what's been learned so far. Throws std::runtime_error if in
+    // isn't a profile.
+    void load(std::istream& in);
+
+    // load() from the file at path, false if there's no such file
+    bool load_file(const std::string& path);
+    // save() to the file at path, replacing it in one step so a crash never
+    // leaves half a profile. Throws std::runtime_error on failure.
+    void save_file(const std::string& path) const;
+
+private:
+    mutable std::mutex    mutex_;
+    size_t                solves_;
+    std::vector<uint64_t> built_;
+    std::vector<uint64_t> on_path_;
+
+    void grow(size_t rules);
+};
+
+#endif
@@ -0,0 +1,112 @@
+#include "rule_profile.h"
+#include "solver.h"
+#include <sstream>
+#include <stdexcept>
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+
+namespace {
+
+void test_penalties() {
+    rule_profile p;
+    assert(p.penalties().empty());
+    p.record({10, 10}, {1});
+    assert(p.solves() == 1 && p.built(0) == 10 && p.on_path(1) == 1 && p.on_path(5) == 0);
+    const auto penalties = p.penalties();
+    assert(penalties.size() == 2 && penalties[0] > 0 && penalties[0] <= rule_profile::max_penalty && penalties[1] == 0);
+
+    // Paths may name rules that built nothing in this solve
+    p.record({}, {3});
+    assert(p.penalties().size() == 4);
+}
+
+void test_save_load() {
+    rule_profile p;
+    p.record({4, 8, 0}, {1, 1, 0});
+    p.record({2, 2, 1}, {1});
+    std::stringstream ss;
+    p.save(ss);
+    assert(ss.str() == "rule_profile 1 2\n6 1\n10 3\n1 0\n");
+
+    rule_profile q;
+    q.record({100}, {});
+    q.load(ss);
+    assert(q.solves() == 2 && q.built(0) == 6 && q.on_path(1) == 3 && q.built(2) == 1);
+    assert(q.penalties() == p.penalties());
+
+    for (const char* bad : { "", "profile 1 0\n", "rule_profile 2 0\n", "rule_profile 1 1\n1 2\n", "rule_profile 1 1\n1\n" }) {
+        std::istringstream in{bad};
+        bool threw = false;
+        try {
+            q.load(in);
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        assert(threw);
+    }
+    assert(q.solves() == 2);
+}
+
+// A batch of solves shares one profile and still solves everything with it
+void test_learning() {
+    rule_profile profile;
+    solve_options options;
+    options.trace = nullptr;
+    options.profile = &profile;
+    const auto lhs = (var("x") + constant(3)) * var("y") - var("z") / constant(2);
+    const auto rhs = var("w") * constant(4) + constant(1);
+    for (int round = 0; round < 2; ++round) {
+        for (const char* v : { "x", "y", "z", "w" }) {
+            const auto r = solver::solve(v, *lhs, *rhs, options);
+            assert(r.status == solve_status::solved);
+        }
+    }
+    assert(profile.solves() == 8);
+    size_t built = 0, on_path = 0;
+    for (size_t rule = 0; rule < profile.penalties().size(); ++rule) {
+        built += profile.built(rule);
+        on_path += profile.on_path(rule);
+        assert(profile.on_path(rule) <= profile.built(rule));
+    }
+    assert(on_path > 0 && on_path <= built);
+
+    // Solves that don't search leave the profile alone
+    solver::solve("x", *(var("x") * var("x")), *constant(4), options);
+    assert(profile.solves() == 8);
+
+    // solve_all learns one solve covering every variable
+    rule_profile all;
+    const auto solutions = solver::solve_all(*lhs, *rhs, nullptr, &all);
+    assert(solutions.size() == 4);
+    assert(all.solves() == 1 && !all.penalties().empty());
+}
+
+void test_files() {
+    const std::string path = "/tmp/rule_profile_test." + std::to_string(getpid());
+    rule_profile p;
+    assert(!p.load_file(path + ".missing"));
+    p.record({3, 1}, {0});
+    p.save_file(path);
+    rule_profile q;
+    assert(q.load_file(path));
+    assert(q.solves() == 1 && q.built(0) == 3 && q.on_path(0) == 1);
+    remove(path.c_str());
+
+    bool threw = false;
+    try {
+        p.save_file("/nonexistent/dir/profile");
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+}
+
+} // unnamed namespace
+
+void rule_profile_test() {
+    test_penalties();
+    test_save_load();
+    test_learning();
+    test_files();
+}
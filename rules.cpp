@@ -0,0 +1,295 @@
+#include "rules.h"
+#include <algorithm>
+#include <stdexcept>
+
+constexpr size_t rule_set::max_rules;
+constexpr size_t rule_set::max_symbols;
+
+namespace {
+
+// The node kind of an expression, found once and tested against every
+// symbol that may follow
+struct view {
+    rule_set::symbol::kind_type kind;
+    char                        op;
+    double                      value;
+    const expr*                 operands[2];
+    size_t                      n;
+};
+
+// Told apart by operand count, a virtual call being a lot cheaper than the
+// casts on the matcher's hot path
+view view_of(const expr& e) {
+    view v{rule_set::symbol::any, 0, 0, {nullptr, nullptr}, e.operand_count()};
+    if (v.n == 2) {
+        const auto& be = static_cast<const bin_op_expr&>(e);
+        v.kind = rule_set::symbol::binary;
+        v.op = be.op();
+        v.operands[0] = &be.lhs();
+        v.operands[1] = &be.rhs();
+    } else if (v.n == 1) {
+        v.kind = rule_set::symbol::negation;
+        v.operands[0] = &e.operand(0);
+    } else if (auto ce = expr_cast<const_expr>(e)) {
+        v.kind = rule_set::symbol::constant;
+        v.value = ce->value();
+    } else {
+        assert(expr_cast<var_expr>(e));
+        v.kind = rule_set::symbol::any_variable;
+    }
+    return v;
+}
+
+// Whether s matches the node, if so it descends into its operands if
+// has_operands is set, and captures the node if captures is
+bool accepts(const rule_set::symbol& s, const view& v, bool& has_operands, bool& captures) {
+    has_operands = captures = false;
+    switch (s.kind) {
+    case rule_set::symbol::negation:
+        return has_operands = v.kind == rule_set::symbol::negation;
+    case rule_set::symbol::binary:
+        return has_operands = v.kind == rule_set::symbol::binary && v.op == s.op;
+    case rule_set::symbol::constant:
+        return v.kind == rule_set::symbol::constant && v.value == s.value;
+    case rule_set::symbol::any_constant:
+        return captures = v.kind == rule_set::symbol::constant;
+    case rule_set::symbol::any_variable:
+        return captures = v.kind == rule_set::symbol::any_variable;
+    case rule_set::symbol::any:
+        return captures = true;
+    }
+    return false;
+}
+
+} // unnamed namespace
+
+rule_set::rule_set(const std::vector<std::string>& extra) : extra_(extra), nodes_(1, node{{}, 0}) {
+}
+
+size_t rule_set::add(const expr& pattern, const expr& result) {
+    if (rules_.size() == max_rules) {
+        throw std::logic_error("Too many rules in rule_set");
+    }
+    // The table usually outlives whatever allocator is installed when it's built
+    expr_allocator::scope heap{nullptr};
+    rule r;
+    r.source = pattern.clone();
+    compile_pattern(pattern, r);
+    r.results.emplace_back();
+    compile_result(result, r, r.results.back());
+    rules_.push_back(std::move(r));
+    insert(rules_.size() - 1);
+    return rules_.size() - 1;
+}
+
+size_t rule_set::add(const expr& pattern, const expr& first, const expr& second) {
+    const size_t index = add(pattern, first);
+    rule& r = rules_[index];
+    r.results.emplace_back();
+    compile_result(second, r, r.results.back());
+    return index;
+}
+
+void rule_set::compile_pattern(const expr& e, rule& r) const {
+    if (r.symbols.size() == max_symbols) {
+        throw std::logic_error("Pattern too large for rule_set");
+    }
+    if (auto ce = expr_cast<const_expr>(e)) {
+        r.symbols.push_back(symbol{symbol::constant, 0, ce->value()});
+    } else if (auto ve = expr_cast<var_expr>(e)) {
+        const std::string& name = ve->name();
+        if (std::find(extra_.begin(), extra_.end(), name) != extra_.end()) {
+            throw std::logic_error("Pattern uses result-only name " + name);
+        }
+        const auto seen = std::find(r.names.begin(), r.names.end(), name);
+        if (seen != r.names.end()) {
+            r.same.emplace_back(seen - r.names.begin(), r.names.size());
+        }
+        r.names.push_back(name);
+        const auto kind = name == "n" ? symbol::any_constant : name == "x" ? symbol::any_variable : symbol::any;
+        r.symbols.push_back(symbol{kind, 0, 0});
+    } else if (auto ne = expr_cast<negation_expr>(e)) {
+        r.symbols.push_back(symbol{symbol::negation, 0, 0});
+        compile_pattern(ne->e(), r);
+    } else if (auto be = expr_cast<bin_op_expr>(e)) {
+        r.symbols.push_back(symbol{symbol::binary, be->op(), 0});
+        compile_pattern(be->lhs(), r);
+        compile_pattern(be->rhs(), r);
+    } else {
+        throw std::logic_error("Unknown expression type in pattern");
+    }
+}
+
+void rule_set::compile_result(const expr& e, const rule& r, std::vector<instruction>& out) const {
+    if (auto ce = expr_cast<const_expr>(e)) {
+        out.push_back(instruction{instruction::constant, 0, 0, ce->value()});
+    } else if (auto ve = expr_cast<var_expr>(e)) {
+        const auto capture = std::find(r.names.begin(), r.names.end(), ve->name());
+        const auto extra = std::find(extra_.begin(), extra_.end(), ve->name());
+        if (capture != r.names.end()) {
+            out.push_back(instruction{instruction::capture, 0, size_t(capture - r.names.begin()), 0});
+        } else if (extra != extra_.end()) {
+            out.push_back(instruction{instruction::extra, 0, size_t(extra - extra_.begin()), 0});
+        } else {
+            throw std::logic_error("Result uses unbound name " + ve->name());
+        }
+    } else if (auto ne = expr_cast<negation_expr>(e)) {
+        compile_result(ne->e(), r, out);
+        out.push_back(instruction{instruction::negate, 0, 0, 0});
+    } else if (auto be = expr_cast<bin_op_expr>(e)) {
+        compile_result(be->lhs(), r, out);
+        compile_result(be->rhs(), r, out);
+        out.push_back(instruction{instruction::binary, be->op(), 0, 0});
+    } else {
+        throw std::logic_error("Unknown expression type in result");
+    }
+}
+
+void rule_set::insert(size_t index) {
+    size_t at = 0;
+    for (const auto& s : rules_[index].symbols) {
+        const auto& edges = nodes_[at].edges;
+        const auto edge = std::find_if(edges.begin(), edges.end(), [&s](const std::pair<symbol, size_t>& e) { return e.first == s; });
+        if (edge != edges.end()) {
+            at = edge->second;
+        } else {
+            nodes_.push_back(node{{}, 0});
+            nodes_[at].edges.emplace_back(s, nodes_.size() - 1);
+            at = nodes_.size() - 1;
+        }
+    }
+    nodes_[at].rules |= rule_mask(1) << index;
+}
+
+bool rule_set::satisfied(const rule& r, const bindings& b) const {
+    return std::all_of(r.same.begin(), r.same.end(), [&b](const std::pair<size_t, size_t>& s) {
+        return b[s.first].equal(b[s.second]);
+    });
+}
+
+// The parts of the expression still to be matched, last first, and the
+// bindings so far
+struct rule_set::walk_state {
+    const expr* pending[max_symbols + 1];
+    size_t      pending_count;
+    bindings    current;
+    rule_mask   found;
+    size_t      best; // the lowest rule in found
+    bindings    best_bindings;
+};
+
+void rule_set::walk(size_t at, walk_state& s) const {
+    const node& n = nodes_[at];
+    if (s.pending_count == 0) {
+        // Preorder is prefix free, so this is where complete patterns end
+        for (rule_mask m = n.rules; m; m &= m - 1) {
+            const size_t i = __builtin_ctzll(m);
+            if (!satisfied(rules_[i], s.current)) {
+                continue;
+            }
+            s.found |= rule_mask(1) << i;
+            if (i < s.best) {
+                s.best = i;
+                s.best_bindings = s.current;
+            }
+        }
+        return;
+    }
+    const expr* e = s.pending[--s.pending_count];
+    const view v = view_of(*e);
+    const size_t pending_count = s.pending_count;
+    const size_t capture_count = s.current.count;
+    for (const auto& edge : n.edges) {
+        bool has_operands, captures;
+        if (!accepts(edge.first, v, has_operands, captures)) {
+            continue;
+        }
+        if (has_operands) {
+            for (size_t i = v.n; i-- > 0;) {
+                s.pending[s.pending_count++] = v.operands[i];
+            }
+        }
+        if (captures) {
+            s.current.captures[s.current.count++] = e;
+        }
+        walk(edge.second, s);
+        s.pending_count = pending_count;
+        s.current.count = capture_count;
+    }
+    s.pending[s.pending_count++] = e;
+}
+
+size_t rule_set::best_of(walk_state& s, bindings& b) const {
+    if (s.best < rules_.size()) {
+        b = s.best_bindings;
+    }
+    return std::min(s.best, rules_.size());
+}
+
+rule_set::rule_mask rule_set::matches(const expr& e) const {
+    walk_state s;
+    s.pending[0] = &e;
+    s.pending_count = 1;
+    s.current.count = 0;
+    s.found = 0;
+    s.best = 0; // no bindings wanted
+    walk(0, s);
+    return s.found;
+}
+
+size_t rule_set::first(const expr& e, bindings& b) const {
+    walk_state s;
+    s.pending[0] = &e;
+    s.pending_count = 1;
+    s.current.count = 0;
+    s.found = 0;
+    s.best = max_rules;
+    walk(0, s);
+    return best_of(s, b);
+}
+
+size_t rule_set::first(char op, const expr& lhs, const expr& rhs, bindings& b) const {
+    // Take the edge for the node instead of looking at one
+    const auto& edges = nodes_[0].edges;
+    walk_state s;
+    s.current.count = 0;
+    s.found = 0;
+    s.best = max_rules;
+    for (const auto& edge : edges) {
+        if (edge.first.kind == symbol::binary && edge.first.op == op) {
+            s.pending[0] = &rhs;
+            s.pending[1] = &lhs;
+            s.pending_count = 2;
+            walk(edge.second, s);
+        } else if (edge.first.kind == symbol::any) {
+            throw std::logic_error("rule_set::first without a node can't capture it");
+        }
+    }
+    return best_of(s, b);
+}
+
+bool rule_set::bind(size_t index, const expr& e, bindings& b) const {
+    const rule& r = rules_[index];
+    const expr* pending[max_symbols + 1];
+    size_t pending_count = 0;
+    pending[pending_count++] = &e;
+    b.count = 0;
+    for (const auto& s : r.symbols) {
+        assert(pending_count);
+        const expr* part = pending[--pending_count];
+        const view v = view_of(*part);
+        bool has_operands, captures;
+        if (!accepts(s, v, has_operands, captures)) {
+            return false;
+        }
+        if (has_operands) {
+            for (size_t i = v.n; i-- > 0;) {
+                pending[pending_count++] = v.operands[i];
+            }
+        }
+        if (captures) {
+            b.captures[b.count++] = part;
+        }
+    }
+    return satisfied(r, b);
+}
@@ -0,0 +1,140 @@
+#ifndef SOLVE_RULES_H
+#define SOLVE_RULES_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "expr.h"
+
+// A table of rewrite rules "pattern -> results". Names in a pattern stand
+// for parts of the matched expression: n for any constant, x for any
+// variable and every other name for any subexpression. A name used twice
+// only matches equal parts, constants only match themselves.
+//
+// The patterns are compiled into a discrimination tree: the pattern
+// symbols in preorder form the paths of a trie, shared between rules with
+// the same prefix. Matching walks the expression down the trie, so its cost
+// depends on how deep the patterns are and not on how many there are.
+class rule_set {
+public:
+    static constexpr size_t max_rules = 64;
+    static constexpr size_t max_symbols = 16; // per pattern
+
+    // Bit i is set if rule i matched
+    typedef uint64_t rule_mask;
+
+    // What the names of a pattern matched, in preorder
+    struct bindings {
+        const expr* captures[max_symbols];
+        size_t      count;
+
+        const expr& operator[](size_t i) const { assert(i < count); return *captures[i]; }
+    };
+
+    // Results may also use the names in extra, supplied when building them
+    explicit rule_set(const std::vector<std::string>& extra = {});
+
+    // Adds a rule with one or two results, returns its index
+    size_t add(const expr& pattern, const expr& result);
+    size_t add(const expr& pattern, const expr& first, const expr& second);
+
+    size_t size() const { return rules_.size(); }
+
+    rule_mask matches(const expr& e) const;
+
+    // The first rule in table order that matches e, or size() if none does
+    size_t first(const expr& e, bindings& b) const;
+    // The same for "lhs op rhs", without building the node
+    size_t first(char op, const expr& lhs, const expr& rhs, bindings& b) const;
+
+    // Matches e against rule only
+    bool bind(size_t rule, const expr& e, bindings& b) const;
+
+    // Builds result number i of rule from b, which gets the parts through
+    //   T capture(size_t i)   the i-th binding
+    //   T extra(size_t i)     the i-th extra name
+    //   T constant(double v)
+    //   T negate(T a)
+    //   T binary(char op, T a, T b)
+    template<typename T, typename Builder>
+    T build(size_t rule, size_t i, Builder& b) const;
+
+    // For the tests and the traces
+    const expr& pattern(size_t rule) const { return *rules_[rule].source; }
+
+    struct symbol {
+        enum kind_type : uint8_t { negation, binary, constant, any_constant, any_variable, any };
+
+        kind_type kind;
+        char      op;    // binary
+        double    value; // constant
+
+        bool operator==(const symbol& s) const { return kind == s.kind && op == s.op && value == s.value; }
+    };
+
+    struct instruction {
+        enum kind_type : uint8_t { capture, extra, constant, negate, binary };
+
+        kind_type kind;
+        char      op;    // binary
+        size_t    index; // capture and extra
+        double    value; // constant
+    };
+
+private:
+    struct rule {
+        expr_ptr                                source;
+        std::vector<symbol>                     symbols;  // preorder
+        std::vector<std::string>                names;    // one per capture
+        std::vector<std::pair<size_t, size_t>>  same;     // captures that must be equal
+        std::vector<std::vector<instruction>>   results;  // postfix
+    };
+
+    struct node {
+        std::vector<std::pair<symbol, size_t>> edges;
+        rule_mask                              rules;
+    };
+
+    struct walk_state;
+
+    std::vector<std::string> extra_;
+    std::vector<rule>        rules_;
+    std::vector<node>        nodes_;
+
+    void compile_pattern(const expr& e, rule& r) const;
+    void compile_result(const expr& e, const rule& r, std::vector<instruction>& out) const;
+    void insert(size_t index);
+    bool satisfied(const rule& r, const bindings& b) const;
+    void walk(size_t node, walk_state& s) const;
+    size_t best_of(walk_state& s, bindings& b) const;
+};
+
+template<typename T, typename Builder>
+T rule_set::build(size_t rule, size_t i, Builder& b) const {
+    small_stack<T> stack;
+    for (const auto& in : rules_[rule].results[i]) {
+        switch (in.kind) {
+        case instruction::capture:
+            stack.push(b.capture(in.index));
+            break;
+        case instruction::extra:
+            stack.push(b.extra(in.index));
+            break;
+        case instruction::constant:
+            stack.push(b.constant(in.value));
+            break;
+        case instruction::negate:
+            stack.push(b.negate(stack.pop()));
+            break;
+        case instruction::binary: {
+            T rhs = stack.pop();
+            T lhs = stack.pop();
+            stack.push(b.binary(in.op, std::move(lhs), std::move(rhs)));
+            break;
+        }
+        }
+    }
+    return stack.pop();
+}
+
+#endif
@@ -0,0 +1,106 @@
+#include "rules.h"
+#include <iostream>
+#include <sstream>
+#include <assert.h>
+
+namespace {
+
+// Prints results instead of building them
+struct print_builder {
+    const rule_set::bindings& b;
+
+    std::string capture(size_t i) { std::ostringstream os; os << b[i]; return os.str(); }
+    std::string extra(size_t i) { return i ? "?" : "B"; }
+    std::string constant(double v) { std::ostringstream os; os << v; return os.str(); }
+    std::string negate(const std::string& a) { return "-" + a; }
+    std::string binary(char op, const std::string& a, const std::string& b) { return "(" + a + op + b + ")"; }
+};
+
+rule_set example() {
+    const auto a = var("a"), b = var("b"), n = var("n"), x = var("x"), B = var("B");
+    rule_set r{{"B"}};
+    r.add(*(*a + *b), *a, *(*B - *b));      // 0
+    r.add(*(*a * *b), *b, *(*B / *a));      // 1
+    r.add(*(*x + *x), *(constant(2) * *x), *B); // 2
+    r.add(*(*a + constant(0)), *a, *B);     // 3
+    r.add(*(*n * *a), *a, *(*B / *n));      // 4
+    r.add(*-*a, *a, *-*B);                  // 5
+    return r;
+}
+
+void test_matches() {
+    const auto rules = example();
+    assert(rules.size() == 6);
+    assert(rules.matches(*(var("y") + var("z"))) == 0x1);
+    assert(rules.matches(*(var("y") + var("y"))) == 0x5);
+    assert(rules.matches(*(var("y") + constant(0))) == 0x9);
+    assert(rules.matches(*(constant(0) + constant(0))) == 0x9);
+    assert(rules.matches(*(constant(3) * var("y"))) == 0x12);
+    assert(rules.matches(*(var("y") * constant(3))) == 0x2);
+    assert(rules.matches(*-(var("y") * var("z"))) == 0x20);
+    assert(rules.matches(*var("y")) == 0);
+    assert(rules.matches(*(var("y") - var("z"))) == 0);
+}
+
+void test_first() {
+    const auto rules = example();
+    rule_set::bindings b;
+    const auto e = (var("y") * var("z")) + constant(0);
+    assert(rules.first(*e, b) == 0);
+    assert(b.count == 2 && b[0].equal(*(var("y") * var("z"))) && b[1].equal(*constant(0)));
+
+    // Without building the node
+    const auto y = var("y");
+    assert(rules.first('+', *y, *y, b) == 0);
+    assert(rules.first('*', *constant(2), *y, b) == 1);
+    assert(rules.first('/', *y, *y, b) == rules.size());
+}
+
+void test_build() {
+    const auto rules = example();
+    rule_set::bindings b;
+    const auto e = var("y") + var("y");
+    assert(rules.bind(2, *e, b));
+    print_builder p{b};
+    assert(rules.build<std::string>(2, 0, p) == "(2*y)");
+    assert(rules.build<std::string>(2, 1, p) == "B");
+    assert(!rules.bind(2, *(var("y") + var("z")), b));
+    assert(!rules.bind(3, *e, b));
+
+    const auto scaled = constant(3) * var("y");
+    assert(rules.bind(4, *scaled, b));
+    assert(rules.build<std::string>(4, 0, p) == "y");
+    assert(rules.build<std::string>(4, 1, p) == "(B/3)");
+    const auto negated = -var("y");
+    assert(rules.bind(5, *negated, b));
+    assert(rules.build<std::string>(5, 1, p) == "-B");
+}
+
+void test_errors() {
+    rule_set r{{"B"}};
+    auto throws = [&](const expr& pattern, const expr& result) {
+        try {
+            r.add(pattern, result);
+        } catch (const std::logic_error&) {
+            return true;
+        }
+        return false;
+    };
+    assert(throws(*var("B"), *constant(0)));        // result-only name in a pattern
+    assert(throws(*var("a"), *var("b")));           // unbound name in a result
+    expr_ptr deep = var("a");
+    for (int i = 0; i < 20; ++i) {
+        deep = -std::move(deep);
+    }
+    assert(throws(*deep, *var("a")));               // too many symbols
+    assert(r.size() == 0);
+}
+
+} // unnamed namespace
+
+void rules_test() {
+    test_matches();
+    test_first();
+    test_build();
+    test_errors();
+}
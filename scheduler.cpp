@@ -0,0 +1,52 @@
+#include "scheduler.h"
+#include <algorithm>
+#include <limits>
+
+size_t solve_scheduler::submit(const std::string& v, const expr& lhs, const expr& rhs, const solve_options& options, completion done) {
+    const size_t id = next_id_++;
+    heap_.emplace_back(new entry{id, std::unique_ptr<solve_task>{new solve_task{v, lhs, rhs, options}}, std::move(done)});
+    std::push_heap(heap_.begin(), heap_.end(), [this](const entry_ptr& a, const entry_ptr& b) { return later(a, b); });
+    return id;
+}
+
+bool solve_scheduler::later(const entry_ptr& a, const entry_ptr& b) const {
+    switch (options_.policy) {
+    case schedule_policy::in_order:
+        break;
+    case schedule_policy::least_expanded:
+        if (a->task->expanded() != b->task->expanded()) {
+            return a->task->expanded() > b->task->expanded();
+        }
+        break;
+    case schedule_policy::earliest_deadline:
+        if (a->task->options().deadline != b->task->options().deadline) {
+            return a->task->options().deadline > b->task->options().deadline;
+        }
+        break;
+    }
+    return a->id > b->id;
+}
+
+bool solve_scheduler::run_one() {
+    if (heap_.empty()) {
+        return false;
+    }
+    const auto order = [this](const entry_ptr& a, const entry_ptr& b) { return later(a, b); };
+    std::pop_heap(heap_.begin(), heap_.end(), order);
+    entry_ptr e = std::move(heap_.back());
+    heap_.pop_back();
+
+    const size_t slice = options_.policy == schedule_policy::in_order ? std::numeric_limits<size_t>::max() : options_.slice_jobs;
+    if (e->task->resume(slice)) {
+        e->done(e->id, e->task->result());
+        return true;
+    }
+    heap_.push_back(std::move(e));
+    std::push_heap(heap_.begin(), heap_.end(), order);
+    return true;
+}
+
+void solve_scheduler::run() {
+    while (run_one()) {
+    }
+}
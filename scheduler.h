@@ -0,0 +1,61 @@
+#ifndef SOLVE_SCHEDULER_H
+#define SOLVE_SCHEDULER_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include "solver.h"
+
+enum class schedule_policy {
+    in_order,          // each solve runs to completion, in submission order
+    least_expanded,    // the solve that has expanded the fewest jobs goes next
+    earliest_deadline, // the solve with the earliest solve_options::deadline goes next
+};
+
+struct scheduler_options {
+    scheduler_options() : policy(schedule_policy::least_expanded), slice_jobs(16) {}
+
+    schedule_policy policy;
+    size_t          slice_jobs; // jobs a solve expands before the next one gets a turn
+};
+
+// Interleaves many solves on one thread. Under least_expanded an easy
+// equation never waits for more than a slice of each harder one ahead of
+// it: the solves that have done the least work get the next turn, so short
+// solves finish early, in the order they'd be in if their cost were known
+// up front. Ties go to the solve submitted first.
+class solve_scheduler {
+public:
+    typedef std::function<void (size_t id, solve_result& result)> completion;
+
+    explicit solve_scheduler(const scheduler_options& options = scheduler_options{}) : options_(options), next_id_(0) {}
+
+    // Queues solving lhs = rhs for v, done is called with the result from
+    // run_one() or run(). Returns an id passed to done.
+    size_t submit(const std::string& v, const expr& lhs, const expr& rhs, const solve_options& options, completion done);
+
+    size_t pending() const { return heap_.size(); }
+
+    // Gives the next solve a slice, returns false if there was nothing to run
+    bool run_one();
+
+    // Until every solve has finished
+    void run();
+
+private:
+    struct entry {
+        size_t                      id;
+        std::unique_ptr<solve_task> task;
+        completion                  done;
+    };
+    typedef std::unique_ptr<entry> entry_ptr;
+
+    scheduler_options      options_;
+    size_t                 next_id_;
+    std::vector<entry_ptr> heap_;
+
+    // Heap order, true if a should run after b
+    bool later(const entry_ptr& a, const entry_ptr& b) const;
+};
+
+#endif
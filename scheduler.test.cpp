@@ -0,0 +1,89 @@
+#include "scheduler.h"
+#include <iostream>
+#include <assert.h>
+
+namespace {
+
+solve_options quiet() {
+    solve_options options;
+    options.trace = nullptr;
+    return options;
+}
+
+void test_slices() {
+    const auto lhs = var("a") * var("b") + var("c") * var("d") - var("e") / var("f");
+    const auto rhs = var("g") + var("h") * var("i");
+    const auto whole = solver::solve("c", *lhs, *rhs, quiet());
+    solve_task task{"c", *lhs, *rhs, quiet()};
+    unsigned slices = 0;
+    while (!task.resume(1)) {
+        ++slices;
+        assert(task.expanded() == slices);
+    }
+    assert(task.result().status == whole.status);
+    assert(task.result().expanded == whole.expanded);
+    assert(task.result().solution->equal(*whole.solution));
+    assert(task.resume(1));
+
+    // Closed form solves take the first slice, not the constructor
+    solve_task quadratic{"x", *(var("x") * var("x")), *constant(4), quiet()};
+    assert(!quadratic.done());
+    assert(quadratic.resume(1) && quadratic.expanded() == 0);
+    assert(quadratic.result().roots.size() == 2);
+
+    // The numeric fallback gets a slice of its own once the search gives up
+    solve_task numeric{"x", *((var("x") * var("x") + constant(1)) / (var("x") + constant(3))), *constant(5), quiet()};
+    while (!numeric.resume(1000)) {
+        assert(numeric.result().numeric_steps == 0);
+    }
+    assert(numeric.result().status == solve_status::solved && numeric.result().numeric_steps > 0);
+}
+
+// Completion order of a hard solve followed by easy ones
+std::vector<size_t> completion_order(const scheduler_options& options) {
+    solve_scheduler scheduler{options};
+    std::vector<size_t> order;
+    const auto done = [&order](size_t id, solve_result&) { order.push_back(id); };
+    auto hard = quiet();
+    hard.max_jobs = 300;
+    // x can't be isolated, the search runs out of jobs
+    scheduler.submit("x", *(var("x") * var("y") + var("y") * var("x") * var("x")), *constant(10), hard, done);
+    for (int i = 0; i < 3; ++i) {
+        scheduler.submit("x", *(var("x") * var("y") + constant(i)), *var("z"), quiet(), done);
+    }
+    assert(scheduler.pending() == 4);
+    scheduler.run();
+    assert(scheduler.pending() == 0 && !scheduler.run_one());
+    return order;
+}
+
+void test_scheduler() {
+    scheduler_options options;
+    options.policy = schedule_policy::in_order;
+    assert((completion_order(options) == std::vector<size_t>{0, 1, 2, 3}));
+    options.policy = schedule_policy::least_expanded;
+    assert((completion_order(options) == std::vector<size_t>{1, 2, 3, 0}));
+
+    // Deadlines far enough out not to be hit
+    options.policy = schedule_policy::earliest_deadline;
+    solve_scheduler scheduler{options};
+    std::vector<size_t> order;
+    const auto now = solve_options::clock::now();
+    for (int i = 0; i < 3; ++i) {
+        auto o = quiet();
+        o.deadline = now + std::chrono::hours(3 - i);
+        scheduler.submit("x", *(var("x") + constant(i)), *var("y"), o, [&order](size_t id, solve_result& r) {
+            assert(r.status == solve_status::solved);
+            order.push_back(id);
+        });
+    }
+    scheduler.run();
+    assert((order == std::vector<size_t>{2, 1, 0}));
+}
+
+} // unnamed namespace
+
+void scheduler_test() {
+    test_slices();
+    test_scheduler();
+}
@@ -0,0 +1,368 @@
+#include "serialize.h"
+#include <stdexcept>
+#include <string.h>
+#include <math.h>
+
+namespace {
+
+const char magic[4] = { 'S', 'L', 'V', 'B' };
+
+void put_varint(std::string& out, uint64_t x) {
+    while (x >= 0x80) {
+        out += static_cast<char>((x & 0x7f) | 0x80);
+        x >>= 7;
+    }
+    out += static_cast<char>(x);
+}
+
+// Only used on validated data
+uint64_t get_varint(const char*& p) {
+    uint64_t x = 0;
+    for (unsigned shift = 0;; shift += 7) {
+        const unsigned char b = *p++;
+        x |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) return x;
+    }
+}
+
+uint64_t checked_varint(const char*& p, const char* end) {
+    uint64_t x = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (p == end) {
+            throw std::runtime_error("Truncated varint in serialized expression");
+        }
+        const unsigned char b = *p++;
+        x |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) return x;
+    }
+    throw std::runtime_error("Overlong varint in serialized expression");
+}
+
+void put_double(std::string& out, double d) {
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    for (int i = 0; i < 8; ++i) {
+        out += static_cast<char>(bits >> (8 * i));
+    }
+}
+
+double get_double(const char* p) {
+    uint64_t bits = 0;
+    for (int i = 0; i < 8; ++i) {
+        bits |= static_cast<uint64_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+    }
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+// Integral doubles that survive a round trip through int64_t, except -0
+bool is_small_integer(double d) {
+    return d >= -9007199254740992.0 && d <= 9007199254740992.0 && d == static_cast<int64_t>(d) && !(d == 0 && signbit(d));
+}
+
+uint64_t zigzag(int64_t x) {
+    return (static_cast<uint64_t>(x) << 1) ^ static_cast<uint64_t>(x >> 63);
+}
+
+int64_t unzigzag(uint64_t x) {
+    return static_cast<int64_t>(x >> 1) ^ -static_cast<int64_t>(x & 1);
+}
+
+serialize::node_kind op_kind(char op) {
+    switch (op) {
+    case '+': return serialize::node_kind::add;
+    case '-': return serialize::node_kind::sub;
+    case '*': return serialize::node_kind::mul;
+    case '/': return serialize::node_kind::div;
+    }
+    throw std::logic_error(std::string("Unknown operator '") + op + "' in serialize");
+}
+
+} // unnamed namespace
+
+namespace serialize {
+
+void writer::add(const expr& e) {
+    put_varint(roots_, 0);
+    encode(e);
+    ++root_count_;
+}
+
+void writer::add(const std::string& name, const expr& e) {
+    put_varint(roots_, intern(name) + 1);
+    encode(e);
+    ++root_count_;
+}
+
+std::string writer::data() const {
+    std::string out(magic, magic + sizeof(magic));
+    put_varint(out, format_version);
+    put_varint(out, vars_.size());
+    for (const auto& v : vars_) {
+        put_varint(out, v.size());
+        out += v;
+    }
+    put_varint(out, root_count_);
+    out += roots_;
+    return out;
+}
+
+uint64_t writer::intern(const std::string& name) {
+    auto it = var_index_.find(name);
+    if (it != var_index_.end()) {
+        return it->second;
+    }
+    var_index_.emplace(name, vars_.size());
+    vars_.push_back(name);
+    return vars_.size() - 1;
+}
+
+void writer::encode(const expr& e) {
+    if (auto c = expr_cast<const_expr>(e)) {
+        if (c->exact() && c->exact_value().small() && !c->exact_value().integer()) {
+            put_varint(roots_, static_cast<uint64_t>(node_kind::rational));
+            put_varint(roots_, zigzag(c->exact_value().small_numerator()));
+            put_varint(roots_, static_cast<uint64_t>(c->exact_value().small_denominator()));
+            return;
+        }
+    }
+    auto m =
+        or_m(const_m([&](double c) {
+                if (is_small_integer(c)) {
+                    put_varint(roots_, static_cast<uint64_t>(node_kind::integer));
+                    put_varint(roots_, zigzag(static_cast<int64_t>(c)));
+                } else {
+                    put_varint(roots_, static_cast<uint64_t>(node_kind::constant));
+                    put_double(roots_, c);
+                }
+                return true;
+            }),
+            var_m([&](const std::string& name) {
+                put_varint(roots_, static_cast<uint64_t>(node_kind::variable));
+                put_varint(roots_, intern(name));
+                return true;
+            }),
+            neg_m([&](const expr& ne) {
+                put_varint(roots_, static_cast<uint64_t>(node_kind::negation));
+                encode(ne);
+                return true;
+            }),
+            bin_op_m([&](char op, const expr& lhs, const expr& rhs) {
+                put_varint(roots_, static_cast<uint64_t>(op_kind(op)));
+                encode(lhs);
+                encode(rhs);
+                return true;
+            }));
+    if (!m(e)) {
+        throw std::logic_error("Unknown expression type in serialize");
+    }
+}
+
+bool operator==(const string_ref& a, const std::string& b) {
+    return a.length == b.size() && memcmp(a.data, b.data(), a.length) == 0;
+}
+
+node_kind node::kind() const {
+    const char* p = p_;
+    return static_cast<node_kind>(get_varint(p));
+}
+
+double node::value() const {
+    if (kind() == node_kind::rational) {
+        return exact_value().to_double();
+    }
+    if (kind() == node_kind::integer) {
+        const char* p = p_ + 1;
+        return static_cast<double>(unzigzag(get_varint(p)));
+    }
+    assert(kind() == node_kind::constant);
+    return get_double(p_ + 1);
+}
+
+::rational node::exact_value() const {
+    const char* p = p_ + 1;
+    const int64_t n = unzigzag(get_varint(p));
+    if (kind() == node_kind::integer) {
+        return ::rational(n);
+    }
+    assert(kind() == node_kind::rational);
+    return ::rational(n, static_cast<int64_t>(get_varint(p)));
+}
+
+string_ref node::var_name() const {
+    assert(kind() == node_kind::variable);
+    const char* p = p_ + 1;
+    return reader_->vars_[get_varint(p)];
+}
+
+char node::op() const {
+    switch (kind()) {
+    case node_kind::add: return '+';
+    case node_kind::sub: return '-';
+    case node_kind::mul: return '*';
+    case node_kind::div: return '/';
+    default:             break;
+    }
+    assert(false);
+    return 0;
+}
+
+node node::operand() const {
+    assert(kind() == node_kind::negation);
+    return node{*reader_, p_ + 1};
+}
+
+node node::lhs() const {
+    assert(kind() >= node_kind::add && kind() <= node_kind::div);
+    return node{*reader_, p_ + 1};
+}
+
+node node::rhs() const {
+    assert(kind() >= node_kind::add && kind() <= node_kind::div);
+    return node{*reader_, p_ + reader_->rhs_offset_[p_ - reader_->begin_]};
+}
+
+expr_ptr node::decode() const {
+    switch (kind()) {
+    case node_kind::constant:
+    case node_kind::integer:  return constant(value());
+    case node_kind::rational: return constant(exact_value());
+    case node_kind::variable: return var(var_name().str());
+    case node_kind::negation: return -operand().decode();
+    default: {
+        auto l = lhs().decode();
+        return do_op(op(), std::move(l), rhs().decode());
+    }
+    }
+}
+
+reader::reader(const char* data, size_t length) : begin_(data), end_(data + length) {
+    const char* p = data;
+    if (length < sizeof(magic) || memcmp(p, magic, sizeof(magic)) != 0) {
+        throw std::runtime_error("Not a serialized expression (bad magic)");
+    }
+    if (length > UINT32_MAX) {
+        throw std::runtime_error("Serialized expression too large");
+    }
+    p += sizeof(magic);
+    const auto version = checked_varint(p, end_);
+    if (version != format_version) {
+        throw std::runtime_error("Unsupported serialized expression version " + std::to_string(version));
+    }
+    const auto var_count = checked_varint(p, end_);
+    for (uint64_t i = 0; i < var_count; ++i) {
+        const auto l = checked_varint(p, end_);
+        if (l > static_cast<uint64_t>(end_ - p)) {
+            throw std::runtime_error("Truncated variable table in serialized expression");
+        }
+        vars_.push_back(string_ref{p, static_cast<size_t>(l)});
+        p += l;
+    }
+    const auto root_count = checked_varint(p, end_);
+    for (uint64_t i = 0; i < root_count; ++i) {
+        const auto name = checked_varint(p, end_);
+        if (name > vars_.size()) {
+            throw std::runtime_error("Invalid root name in serialized expression");
+        }
+        roots_.push_back(root_info{name, p});
+        p = validate(p);
+    }
+    if (p != end_) {
+        throw std::runtime_error("Trailing data after serialized expression");
+    }
+}
+
+// Check the node at p, returns a pointer past it. Also notes where the rhs
+// of each binary node starts: its lhs is done once pending drops back to
+// what it was when the binary node was read.
+const char* reader::validate(const char* p) {
+    struct open_binary {
+        const char* tag;
+        size_t      pending;
+    };
+    std::vector<open_binary> open;
+    for (size_t pending = 1; pending; ) {
+        const char* const start = p;
+        const auto tag = checked_varint(p, end_);
+        switch (tag) {
+        case static_cast<uint64_t>(node_kind::constant):
+            if (end_ - p < 8) {
+                throw std::runtime_error("Truncated constant in serialized expression");
+            }
+            p += 8;
+            break;
+        case static_cast<uint64_t>(node_kind::variable):
+            if (checked_varint(p, end_) >= vars_.size()) {
+                throw std::runtime_error("Invalid variable index in serialized expression");
+            }
+            break;
+        case static_cast<uint64_t>(node_kind::integer):
+            checked_varint(p, end_);
+            break;
+        case static_cast<uint64_t>(node_kind::rational): {
+            checked_varint(p, end_);
+            const auto d = checked_varint(p, end_);
+            if (d == 0 || d > static_cast<uint64_t>(INT64_MAX)) {
+                throw std::runtime_error("Invalid denominator in serialized expression");
+            }
+            break;
+        }
+        case static_cast<uint64_t>(node_kind::negation):
+            ++pending;
+            break;
+        case static_cast<uint64_t>(node_kind::add):
+        case static_cast<uint64_t>(node_kind::sub):
+        case static_cast<uint64_t>(node_kind::mul):
+        case static_cast<uint64_t>(node_kind::div):
+            if (rhs_offset_.empty()) {
+                rhs_offset_.resize(end_ - begin_);
+            }
+            open.push_back(open_binary{start, pending});
+            pending += 2;
+            break;
+        default:
+            throw std::runtime_error("Invalid tag " + std::to_string(tag) + " in serialized expression");
+        }
+        for (--pending; !open.empty() && open.back().pending == pending; open.pop_back()) {
+            rhs_offset_[open.back().tag - begin_] = static_cast<uint32_t>(p - open.back().tag);
+        }
+    }
+    return p;
+}
+
+std::string encode(const expr& e) {
+    writer w;
+    w.add(e);
+    return w.data();
+}
+
+std::string encode(const std::map<std::string, expr_ptr>& solutions) {
+    writer w;
+    for (const auto& s : solutions) {
+        w.add(s.first, *s.second);
+    }
+    return w.data();
+}
+
+expr_ptr decode_expr(const std::string& data) {
+    reader r{data};
+    if (r.size() != 1 || r.named(0)) {
+        throw std::runtime_error("Expected a single unnamed serialized expression");
+    }
+    return r.root(0).decode();
+}
+
+std::map<std::string, expr_ptr> decode_solutions(const std::string& data) {
+    reader r{data};
+    std::map<std::string, expr_ptr> res;
+    for (size_t i = 0; i < r.size(); ++i) {
+        if (!r.named(i)) {
+            throw std::runtime_error("Expected named serialized expressions");
+        }
+        res[r.name(i).str()] = r.root(i).decode();
+    }
+    return res;
+}
+
+} // namespace serialize
@@ -0,0 +1,136 @@
+#ifndef SOLVE_SERIALIZE_H
+#define SOLVE_SERIALIZE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <stdint.h>
+#include "expr.h"
+
+namespace serialize {
+
+// Compact binary encoding of expressions.
+//
+//   document  := "SLVB" varint(version) variables roots
+//   variables := varint(count) { varint(length) bytes }*
+//   roots     := varint(count) { varint(name) node }*
+//   node      := varint(tag) payload
+//
+// Variable names are interned in the variable table and referenced by
+// index. A root's name is 0 when unnamed and the variable table index + 1
+// otherwise. Integral constants are stored as zigzag varints, other exact
+// constants with 64-bit parts as a zigzag numerator and a denominator
+// varint, and the rest as the 8 bytes of the IEEE-754 double in little
+// endian order,
+// negation is followed by its operand and binary
+// operations by their lhs and rhs in prefix order.
+const uint32_t format_version = 1;
+
+enum class node_kind {
+    constant = 0,
+    variable = 1,
+    negation = 2,
+    add      = 3,
+    sub      = 4,
+    mul      = 5,
+    div      = 6,
+    integer  = 7, // a constant with an integral value
+    rational = 8, // an exact constant that isn't an integer
+};
+
+class writer {
+public:
+    explicit writer() : root_count_(0) {}
+
+    // Append an unnamed root
+    void add(const expr& e);
+    // Append a root named name, e.g. the variable a solution is for
+    void add(const std::string& name, const expr& e);
+
+    std::string data() const;
+
+private:
+    std::unordered_map<std::string, uint64_t> var_index_;
+    std::vector<std::string>                  vars_;
+    std::string                               roots_;
+    size_t                                    root_count_;
+
+    uint64_t intern(const std::string& name);
+    void encode(const expr& e);
+};
+
+// Refers to bytes owned by the buffer given to reader
+struct string_ref {
+    const char* data;
+    size_t      length;
+
+    std::string str() const { return std::string(data, length); }
+};
+bool operator==(const string_ref& a, const std::string& b);
+
+class reader;
+
+// A node inside the buffer, navigating it allocates nothing
+class node {
+public:
+    node_kind  kind() const;
+    double     value() const;     // node_kind::constant, node_kind::integer or node_kind::rational
+    ::rational exact_value() const; // node_kind::integer or node_kind::rational
+    string_ref var_name() const;  // node_kind::variable
+    char       op() const;        // binary operations
+    node       operand() const;   // node_kind::negation
+    node       lhs() const;       // binary operations
+    node       rhs() const;       // binary operations
+
+    expr_ptr   decode() const;
+
+private:
+    friend reader;
+    node(const reader& r, const char* p) : reader_(&r), p_(p) {}
+
+    const reader* reader_;
+    const char*   p_;             // points at the tag
+};
+
+// Validates a document up front, after which its nodes can be walked
+// without any further checks. The buffer must outlive the reader.
+class reader {
+public:
+    reader(const char* data, size_t length);
+    explicit reader(const std::string& data) : reader(data.data(), data.size()) {}
+
+    size_t     var_count() const { return vars_.size(); }
+    string_ref var(size_t index) const { return vars_[index]; }
+
+    size_t     size() const { return roots_.size(); }
+    bool       named(size_t index) const { return roots_[index].name != 0; }
+    string_ref name(size_t index) const { return vars_[roots_[index].name - 1]; }
+    node       root(size_t index) const { return node{*this, roots_[index].p}; }
+
+private:
+    friend node;
+    struct root_info {
+        uint64_t    name;
+        const char* p;
+    };
+    const char*             begin_;
+    const char*             end_;
+    std::vector<string_ref> vars_;
+    std::vector<root_info>  roots_;
+    // Indexed by the offset of a binary node's tag, the distance to its rhs
+    std::vector<uint32_t>   rhs_offset_;
+
+    const char* validate(const char* p);
+};
+
+std::string encode(const expr& e);
+std::string encode(const std::map<std::string, expr_ptr>& solutions);
+
+// Throw std::runtime_error if data isn't a valid document of the expected shape
+expr_ptr decode_expr(const std::string& data);
+std::map<std::string, expr_ptr> decode_solutions(const std::string& data);
+
+} // namespace serialize
+
+#endif
@@ -0,0 +1,100 @@
+#include "serialize.h"
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <assert.h>
+
+namespace {
+
+void test_round_trip(const expr_ptr& e) {
+    const auto data = serialize::encode(*e);
+    auto decoded = serialize::decode_expr(data);
+    if (!decoded->equal(*e)) {
+        std::cout << "Serialization round trip of " << e << " failed.\n";
+        std::cout << "Got: " << decoded << std::endl;
+        assert(false);
+    }
+}
+
+void test_invalid(const std::string& name, const std::string& data) {
+    try {
+        serialize::reader r{data};
+    } catch (const std::runtime_error&) {
+        return;
+    }
+    std::cout << "Invalid serialized data accepted: " << name << std::endl;
+    assert(false);
+}
+
+bool points_into(const serialize::string_ref& s, const std::string& buffer) {
+    return s.data >= buffer.data() && s.data + s.length <= buffer.data() + buffer.size();
+}
+
+} // unnamed namespace
+
+void serialize_test() {
+    test_round_trip(constant(0.1));
+    test_round_trip(constant(-0.0));
+    test_round_trip(constant(-3) + constant(9007199254740993.0));
+    test_round_trip(constant(-500.0/42));
+    test_round_trip(constant(1e300) * constant(1e-300));
+    test_round_trip(-(var("xyz") + constant(2)) / (var("a") - var("$0") * constant(3)));
+    test_round_trip(var("x") + var("x") * var("x"));
+    test_round_trip(constant(rational(1, 10)) - constant(rational(-7, 3)) * constant(rational(INT64_MAX, 2)));
+
+    // Exact constants stay exact, even the ones a double can't hold
+    const auto third = serialize::decode_expr(serialize::encode(*constant(rational(1, 3))));
+    assert(expr_cast<const_expr>(*third)->exact() && expr_cast<const_expr>(*third)->exact_value() == rational(1, 3));
+
+    // Solutions with interned names
+    std::map<std::string, expr_ptr> solutions;
+    solutions["Y"] = constant(500) - var("Z");
+    solutions["Z"] = constant(500) - var("Y");
+    const auto data = serialize::encode(solutions);
+    auto decoded = serialize::decode_solutions(data);
+    assert(decoded.size() == 2);
+    assert(decoded["Y"]->equal(*solutions["Y"]));
+    assert(decoded["Z"]->equal(*solutions["Z"]));
+
+    // Walk without decoding, names refer to the buffer
+    serialize::reader r{data};
+    assert(r.var_count() == 2 && r.size() == 2);
+    assert(r.named(0) && r.name(0) == std::string("Y") && points_into(r.name(0), data));
+    auto n = r.root(0);
+    assert(n.kind() == serialize::node_kind::sub && n.op() == '-');
+    assert(n.lhs().kind() == serialize::node_kind::integer && n.lhs().value() == 500);
+    assert(n.rhs().kind() == serialize::node_kind::variable && n.rhs().var_name() == std::string("Z"));
+    assert(points_into(n.rhs().var_name(), data));
+
+    // Shared variables are only stored once, far smaller than the text form
+    auto big = var("alpha");
+    for (int i = 0; i < 20; ++i) {
+        big = std::move(big) * var("alpha") + constant(i);
+    }
+    std::ostringstream text;
+    text << big;
+    const auto big_data = serialize::encode(*big);
+    assert(big_data.size() < text.str().size() / 2);
+
+    // Each rhs on the left spine is found without walking the lhs
+    serialize::reader spine{big_data};
+    auto add = spine.root(0);
+    for (int i = 19; i >= 0; --i) {
+        assert(add.op() == '+' && add.rhs().value() == i);
+        assert(add.lhs().op() == '*' && add.lhs().rhs().var_name() == std::string("alpha"));
+        add = add.lhs().lhs();
+    }
+    assert(add.kind() == serialize::node_kind::variable);
+
+    const auto x = serialize::encode(*(var("x") + constant(2)));
+    test_invalid("empty", "");
+    test_invalid("bad magic", "XXXX" + x.substr(4));
+    test_invalid("bad version", x.substr(0, 4) + '\x02' + x.substr(5));
+    for (size_t l = 0; l < x.size(); ++l) {
+        test_invalid("truncated to " + std::to_string(l), x.substr(0, l));
+    }
+    test_invalid("trailing data", x + '\0');
+    test_invalid("bad tag", serialize::encode(*constant(1)).substr(0, 8) + '\x09');
+    test_invalid("zero denominator", serialize::encode(*constant(rational(1, 2))).substr(0, 10) + '\x00');
+    test_invalid("bad variable index", std::string("SLVB\x01\x00\x01\x00\x01\x00", 10));
+}
@@ -0,0 +1,361 @@
+#include "server.h"
+#include "parse.h"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace {
+
+// Bytes on the wake pipe
+const char wake_stop = 0;
+const char wake_room = 1;
+
+std::runtime_error system_error(const std::string& what) {
+    return std::runtime_error(what + ": " + strerror(errno));
+}
+
+sockaddr_un socket_address(const std::string& path) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("Invalid socket path \"" + path + "\"");
+    }
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return addr;
+}
+
+bool write_all(int fd, const std::string& data) {
+    for (size_t done = 0; done < data.size();) {
+        const ssize_t n = send(fd, data.data() + done, data.size() - done, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+// Appends what's available to buffer, false on end of file or error
+bool read_some(int fd, std::string& buffer) {
+    char chunk[4096];
+    for (;;) {
+        const ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        buffer.append(chunk, n);
+        return true;
+    }
+}
+
+// Removes the complete lines from the front of buffer
+std::vector<std::string> take_lines(std::string& buffer) {
+    std::vector<std::string> lines;
+    size_t start = 0;
+    for (size_t end; (end = buffer.find('\n', start)) != std::string::npos; start = end + 1) {
+        size_t len = end - start;
+        if (len && buffer[end - 1] == '\r') {
+            --len;
+        }
+        lines.push_back(buffer.substr(start, len));
+    }
+    buffer.erase(0, start);
+    return lines;
+}
+
+} // unnamed namespace
+
+bool solve_request(template_cache& templates, const std::string& line, std::string& answer) {
+    try {
+        source::file src{"<request>", line};
+        const auto eq = parse_equation(src);
+        std::ostringstream out;
+        solve_status status;
+        const char* sep = "";
+        for (const auto& s : templates.solve_all(*eq.first, *eq.second, &status)) {
+            out << sep << s.first << " = " << *s.second;
+            sep = "; ";
+        }
+        if (status == solve_status::no_solution || status == solve_status::any_value) {
+            out << status;
+        }
+        answer = out.str();
+        return true;
+    } catch (const std::exception& e) {
+        answer = e.what();
+        // Keep the protocol one line per request
+        for (auto& c : answer) {
+            if (c == '\n') c = ' ';
+        }
+        return false;
+    }
+}
+
+solve_server::solve_server(const std::string& path, const server_options& options)
+    : path_(path)
+    , options_(options)
+    , listen_fd_(-1)
+    , requests_(0)
+    , batches_(0)
+    , stopping_(false)
+    , active_connections_(0) {
+    if (options_.workers == 0 || options_.max_batch == 0 || options_.max_connections == 0) {
+        throw std::runtime_error("A server needs at least one worker taking at least one request at a time, and room for a connection");
+    }
+    if (!options_.profile_file.empty()) {
+        profile_.load_file(options_.profile_file);
+    }
+    const auto addr = socket_address(path_);
+    if (pipe(wake_) != 0) {
+        throw system_error("pipe");
+    }
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        const auto err = system_error("socket");
+        close(wake_[0]);
+        close(wake_[1]);
+        throw err;
+    }
+    unlink(path_.c_str());
+    if (bind(listen_fd_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listen_fd_, 64) != 0) {
+        const auto err = system_error("Could not listen on " + path_);
+        close(listen_fd_);
+        close(wake_[0]);
+        close(wake_[1]);
+        throw err;
+    }
+}
+
+solve_server::~solve_server() {
+    close(listen_fd_);
+    close(wake_[0]);
+    close(wake_[1]);
+    unlink(path_.c_str());
+}
+
+void solve_server::stop() {
+    const char c = wake_stop;
+    while (write(wake_[1], &c, 1) < 0 && errno == EINTR) {
+    }
+}
+
+void solve_server::run() {
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < options_.workers; ++i) {
+        workers.emplace_back(&solve_server::worker, this);
+    }
+
+    pollfd fds[2] = { { listen_fd_, POLLIN, 0 }, { wake_[0], POLLIN, 0 } };
+    for (;;) {
+        {
+            // Not accepting while full, a negative fd is ignored by poll
+            std::lock_guard<std::mutex> lock{mutex_};
+            fds[0].fd = active_connections_ < options_.max_connections ? listen_fd_ : -1;
+            fds[0].revents = 0;
+        }
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) {
+            char c = wake_stop;
+            (void)!read(wake_[0], &c, 1);
+            if (c == wake_room) continue;
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock{mutex_};
+            connections_.push_back(fd);
+            ++active_connections_;
+            std::thread{&solve_server::serve_connection, this, fd}.detach();
+        }
+    }
+
+    // Let the connections finish the requests they've read, then the workers
+    std::unique_lock<std::mutex> lock{mutex_};
+    for (const int fd : connections_) {
+        shutdown(fd, SHUT_RD);
+    }
+    closed_.wait(lock, [this] { return active_connections_ == 0; });
+    stopping_ = true;
+    queued_.notify_all();
+    lock.unlock();
+    for (auto& t : workers) {
+        t.join();
+    }
+    stopping_ = false;
+    if (!options_.profile_file.empty()) {
+        profile_.save_file(options_.profile_file);
+    }
+}
+
+void solve_server::enqueue(const std::shared_ptr<batch>& b) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    for (size_t i = 0; i < b->requests.size(); ++i) {
+        if (b->requests[i].response.empty()) {
+            queue_.emplace_back(b, i);
+        }
+    }
+    queued_.notify_all();
+}
+
+void solve_server::serve_connection(int fd) {
+    const std::string too_long = "error 0us Request longer than " + std::to_string(options_.max_line) + " bytes";
+    std::string buffer;
+    // Dropping what's left of a line that grew past max_line
+    bool overlong = false;
+    for (bool open = true; open;) {
+        open = read_some(fd, buffer);
+        auto lines = take_lines(buffer);
+        std::vector<bool> rejected(lines.size());
+        if (overlong && !lines.empty()) {
+            rejected[0] = true;
+            overlong = false;
+        }
+        if (buffer.size() > options_.max_line) {
+            buffer.clear();
+            overlong = true;
+        }
+        if (!open && (overlong || !buffer.empty())) {
+            // The last line, without its newline
+            if (!buffer.empty() && buffer.back() == '\r') {
+                buffer.pop_back();
+            }
+            lines.push_back(std::move(buffer));
+            rejected.push_back(overlong);
+        }
+        if (lines.empty()) {
+            continue;
+        }
+        const auto received = request::clock::now();
+        auto b = std::make_shared<batch>();
+        b->requests.resize(lines.size());
+        b->remaining = 0;
+        for (size_t i = 0; i < lines.size(); ++i) {
+            auto& r = b->requests[i];
+            if (rejected[i] || lines[i].size() > options_.max_line) {
+                r.response = too_long;
+            } else {
+                r.line = std::move(lines[i]);
+                r.received = received;
+                ++b->remaining;
+            }
+        }
+        requests_ += lines.size();
+        enqueue(b);
+
+        std::string out;
+        {
+            std::unique_lock<std::mutex> lock{b->mutex};
+            b->answered.wait(lock, [&b] { return b->remaining == 0; });
+        }
+        for (const auto& r : b->requests) {
+            out += r.response;
+            out += '\n';
+        }
+        if (!write_all(fd, out)) {
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock{mutex_};
+    connections_.erase(std::find(connections_.begin(), connections_.end(), fd));
+    close(fd);
+    if (active_connections_-- == options_.max_connections) {
+        // run() stopped accepting
+        const char c = wake_room;
+        while (write(wake_[1], &c, 1) < 0 && errno == EINTR) {
+        }
+    }
+    closed_.notify_all();
+}
+
+void solve_server::worker() {
+    template_cache templates{nullptr, options_.profile_file.empty() ? nullptr : &profile_};
+    std::vector<queue_entry> taken;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock{mutex_};
+            queued_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;
+            }
+            const size_t n = std::min(queue_.size(), options_.max_batch);
+            taken.assign(std::make_move_iterator(queue_.begin()), std::make_move_iterator(queue_.begin() + n));
+            queue_.erase(queue_.begin(), queue_.begin() + n);
+        }
+        ++batches_;
+        for (auto& entry : taken) {
+            auto& r = entry.first->requests[entry.second];
+            std::string answer;
+            const bool ok = solve_request(templates, r.line, answer);
+            const auto us = std::chrono::duration_cast<std::chrono::microseconds>(request::clock::now() - r.received).count();
+            r.response = (ok ? "ok " : "error ") + std::to_string(us) + "us" + (answer.empty() ? "" : " " + answer);
+
+            std::lock_guard<std::mutex> lock{entry.first->mutex};
+            if (--entry.first->remaining == 0) {
+                entry.first->answered.notify_all();
+            }
+        }
+        taken.clear();
+    }
+}
+
+server_client::server_client(const std::string& path) : fd_(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) {
+    if (fd_ < 0) {
+        throw system_error("socket");
+    }
+    const auto addr = socket_address(path);
+    if (connect(fd_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+        const auto err = system_error("Could not connect to " + path);
+        close(fd_);
+        throw err;
+    }
+}
+
+server_client::~server_client() {
+    close(fd_);
+}
+
+std::vector<std::string> server_client::request(const std::vector<std::string>& lines) {
+    std::string out;
+    for (const auto& l : lines) {
+        out += l;
+        out += '\n';
+    }
+    if (!write_all(fd_, out)) {
+        throw system_error("send");
+    }
+    std::vector<std::string> responses = take_lines(buffer_);
+    while (responses.size() < lines.size()) {
+        if (!read_some(fd_, buffer_)) {
+            throw std::runtime_error("Connection closed with " + std::to_string(lines.size() - responses.size()) + " responses outstanding");
+        }
+        for (auto& r : take_lines(buffer_)) {
+            responses.push_back(std::move(r));
+        }
+    }
+    return responses;
+}
+
+std::string server_client::request(const std::string& line) {
+    return request(std::vector<std::string>{line}).front();
+}
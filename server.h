@@ -0,0 +1,134 @@
+#ifndef SOLVE_SERVER_H
+#define SOLVE_SERVER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include "templates.h"
+#include "rule_profile.h"
+
+// A long running solver listening on a Unix domain socket. Clients send
+// newline terminated equations and get one line back for each, in order:
+//
+//   ok <latency>us <v> = <solution>; <v> = <solution>
+//   ok <latency>us no solution
+//   ok <latency>us any value
+//   error <latency>us <message>
+//
+// or a bare "ok <latency>us" when the search gave up, where latency is the time from reading the request to its answer being
+// ready. Requests arriving together, on one connection or many, are queued
+// and taken in batches by a pool of workers. Each worker keeps its own
+// template_cache, so equations of a shape seen before are answered without
+// searching. With a profile_file the workers share one rule_profile, kept in
+// that file from one run of the server to the next.
+
+struct server_options {
+    server_options() : workers(4), max_batch(32), max_line(64 * 1024), max_connections(64) {}
+
+    unsigned    workers;
+    size_t      max_batch;    // requests a worker takes off the queue at once
+    // Longer request lines are answered with an error without being kept
+    size_t      max_line;
+    // Connections served at once, more wait in the listen backlog
+    size_t      max_connections;
+    // The rule_profile the searches use, loaded when the server starts if
+    // the file exists and saved when run() returns. "" for no profile.
+    std::string profile_file;
+};
+
+// A final line without a newline is answered when the client shuts down its
+// side of the connection.
+
+// Solves one request line, answer gets the solutions, "no solution", "any
+// value" or the error message
+bool solve_request(template_cache& templates, const std::string& line, std::string& answer);
+
+class solve_server {
+public:
+    // Binds and listens on path, replacing a stale socket file. Throws
+    // std::runtime_error on failure.
+    explicit solve_server(const std::string& path, const server_options& options = server_options{});
+    ~solve_server();
+
+    const std::string& path() const { return path_; }
+
+    // Serves connections until stop() is called. Throws std::runtime_error
+    // if the profile can't be saved afterwards.
+    void run();
+
+    const rule_profile& profile() const { return profile_; }
+
+    // May be called from any thread or a signal handler
+    void stop();
+
+    size_t requests() const { return requests_.load(); }
+    size_t batches() const { return batches_.load(); }
+
+private:
+    struct request {
+        typedef std::chrono::steady_clock clock;
+
+        std::string       line;
+        clock::time_point received;
+        std::string       response;   // set before queueing when the line is rejected
+    };
+
+    // Requests read together from one connection, answered in order
+    struct batch {
+        std::vector<request>    requests;
+        size_t                  remaining;
+        std::mutex              mutex;
+        std::condition_variable answered;
+    };
+    typedef std::pair<std::shared_ptr<batch>, size_t> queue_entry;
+
+    std::string                    path_;
+    server_options                 options_;
+    int                            listen_fd_;
+    int                            wake_[2];  // pipe written by stop(), and when a connection frees up room
+    std::atomic<size_t>            requests_;
+    std::atomic<size_t>            batches_;
+    rule_profile                   profile_;
+
+    std::mutex                     mutex_;    // guards everything below
+    std::condition_variable        queued_;
+    std::deque<queue_entry>        queue_;
+    bool                           stopping_;
+    std::vector<int>               connections_;
+    size_t                         active_connections_;
+    std::condition_variable        closed_;   // a connection has finished
+
+    void worker();
+    void serve_connection(int fd);
+    void enqueue(const std::shared_ptr<batch>& b);
+
+    solve_server(const solve_server&) = delete;
+    solve_server& operator=(const solve_server&) = delete;
+};
+
+// Blocking client for one connection to a solve_server
+class server_client {
+public:
+    // Throws std::runtime_error if the server can't be reached
+    explicit server_client(const std::string& path);
+    ~server_client();
+
+    // Sends all lines at once, then reads as many responses
+    std::vector<std::string> request(const std::vector<std::string>& lines);
+    std::string request(const std::string& line);
+
+private:
+    int         fd_;
+    std::string buffer_;
+
+    server_client(const server_client&) = delete;
+    server_client& operator=(const server_client&) = delete;
+};
+
+#endif
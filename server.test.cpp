@@ -0,0 +1,204 @@
+#include "server.h"
+#include <iostream>
+#include <stdexcept>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace {
+
+// Response without the latency, which varies
+std::string strip_latency(const std::string& response) {
+    const auto status_end = response.find(' ');
+    assert(status_end != std::string::npos);
+    const auto latency_end = response.find("us", status_end);
+    assert(latency_end != std::string::npos);
+    return response.substr(0, status_end) + response.substr(latency_end + 2);
+}
+
+void test_response(const std::string& response, const std::string& expected) {
+    if (strip_latency(response) != expected) {
+        std::cout << "Expected server response \"" << expected << "\" got \"" << response << "\"" << std::endl;
+        assert(false);
+    }
+}
+
+void test_solve_request() {
+    template_cache templates{nullptr};
+    std::string answer;
+    assert(solve_request(templates, "X*2=8", answer));
+    assert(answer == "X = 4");
+    assert(solve_request(templates, "Y+Z=500", answer));
+    assert(answer == "Y = (500 - Z); Z = (500 - Y)");
+    assert(solve_request(templates, "X+1=X", answer));
+    assert(answer == "no solution");
+    assert(solve_request(templates, "X=X", answer));
+    assert(answer == "any value");
+    assert(!solve_request(templates, "X*2=", answer));
+    assert(!answer.empty() && answer.find('\n') == std::string::npos);
+}
+
+void test_server() {
+    const std::string path = "/tmp/solve_test." + std::to_string(getpid()) + ".sock";
+    server_options options;
+    options.workers = 3;
+    options.max_batch = 4;
+    solve_server server{path, options};
+    std::thread serving{&solve_server::run, &server};
+
+    const unsigned clients = 4, per_client = 20;
+    std::vector<std::thread> threads;
+    for (unsigned c = 0; c < clients; ++c) {
+        threads.emplace_back([&path, c] {
+            server_client client{path};
+            std::vector<std::string> lines, expected;
+            for (unsigned i = 0; i < per_client; ++i) {
+                const auto k = std::to_string(c * per_client + i);
+                lines.push_back("X*2=" + k + "*2");
+                expected.push_back("ok X = " + k);
+            }
+            lines.push_back("X*2=");
+            const auto responses = client.request(lines);
+            assert(responses.size() == lines.size());
+            for (unsigned i = 0; i < per_client; ++i) {
+                test_response(responses[i], expected[i]);
+            }
+            assert(responses.back().compare(0, 6, "error ") == 0);
+            // Same connection again, one at a time
+            test_response(client.request("A+1=3"), "ok A = 2");
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    assert(server.requests() == clients * (per_client + 2));
+    assert(server.batches() > 0 && server.batches() <= server.requests());
+
+    server.stop();
+    serving.join();
+
+    bool thrown = false;
+    try {
+        server_client{path + ".missing"};
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+// A connection that sends raw bytes, unlike server_client
+int connect_raw(const std::string& path) {
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    assert(fd >= 0);
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    const int res = connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+    assert(res == 0);
+    return fd;
+}
+
+// Sends data, ends the request side and returns the response lines
+std::vector<std::string> send_raw(int fd, const std::string& data) {
+    for (size_t done = 0; done < data.size();) {
+        const ssize_t n = send(fd, data.data() + done, data.size() - done, MSG_NOSIGNAL);
+        assert(n > 0);
+        done += n;
+    }
+    shutdown(fd, SHUT_WR);
+    std::string received;
+    char chunk[4096];
+    for (ssize_t n; (n = recv(fd, chunk, sizeof(chunk), 0)) > 0;) {
+        received.append(chunk, n);
+    }
+    close(fd);
+    std::vector<std::string> lines;
+    for (size_t start = 0, end; (end = received.find('\n', start)) != std::string::npos; start = end + 1) {
+        lines.push_back(received.substr(start, end - start));
+    }
+    return lines;
+}
+
+// Overlong lines, lines without a newline and more connections than allowed
+void test_server_limits() {
+    const std::string path = "/tmp/solve_test_limits." + std::to_string(getpid()) + ".sock";
+    server_options options;
+    options.workers = 1;
+    options.max_line = 16;
+    options.max_connections = 1;
+    solve_server server{path, options};
+    std::thread serving{&solve_server::run, &server};
+
+    // Answered and the connection lives on, also past a line that never ends
+    auto responses = send_raw(connect_raw(path), "X*2=4\n" + std::string(40, ' ') + "X=1\nX*2=8\nX=" + std::string(10000, '1'));
+    assert(responses.size() == 4);
+    test_response(responses[0], "ok X = 2");
+    assert(responses[1] == "error 0us Request longer than 16 bytes");
+    test_response(responses[2], "ok X = 4");
+    assert(responses[3] == responses[1]);
+
+    responses = send_raw(connect_raw(path), "X*2=6\r");
+    assert(responses.size() == 1);
+    test_response(responses[0], "ok X = 3");
+
+    // A second connection waits in the backlog until the first one closes
+    int second;
+    {
+        server_client first{path};
+        test_response(first.request("X+1=2"), "ok X = 1");
+        second = connect_raw(path);
+        const std::string line = "X+1=3\n";
+        assert(send(second, line.data(), line.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(line.size()));
+        pollfd p{second, POLLIN, 0};
+        assert(poll(&p, 1, 100) == 0);
+        test_response(first.request("X+1=4"), "ok X = 3");
+    }
+    responses = send_raw(second, "");
+    assert(responses.size() == 1);
+    test_response(responses[0], "ok X = 2");
+
+    server.stop();
+    serving.join();
+}
+
+// The server learns into profile_file and saves it on the way out
+void test_server_profile() {
+    const std::string path = "/tmp/solve_test_profile." + std::to_string(getpid());
+    server_options options;
+    options.workers = 1;
+    options.profile_file = path + ".profile";
+    {
+        solve_server server{path + ".sock", options};
+        std::thread serving{&solve_server::run, &server};
+        {
+            server_client client{path + ".sock"};
+            test_response(client.request("(A+1)*B=6"), "ok A = ((6 / B) - 1); B = (6 / (A + 1))");
+        }
+        server.stop();
+        serving.join();
+        // One search per variable of the template
+        assert(server.profile().solves() == 2);
+    }
+    rule_profile saved;
+    assert(saved.load_file(options.profile_file));
+    assert(saved.solves() == 2);
+
+    // A restarted server picks up where the last one left off
+    solve_server again{path + ".sock", options};
+    assert(again.profile().solves() == 2);
+    remove(options.profile_file.c_str());
+}
+
+} // unnamed namespace
+
+void server_test() {
+    test_solve_request();
+    test_server();
+    test_server_limits();
+    test_server_profile();
+}
@@ -0,0 +1,50 @@
+#include "solution_cache.h"
+#include <stdexcept>
+#include "serialize.h"
+
+expr_ptr solution_cache::solve_for(const std::string& v, const expr& lhs, const expr& rhs) {
+    const auto k = key(v, lhs, rhs);
+    std::string value;
+    if (store_.find(k, value)) {
+        try {
+            auto s = value.empty() ? nullptr : serialize::decode_expr(value);
+            ++hits_;
+            return s;
+        } catch (const std::runtime_error&) {
+            // Written by an incompatible version, solve again and shadow it
+        }
+    }
+    ++misses_;
+    auto s = solver::solve_for(v, lhs, rhs);
+    store_.insert(k, s ? serialize::encode(*s) : "");
+    return s;
+}
+
+solution_cache::solution_map solution_cache::solve_all(const expr& lhs, const expr& rhs, const solve_all_function& solve, solve_status* status) {
+    const auto k = key("", lhs, rhs);
+    std::string value;
+    if (store_.find(k, value) && !value.empty() && value[0] >= '0' && value[0] <= '0' + static_cast<int>(solve_status::any_value)) {
+        try {
+            auto solutions = serialize::decode_solutions(value.substr(1));
+            ++hits_;
+            if (status) *status = static_cast<solve_status>(value[0] - '0');
+            return solutions;
+        } catch (const std::runtime_error&) {
+        }
+    }
+    ++misses_;
+    solve_status solved;
+    auto solutions = solve(lhs, rhs, &solved);
+    store_.insert(k, static_cast<char>('0' + static_cast<int>(solved)) + serialize::encode(solutions));
+    if (status) *status = solved;
+    return solutions;
+}
+
+std::string solution_cache::key(const std::string& v, const expr& lhs, const expr& rhs) {
+    auto l = serialize::encode(*simplify(lhs));
+    auto r = serialize::encode(*simplify(rhs));
+    if (r < l) {
+        std::swap(l, r);
+    }
+    return v + '\0' + l + r;
+}
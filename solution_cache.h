@@ -0,0 +1,35 @@
+#ifndef SOLVE_SOLUTION_CACHE_H
+#define SOLVE_SOLUTION_CACHE_H
+
+#include <functional>
+#include "cache.h"
+#include "solver.h"
+
+// Solutions stored in a cache::store, keyed by the canonical form of the
+// simplified equation and the variable solved for ("" for solve_all).
+// Values are serialize:: documents, negative results are cached too. For
+// solve_all they're prefixed with the status digit.
+class solution_cache {
+public:
+    typedef std::map<std::string, expr_ptr> solution_map;
+    // Like solver::solve_all, status may be null
+    typedef std::function<solution_map (const expr&, const expr&, solve_status* status)> solve_all_function;
+
+    explicit solution_cache(const std::string& filename) : store_(filename), hits_(0), misses_(0) {}
+
+    expr_ptr solve_for(const std::string& v, const expr& lhs, const expr& rhs);
+    // status as for solver::solve_all
+    solution_map solve_all(const expr& lhs, const expr& rhs, const solve_all_function& solve, solve_status* status = nullptr);
+
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+
+private:
+    cache::store store_;
+    size_t       hits_;
+    size_t       misses_;
+
+    static std::string key(const std::string& v, const expr& lhs, const expr& rhs);
+};
+
+#endif
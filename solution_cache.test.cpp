@@ -0,0 +1,45 @@
+#include "solution_cache.h"
+#include <iostream>
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+void solution_cache_test()
+{
+    char filename[] = "/tmp/solve_solution_cache_test_XXXXXX";
+    const int fd = mkstemp(filename);
+    assert(fd >= 0);
+    close(fd);
+    unlink(filename);
+
+    const auto lhs = var("x") * constant(4) + constant(10);
+    const auto rhs = var("y");
+    auto solve = [](const expr& l, const expr& r, solve_status* status) { return solver::solve_all(l, r, &std::cout, nullptr, status); };
+    auto quiet = [](const expr& l, const expr& r, solve_status* status) { return solver::solve_all(l, r, nullptr, nullptr, status); };
+    {
+        solution_cache cache{filename};
+        auto s = cache.solve_for("x", *lhs, *rhs);
+        assert(s && s->equal(*((var("y") - constant(10)) / constant(4))));
+        assert(!cache.solve_for("z", *lhs, *rhs));
+        cache.solve_all(*lhs, *rhs, solve);
+        solve_status status;
+        assert(cache.solve_all(*(var("x") + constant(1)), *var("x"), quiet, &status).empty());
+        assert(status == solve_status::no_solution);
+        assert(cache.hits() == 0 && cache.misses() == 4);
+    }
+    {
+        // Warm start, the sides are swapped and not simplified
+        solution_cache cache{filename};
+        auto s = cache.solve_for("x", *rhs, *(var("x") * constant(4) + (constant(5) + constant(5))));
+        assert(s && s->equal(*((var("y") - constant(10)) / constant(4))));
+        assert(!cache.solve_for("z", *lhs, *rhs));
+        solve_status status;
+        auto all = cache.solve_all(*lhs, *rhs, solve, &status);
+        assert(all.size() == 2 && all["y"]->equal(*lhs) && status == solve_status::solved);
+        // The verdict is cached along with the (lack of) solutions
+        assert(cache.solve_all(*(var("x") + constant(1)), *var("x"), quiet, &status).empty());
+        assert(status == solve_status::no_solution);
+        assert(cache.hits() == 4 && cache.misses() == 0);
+    }
+    unlink(filename);
+}
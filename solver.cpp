@@ -0,0 +1,781 @@
+#include "solver.h"
+#include "rules.h"
+#include "rule_profile.h"
+#include "numeric.h"
+#include "polynomial.h"
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+#include <math.h>
+#include <mutex>
+#include <thread>
+
+bool operator==(const job_type& a, const job_type& b) {
+    return a.first->equal(*b.first) && a.second->equal(*b.second);
+}
+
+std::ostream& operator<<(std::ostream& os, const job_type& j) {
+    return os << "{job " << *j.first << " " << *j.second << "}";
+}
+
+std::ostream& operator<<(std::ostream& os, solve_status s) {
+    switch (s) {
+    case solve_status::solved:  return os << "solved";
+    case solve_status::partial: return os << "partial";
+    case solve_status::gave_up: return os << "gave up";
+    case solve_status::no_solution: return os << "no solution";
+    case solve_status::any_value: return os << "any value";
+    }
+    return os;
+}
+
+constexpr size_t solver::fingerprint_memory;
+
+namespace {
+
+// inf and NaN come from folding things like 0*(1/0), and no value of the
+// variable makes an equation holding them true
+bool finite_constants(const expr& e) {
+    // char rather than bool, fold_expr keeps its results in a vector
+    return fold_expr<char>(e, [](const expr& n, char* operands) -> char {
+        if (auto c = expr_cast<const_expr>(n)) {
+            return isfinite(c->value());
+        }
+        for (size_t i = 0; i < n.operand_count(); ++i) {
+            if (!operands[i]) return false;
+        }
+        return true;
+    }) != 0;
+}
+
+} // unnamed namespace
+
+expr_ptr solver::solve_for(const std::string& v, const expr& lhs, const expr& rhs) {
+    return solve(v, lhs, rhs, solve_options{}).solution;
+}
+
+solve_result solver::solve(const std::string& v, const expr& lhs, const expr& rhs, const solve_options& options) {
+    solve_task task{v, lhs, rhs, options};
+    while (!task.resume(std::numeric_limits<size_t>::max())) {
+    }
+    return std::move(task.result());
+}
+
+solve_task::solve_task(const std::string& v, const expr& lhs, const expr& rhs, const solve_options& options)
+    : v_(v)
+    , options_(options)
+    , lhs_(options.bindings.empty() ? simplify(lhs) : numeric::bind(lhs, options.bindings))
+    , rhs_(options.bindings.empty() ? simplify(rhs) : numeric::bind(rhs, options.bindings))
+    , solver_(v, options.trace, options.profile ? options.profile->penalties() : std::vector<size_t>{})
+    , numeric_(false)
+    , started_(false)
+    , searched_(false)
+    , done_(false)
+    , result_{solve_status::gave_up, nullptr, job_type{}, 0, 0, 0, {}} {
+    options_.bindings.clear();
+    auto vars = find_vars_in_expr(*lhs_);
+    const auto rhs_vars = find_vars_in_expr(*rhs_);
+    vars.insert(rhs_vars.begin(), rhs_vars.end());
+    if (options_.numeric_fallback && vars == std::set<std::string>{v_}) {
+        numeric_ = true;
+        options_.max_jobs = std::min(options_.max_jobs, options_.numeric_after_jobs);
+    }
+}
+
+bool solve_task::resume(size_t max_expand) {
+    if (done_) {
+        return true;
+    }
+    if (searched_) {
+        // The search gave up, find_root gets a slice of its own
+        const auto root = numeric::find_root(v_, *lhs_, *rhs_);
+        result_.numeric_steps = root.steps;
+        if (root.found) {
+            result_.status = solve_status::solved;
+            result_.solution = constant(root.x);
+        }
+        done_ = true;
+        return true;
+    }
+    if (!started_) {
+        // The formulas cost about as much as expanding a job, so the first
+        // slice starts searching right after them
+        if (options_.closed_form && solver::closed_form(v_, *lhs_, *rhs_, result_.roots, result_.solution)) {
+            if (result_.solution) {
+                result_.status = solve_status::solved;
+            }
+            done_ = true;
+            return true;
+        }
+        if (options_.mode != search_mode::best_first) {
+            result_ = solver_.search(v_, *lhs_, *rhs_, options_);
+            return finish();
+        }
+        solver_.items_.add(lhs_->clone(), rhs_->clone());
+        started_ = true;
+    }
+    return solver_.solve_slice(v_, options_, max_expand, result_) && finish();
+}
+
+bool solve_task::finish() {
+    if (options_.profile && started_) {
+        std::vector<uint8_t> path;
+        if (solver_.solved_) {
+            solver_.items_.derivation(*solver_.solved_, path);
+        }
+        options_.profile->record(solver_.items_.built_by_rule(), path);
+    }
+    if (!numeric_ || result_.status == solve_status::solved || result_.status == solve_status::no_solution || result_.status == solve_status::any_value || (options_.cancel && options_.cancel->cancelled()) || solve_options::clock::now() >= options_.deadline) {
+        done_ = true;
+    } else {
+        searched_ = true;
+    }
+    return done_;
+}
+
+solve_result solver::search(const std::string& v, const expr& lhs, const expr& rhs, const solve_options& options) {
+    switch (options.mode) {
+    case search_mode::best_first:
+        items_.add(lhs.clone(), rhs.clone());
+        return do_solve(v, options);
+    case search_mode::beam:
+        return do_beam_solve(v, job_type{simplify(lhs), simplify(rhs)}, options);
+    case search_mode::iterative_deepening:
+        return do_iterative_deepening_solve(v, job_type{simplify(lhs), simplify(rhs)}, options);
+    }
+    throw std::logic_error("Unknown search mode");
+}
+
+bool solver::closed_form(const std::string& v, const expr& lhs, const expr& rhs, std::vector<double>& roots, expr_ptr& smallest) {
+    std::vector<double> coefficients;
+    // Simplified first, so other variables that cancel like y*0 are gone
+    const auto difference = simplify(*(lhs.clone() - rhs.clone()));
+    if (!polynomial::coefficients(*difference, v, coefficients)
+        || coefficients.size() < 2 || coefficients.size() > polynomial::max_degree + 1) {
+        return false;
+    }
+    std::vector<rational> exact;
+    if (coefficients.size() == 2 && polynomial::exact_coefficients(*difference, v, exact) && exact.size() == 2) {
+        const auto root = -exact[0] / exact[1];
+        roots.assign(1, root.to_double());
+        smallest = constant(root);
+        return true;
+    }
+    roots = polynomial::roots(coefficients);
+    smallest = roots.empty() ? nullptr : constant(roots.front());
+    return true;
+}
+
+std::map<std::string, expr_ptr> solver::solve_all(const expr& lhs, const expr& rhs, std::ostream* trace, rule_profile* profile, solve_status* status) {
+    solver s{"", trace, profile ? profile->penalties() : std::vector<size_t>{}};
+    auto vars = find_vars_in_expr(*simplify(lhs));
+    const auto rhs_vars = find_vars_in_expr(*simplify(rhs));
+    vars.insert(rhs_vars.begin(), rhs_vars.end());
+    std::vector<double> roots;
+    expr_ptr smallest;
+    if (vars.size() == 1 && closed_form(*vars.begin(), lhs, rhs, roots, smallest)) {
+        // Like solve(), no real roots is giving up rather than a verdict
+        if (status) *status = smallest ? solve_status::solved : solve_status::gave_up;
+        if (smallest) {
+            s.solutions_[*vars.begin()] = std::move(smallest);
+        }
+        return std::move(s.solutions_);
+    }
+    s.items_.add(lhs.clone(), rhs.clone());
+    std::vector<uint8_t> path;
+    for (const auto& v : find_vars_in_expr(lhs)) {
+        s.solve_target(v, path);
+    }
+    for (const auto& v : find_vars_in_expr(rhs)) {
+        s.solve_target(v, path);
+    }
+    if (profile) {
+        profile->record(s.items_.built_by_rule(), path);
+    }
+    if (status) {
+        solve_result result{solve_status::gave_up, nullptr, job_type{}, 0, 0, 0, {}};
+        s.settled(result);
+        *status = s.solutions_.empty() ? result.status : solve_status::solved;
+    }
+    return std::move(s.solutions_);
+}
+
+std::map<std::string, expr_ptr> solver::solve_all_parallel(const expr& lhs, const expr& rhs, unsigned threads) {
+    // Shared read-only by the searches
+    const job_type initial{simplify(lhs), simplify(rhs)};
+    auto vars = find_vars_in_expr(*initial.first);
+    const auto rhs_vars = find_vars_in_expr(*initial.second);
+    vars.insert(rhs_vars.begin(), rhs_vars.end());
+    if (vars.size() <= 1) {
+        return solve_all(lhs, rhs, nullptr);
+    }
+    const std::vector<std::string> targets(vars.begin(), vars.end());
+    std::vector<std::map<std::string, expr_ptr>> found(targets.size());
+    std::atomic<size_t> next{0};
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    expr_allocator* const allocator = expr_allocator::current();
+
+    const auto work = [&] {
+        expr_allocator::scope s{allocator};
+        try {
+            for (size_t i; (i = next++) < targets.size();) {
+                solver search{targets[i], nullptr};
+                search.items_.add(initial.first->clone(), initial.second->clone());
+                search.do_solve(targets[i], solve_options{});
+                found[i] = std::move(search.solutions_);
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock{error_mutex};
+            error = std::current_exception();
+            next = targets.size();
+        }
+    };
+    if (!threads) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < std::min<size_t>(threads, targets.size()); ++i) {
+        pool.emplace_back(work);
+    }
+    work();
+    for (auto& t : pool) {
+        t.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    std::map<std::string, expr_ptr> solutions;
+    for (size_t i = 0; i < targets.size(); ++i) {
+        auto it = found[i].find(targets[i]);
+        if (it != found[i].end()) {
+            solutions[targets[i]] = std::move(it->second);
+        }
+    }
+    for (auto& f : found) {
+        for (auto& s : f) {
+            if (s.second && !solutions.count(s.first)) {
+                solutions[s.first] = std::move(s.second);
+            }
+        }
+    }
+    return solutions;
+}
+
+size_t solver::job_compare::cost(const job_type& a) const {
+    const auto& l = *a.first;
+    const auto& r = *a.second;
+    const size_t depth_cost = depth(l) + depth(r);
+    if (target_.empty()) {
+        const size_t var_cost = find_vars_in_expr(l).size() + find_vars_in_expr(r).size();
+        return depth_cost + var_cost * 100;
+    }
+    const auto lo = find_var_occurrences(l, target_);
+    const auto ro = find_var_occurrences(r, target_);
+    return cost(depth_cost, lo.count, ro.count, lo.depth_sum + ro.depth_sum);
+}
+
+namespace {
+
+// Simplified constants may be negated once, see simplify()
+bool constant_value(const expr& e, double& v) {
+    if (auto ne = expr_cast<negation_expr>(e)) {
+        if (extract_const(ne->e(), v)) {
+            v = -v;
+            return true;
+        }
+        return false;
+    }
+    return extract_const(e, v);
+}
+
+// The same for exact constants
+bool exact_constant_value(const expr& e, rational& v) {
+    const auto ne = expr_cast<negation_expr>(e);
+    const auto c = expr_cast<const_expr>(ne ? ne->e() : e);
+    if (!c || !c->exact()) {
+        return false;
+    }
+    v = ne ? -c->exact_value() : c->exact_value();
+    return true;
+}
+
+} // unnamed namespace
+
+job_verdict solver::job_compare::judge(const job_type& a, size_t& cost) const {
+    double l, r;
+    if (constant_value(*a.first, l) && constant_value(*a.second, r)) {
+        rational el, er;
+        if (exact_constant_value(*a.first, el) && exact_constant_value(*a.second, er)) {
+            return el == er ? job_verdict::identity : job_verdict::contradiction;
+        }
+        // Rewriting may have folded the constants in another order
+        return fabs(l - r) <= 1e-12 * std::max(1.0, std::max(fabs(l), fabs(r))) ? job_verdict::identity : job_verdict::contradiction;
+    }
+    if (target_.empty()) {
+        cost = this->cost(a);
+        return job_verdict::keep;
+    }
+    const auto lo = find_var_occurrences(*a.first, target_);
+    const auto ro = find_var_occurrences(*a.second, target_);
+    if (exclusive_ && !lo.count && !ro.count) {
+        return job_verdict::dead;
+    }
+    cost = job_compare::cost(depth(*a.first) + depth(*a.second), lo.count, ro.count, lo.depth_sum + ro.depth_sum);
+    return job_verdict::keep;
+}
+
+size_t solver::job_compare::cost(size_t depth_cost, size_t lhs_count, size_t rhs_count, size_t depth_sum) {
+    const size_t count = lhs_count + rhs_count;
+    if (!count) {
+        return depth_cost + 1000000;
+    }
+    const size_t both_sides = lhs_count && rhs_count ? 1 : 0;
+    return (depth_cost + depth_sum) * 10 + (count - 1) * 40 + both_sides * 100;
+}
+
+void solver::solve_target(const std::string& v, std::vector<uint8_t>& path) {
+    if (solutions_.count(v)) {
+        return;
+    }
+    items_.rekey(items_.compare().retarget(v));
+    solved_ = nullptr;
+    do_solve(v, solve_options{});
+    if (solved_) {
+        items_.derivation(*solved_, path);
+    }
+}
+
+size_t solver::fingerprint(const job_type& job) {
+    const size_t a = job.first->hash();
+    const size_t b = job.second->hash();
+    return hash_combine(std::min(a, b), std::max(a, b));
+}
+
+size_t solver::job_memory(const job_type& job) {
+    return sizeof(job_type) + (node_count(*job.first) + node_count(*job.second)) * (sizeof(bin_op_expr) + 16);
+}
+
+bool solver::limit_reached(const solve_options& options, size_t iter, size_t memory) {
+    return iter >= options.max_jobs
+        || (options.max_memory && memory >= options.max_memory)
+        || (options.cancel && options.cancel->cancelled())
+        || solve_options::clock::now() >= options.deadline;
+}
+
+bool solver::visit(const std::string& v, const job_type& job, size_t cost, solve_result& result) {
+    ++expanded_;
+    ++result.expanded;
+    const auto& lhs = *job.first;
+    const auto& rhs = *job.second;
+    if (trace_) {
+        *trace_ << ">>> " << lhs << " = " << rhs << std::endl;
+    }
+
+    if (!result.best.first || cost < best_cost_) {
+        result.best = job_type{lhs.clone(), rhs.clone()};
+        best_cost_ = cost;
+    }
+
+    if (auto var = expr_cast<var_expr>(lhs)) {
+        if (!expr_has_var(rhs, var->name()) && finite_constants(rhs)) {
+            if (trace_) *trace_ << "> " << var->name() << " = " << rhs << std::endl;
+            solutions_[var->name()] = rhs.clone();
+            if (var->name() == v) result.solution = rhs.clone();
+        }
+    }
+    if (auto var = expr_cast<var_expr>(rhs)) {
+        if (!expr_has_var(lhs, var->name()) && finite_constants(lhs)) {
+            if (trace_) *trace_ << "> " << var->name() << " = " << lhs << std::endl;
+            solutions_[var->name()] = lhs.clone();
+            if (var->name() == v) result.solution = lhs.clone();
+        }
+    }
+    if (result.solution) {
+        result.status = solve_status::solved;
+        return true;
+    }
+    return false;
+}
+
+solve_result solver::do_solve(const std::string& v, const solve_options& options) {
+    solve_result result{solve_status::gave_up, nullptr, job_type{}, 0, 0, 0, {}};
+    while (!solve_slice(v, options, std::numeric_limits<size_t>::max(), result)) {
+    }
+    return result;
+}
+
+bool solver::solve_slice(const std::string& v, const solve_options& options, size_t max_expand, solve_result& result) {
+    for (size_t n = 0; n < max_expand; ++n) {
+        if (settled(result)) {
+            return true;
+        }
+        if (limit_reached(options, result.expanded, items_.memory_usage())) {
+            result.status = solve_status::partial;
+            return true;
+        }
+        size_t cost;
+        const auto& job = items_.next(cost);
+        if (!job.first) {
+            settled(result);
+            return true;
+        }
+        assert(job.second);
+        if (visit(v, job, cost, result)) {
+            solved_ = &job;
+            return true;
+        }
+        items_.add_successors(job);
+    }
+    return false;
+}
+
+bool solver::settled(solve_result& result) const {
+    result.pruned = items_.pruned();
+    switch (items_.verdict()) {
+    case job_verdict::identity:
+        result.status = solve_status::any_value;
+        return true;
+    case job_verdict::contradiction:
+        result.status = solve_status::no_solution;
+        return true;
+    default:
+        return false;
+    }
+}
+
+std::vector<job_type> solver::expand(const job_type& job, const std::unordered_set<size_t>& visited) {
+    std::vector<rewrite_step> steps;
+    rewrite_steps(job, steps);
+    std::vector<job_type> res;
+    for (const auto step : steps) {
+        const auto s = apply_rewrite(job, step);
+        job_type j{simplify(*s.first), simplify(*s.second)};
+        if (!visited.count(fingerprint(j))) {
+            res.push_back(std::move(j));
+        }
+    }
+    return res;
+}
+
+solve_result solver::do_beam_solve(const std::string& v, job_type initial, const solve_options& options) {
+    typedef std::pair<size_t, job_type> costed_job;
+    const job_compare compare{v};
+    solve_result result{solve_status::gave_up, nullptr, job_type{}, 0, 0, 0, {}};
+    std::unordered_set<size_t> visited{fingerprint(initial)};
+    std::vector<costed_job> beam;
+    const size_t initial_cost = compare.cost(initial);
+    beam.emplace_back(initial_cost, std::move(initial));
+    size_t beam_memory = job_memory(beam.back().second);
+
+    while (!beam.empty()) {
+        std::vector<costed_job> candidates;
+        size_t candidate_memory = 0;
+        for (const auto& j : beam) {
+            if (limit_reached(options, result.expanded, beam_memory + candidate_memory + visited.size() * fingerprint_memory)) {
+                result.status = solve_status::partial;
+                return result;
+            }
+            if (visit(v, j.second, j.first, result)) {
+                return result;
+            }
+            for (auto& s : expand(j.second, visited)) {
+                // Several parents can produce the same successor
+                if (!visited.insert(fingerprint(s)).second) {
+                    continue;
+                }
+                candidate_memory += job_memory(s);
+                const size_t cost = compare.cost(s);
+                candidates.emplace_back(cost, std::move(s));
+            }
+        }
+        if (candidates.size() > options.beam_width) {
+            std::nth_element(candidates.begin(), candidates.begin() + options.beam_width, candidates.end(),
+                    [](const costed_job& a, const costed_job& b) { return a.first < b.first; });
+            candidates.resize(options.beam_width);
+        }
+        std::sort(candidates.begin(), candidates.end(),
+                [](const costed_job& a, const costed_job& b) { return a.first < b.first; });
+        beam = std::move(candidates);
+        beam_memory = 0;
+        for (const auto& j : beam) {
+            beam_memory += job_memory(j.second);
+        }
+    }
+    return result;
+}
+
+bool solver::deepening_search(deepening_state& state, const job_type& job, size_t cost, unsigned d, solve_result& result) {
+    if (limit_reached(state.options, result.expanded, state.path_memory + state.visited.size() * fingerprint_memory)) {
+        result.status = solve_status::partial;
+        return true;
+    }
+    if (visit(state.v, job, cost, result)) {
+        return true;
+    }
+    if (d == state.limit) {
+        state.cut_off = true;
+        return false;
+    }
+
+    std::vector<std::pair<size_t, job_type>> successors;
+    size_t memory = 0;
+    for (auto& s : expand(job, std::unordered_set<size_t>{})) {
+        auto it = state.visited.find(fingerprint(s));
+        if (it != state.visited.end() && it->second <= d + 1) {
+            continue;
+        }
+        state.visited[fingerprint(s)] = d + 1;
+        memory += job_memory(s);
+        const size_t c = state.compare.cost(s);
+        successors.emplace_back(c, std::move(s));
+    }
+    std::stable_sort(successors.begin(), successors.end(),
+            [](const std::pair<size_t, job_type>& a, const std::pair<size_t, job_type>& b) { return a.first < b.first; });
+
+    state.path_memory += memory;
+    for (const auto& s : successors) {
+        if (deepening_search(state, s.second, s.first, d + 1, result)) {
+            return true;
+        }
+    }
+    state.path_memory -= memory;
+    return false;
+}
+
+solve_result solver::do_iterative_deepening_solve(const std::string& v, const job_type& initial, const solve_options& options) {
+    solve_result result{solve_status::gave_up, nullptr, job_type{}, 0, 0, 0, {}};
+    deepening_state state{v, job_compare{v}, options, 0, false, job_memory(initial), {}};
+    const size_t initial_cost = state.compare.cost(initial);
+    for (; state.limit <= options.max_depth; ++state.limit) {
+        state.cut_off = false;
+        state.visited.clear();
+        state.visited[fingerprint(initial)] = 0;
+        if (deepening_search(state, initial, initial_cost, 0, result)) {
+            return result;
+        }
+        if (!state.cut_off) {
+            // Everything reachable has been explored
+            return result;
+        }
+    }
+    result.status = solve_status::partial;
+    return result;
+}
+
+namespace {
+
+// The side rewritten by step and the other one
+const expr& rewritten_side(const job_type& job, rewrite_step step) {
+    return step.side ? *job.second : *job.first;
+}
+
+const expr& other_side(const job_type& job, rewrite_step step) {
+    return step.side ? *job.first : *job.second;
+}
+
+// How the search rewrites one side of "E = B", as { E', B' }, in the order
+// successors are generated
+const rule_set& search_rules() {
+    static const rule_set rules = [] {
+        const auto a = var("a"), b = var("b"), c = var("c"), n = var("n"), x = var("x"), B = var("B");
+        rule_set r{{"B"}};
+        // Distribute * and / over + and -
+        for (char op : {'*', '/'}) {
+            for (char inner : {'+', '-'}) {
+                r.add(*do_op(op, do_op(inner, *a, *b), *c), *do_op(inner, do_op(op, *a, *c), do_op(op, *b, *c)), *B);
+            }
+        }
+        // Commute + and -
+        r.add(*(*a + *b + *c), *(*a + (*b + *c)), *B);
+        r.add(*(*a + *b - *c), *(*a + (*b - *c)), *B);
+        r.add(*(*a - *b + *c), *(*a - (*b - *c)), *B);
+        r.add(*(*a - *b - *c), *(*a - (*b + *c)), *B);
+        // Isolate either operand
+        r.add(*(*a + *b), *a, *(*B - *b));
+        r.add(*(*a + *b), *b, *(*B - *a));
+        r.add(*(*a - *b), *a, *(*B + *b));
+        r.add(*(*a - *b), *-*b, *(*B - *a));
+        r.add(*(*a * *b), *a, *(*B / *b));
+        r.add(*(*a * *b), *b, *(*B / *a));
+        r.add(*(*a / *b), *a, *(*B * *b));
+        r.add(*(*a / *b), *(constant(1) / *b), *(*B / *a));
+        r.add(*-*a, *a, *-*B);
+        // Move a leaf over
+        r.add(*n, *constant(0), *(*B - *n));
+        r.add(*x, *constant(0), *(*B - *x));
+        return r;
+    }();
+    return rules;
+}
+
+// Builds a rewritten side from copies of the parts of the job
+struct copy_builder {
+    const rule_set::bindings& b;
+    const expr&               other;
+
+    expr_ptr capture(size_t i) { return b[i].clone(); }
+    expr_ptr extra(size_t) { return other.clone(); }
+    expr_ptr constant(double v) { return ::constant(v); }
+    expr_ptr negate(expr_ptr a) { return -std::move(a); }
+    expr_ptr binary(char op, expr_ptr a, expr_ptr b) { return do_op(op, std::move(a), std::move(b)); }
+};
+
+} // unnamed namespace
+
+void rewrite_steps(const job_type& job, std::vector<rewrite_step>& out) {
+    const rule_set& rules = search_rules();
+    for (uint8_t side = 0; side < 2; ++side) {
+        for (auto m = rules.matches(side ? *job.second : *job.first); m; m &= m - 1) {
+            out.push_back(rewrite_step{side, static_cast<uint8_t>(__builtin_ctzll(m))});
+        }
+    }
+}
+
+job_type apply_rewrite(const job_type& job, rewrite_step step) {
+    const rule_set& rules = search_rules();
+    rule_set::bindings b;
+    if (!rules.bind(step.rule, rewritten_side(job, step), b)) {
+        throw std::logic_error("Rewrite doesn't apply to the job");
+    }
+    copy_builder builder{b, other_side(job, step)};
+    auto first = rules.build<expr_ptr>(step.rule, 0, builder);
+    return job_type{std::move(first), rules.build<expr_ptr>(step.rule, 1, builder)};
+}
+
+bool divides_by_variable(const job_type& job) {
+    // Per subexpression, whether it has a variable and whether it divides by one
+    struct found {
+        bool var;
+        bool divides;
+    };
+    const auto divides = [](const expr& e) {
+        return fold_expr<found>(e, [](const expr& n, found* operands) {
+            found res{expr_cast<var_expr>(n) != nullptr, false};
+            for (size_t i = 0; i < n.operand_count(); ++i) {
+                res.var |= operands[i].var;
+                res.divides |= operands[i].divides;
+            }
+            auto be = expr_cast<bin_op_expr>(n);
+            res.divides |= be && be->op() == '/' && operands[1].var;
+            return res;
+        }).divides;
+    };
+    return divides(*job.first) || divides(*job.second);
+}
+
+namespace {
+
+// What job_compare::cost looks at for one side of a job. Rewrites only add
+// a few operations on top of subtrees that are already simplified, so
+// following the simplify() rules for just those operations predicts the
+// cost of the simplified successor without building it.
+struct side_shape {
+    enum kind_type { constant_kind, variable_kind, negation_kind, other_kind };
+
+    kind_type          kind;
+    double             value; // constant_kind
+    const std::string* name;  // variable_kind
+    unsigned           depth;
+    size_t             count;     // occurrences of the target
+    size_t             depth_sum; // of those occurrences
+};
+
+side_shape shape_of(const expr& e, const std::string& target) {
+    side_shape s{side_shape::other_kind, 0, nullptr, depth(e), 0, 0};
+    if (auto c = expr_cast<const_expr>(e)) {
+        s.kind = side_shape::constant_kind;
+        s.value = c->value();
+    } else if (auto v = expr_cast<var_expr>(e)) {
+        s.kind = side_shape::variable_kind;
+        s.name = &v->name();
+    } else if (expr_cast<negation_expr>(e)) {
+        s.kind = side_shape::negation_kind;
+    }
+    const auto occ = find_var_occurrences(e, target);
+    s.count = occ.count;
+    s.depth_sum = occ.depth_sum;
+    return s;
+}
+
+side_shape constant_shape(double value) {
+    return side_shape{side_shape::constant_kind, value, nullptr, 1, 0, 0};
+}
+
+// Deepens a by one under a new node of the given kind
+side_shape wrap(side_shape::kind_type kind, const side_shape& a) {
+    return side_shape{kind, 0, nullptr, a.depth + 1, a.count, a.depth_sum + a.count};
+}
+
+side_shape negate(const side_shape& a) {
+    switch (a.kind) {
+    case side_shape::constant_kind:
+        return constant_shape(-a.value);
+    case side_shape::negation_kind: // the operand, whatever it is
+        return side_shape{side_shape::other_kind, 0, nullptr, a.depth - 1, a.count, a.depth_sum - a.count};
+    default:
+        return wrap(side_shape::negation_kind, a);
+    }
+}
+
+side_shape combine(char op, const side_shape& a, const side_shape& b) {
+    const bool a_const = a.kind == side_shape::constant_kind;
+    const bool b_const = b.kind == side_shape::constant_kind;
+    if (a_const && b_const) {
+        switch (op) {
+        case '+': return constant_shape(a.value + b.value);
+        case '-': return constant_shape(a.value - b.value);
+        case '*': return constant_shape(a.value * b.value);
+        case '/': return constant_shape(a.value / b.value);
+        }
+    }
+    if (a_const) {
+        if (a.value == 0.0 && op != '+') return op == '-' ? wrap(side_shape::negation_kind, b) : constant_shape(0);
+        if ((a.value == 0.0 && op == '+') || (a.value == 1.0 && op == '*')) return b;
+    }
+    if (b_const) {
+        if (b.value == 0.0 && op == '*') return constant_shape(0);
+        if ((b.value == 0.0 && (op == '+' || op == '-')) || (b.value == 1.0 && op == '*')) return a;
+    }
+    if (a.kind == side_shape::variable_kind && b.kind == side_shape::variable_kind && *a.name == *b.name) {
+        switch (op) {
+        case '+': return wrap(side_shape::other_kind, a); // 2 * a
+        case '-': return constant_shape(0);
+        case '/': return constant_shape(1);
+        }
+    }
+    const unsigned d = std::max(a.depth, b.depth) + 1;
+    return side_shape{side_shape::other_kind, 0, nullptr, d, a.count + b.count, a.depth_sum + a.count + b.depth_sum + b.count};
+}
+
+// Builds the shape of a rewritten side instead of the side itself
+struct shape_builder {
+    const rule_set::bindings& b;
+    const expr&               other;
+    const std::string&        target;
+
+    side_shape capture(size_t i) { return shape_of(b[i], target); }
+    side_shape extra(size_t) { return shape_of(other, target); }
+    side_shape constant(double v) { return constant_shape(v); }
+    side_shape negate(const side_shape& a) { return ::negate(a); }
+    side_shape binary(char op, const side_shape& a, const side_shape& b) { return combine(op, a, b); }
+};
+
+} // unnamed namespace
+
+size_t solver::job_compare::estimate(const job_type& parent, rewrite_step step) const {
+    if (target_.empty()) {
+        return 0; // built as soon as it reaches the front, then keyed by cost()
+    }
+    const rule_set& rules = search_rules();
+    rule_set::bindings b;
+    if (!rules.bind(step.rule, rewritten_side(parent, step), b)) {
+        throw std::logic_error("Rewrite doesn't apply to the job");
+    }
+    shape_builder builder{b, other_side(parent, step), target_};
+    const auto first = rules.build<side_shape>(step.rule, 0, builder);
+    const auto second = rules.build<side_shape>(step.rule, 1, builder);
+    return cost(first.depth + second.depth, first.count, second.count, first.depth_sum + second.depth_sum) + penalty(step.rule);
+}
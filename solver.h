@@ -0,0 +1,512 @@
+#ifndef SOLVE_SOLVER_H
+#define SOLVE_SOLVER_H
+
+#include <iostream>
+#include <map>
+#include <queue>
+#include <vector>
+#include <unordered_set>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include "expr.h"
+
+class rule_profile;
+
+////////////////////////////
+// JOB LIST
+////////////////////////////
+
+typedef std::pair<expr_ptr, expr_ptr> job_type;
+const job_type empty_job{nullptr, nullptr};
+
+// std::hash<> specialization for job_type
+namespace std {
+template<>
+struct hash<job_type> {
+    size_t operator()(const job_type& i) const {
+        return hash_combine(i.first->hash(), i.second->hash());
+    }
+};
+} // namespace std
+
+bool operator==(const job_type& a, const job_type& b);
+std::ostream& operator<<(std::ostream& os, const job_type& j);
+
+// One rewrite of one side E of an equation "E = B" by a rule of the
+// search's table (see search_rules in solver.cpp)
+struct rewrite_step {
+    uint8_t side; // 0 rewrites job.first, 1 job.second
+    uint8_t rule;
+};
+
+// The rewrites that apply to job, appended to out
+void rewrite_steps(const job_type& job, std::vector<rewrite_step>& out);
+
+// The successor of job by step, not simplified
+job_type apply_rewrite(const job_type& job, rewrite_step step);
+
+// Whether either side of job divides by something with a variable in it.
+// Isolating through such a division, or simplify() cancelling x/x, can gain
+// or lose solutions.
+bool divides_by_variable(const job_type& job);
+
+// What the pruning in front of the frontier makes of a simplified job
+enum class job_verdict {
+    keep,
+    dead,          // can't lead to the variable searched for
+    identity,      // constant and true, like 0 = 0
+    contradiction, // constant and false, like 0 = 5
+};
+
+// The frontier of a best first search. Successors are added lazily as
+// (parent, rewrite) keyed by Compare::estimate, and only built and
+// simplified when they reach the front. A built job whose cost turns out
+// higher than the next key goes back in with its real cost. As long as
+// estimates never exceed real costs, which next() asserts, jobs come out in
+// the order building every successor up front would give.
+//
+// New jobs are judged by Compare::judge, which also gives their cost. All but the ones
+// to keep are pruned. Rewrites are equivalences as long as nothing on the
+// way divides by (or multiplies through) a subexpression with a variable in
+// it, so an identity or contradiction reached without that decides the
+// whole equation: it's kept as verdict(). Otherwise the job is just dead.
+template<typename Compare>
+class job_list {
+public:
+    explicit job_list(const Compare& compare = Compare{}) : compare_(compare), seq_(0), memory_(0), added_(0), built_(0), pruned_(0), verdict_(job_verdict::keep) {}
+
+    void add(std::pair<expr_ptr, expr_ptr>&& j) {
+        add(std::move(j.first), std::move(j.second));
+    }
+    void add(expr_ptr lhs, expr_ptr rhs) {
+        assert(lhs && rhs);
+        ++added_;
+        size_t cost;
+        job_type j{std::move(lhs), std::move(rhs)};
+        const bool divides = divides_by_variable(j);
+        if (auto stored = remember(std::move(j), origin{nullptr, lazy_none, divides}, cost)) {
+            items_.push(entry{cost, seq_++, stored, lazy_none});
+        }
+    }
+
+    // Every rewrite of parent, which must be a job returned by next()
+    void add_successors(const job_type& parent) {
+        steps_.clear();
+        rewrite_steps(parent, steps_);
+        for (const auto step : steps_) {
+            ++added_;
+            memory_ += sizeof(entry);
+            items_.push(entry{compare_.estimate(parent, step), seq_++, &parent, step});
+        }
+    }
+
+    const job_type& next() {
+        size_t cost;
+        return next(cost);
+    }
+
+    const job_type& next(size_t& cost) {
+        while (!items_.empty()) {
+            entry top = items_.top();
+            items_.pop();
+            if (top.step.rule == lazy_none.rule) {
+                cost = top.cost;
+                return *top.job;
+            }
+            memory_ -= sizeof(entry);
+            ++built_;
+            if (top.step.rule >= built_by_rule_.size()) {
+                built_by_rule_.resize(top.step.rule + 1);
+            }
+            ++built_by_rule_[top.step.rule];
+            size_t built_cost;
+            auto j = remember(apply_rewrite(*top.job, top.step), origin{top.job, top.step, false}, built_cost);
+            if (!j) {
+                continue;
+            }
+            built_cost += compare_.penalty(top.step.rule);
+            assert(built_cost >= top.cost && "Compare::estimate must not exceed the built job's cost");
+            const entry built{built_cost, top.seq, j, lazy_none};
+            if (!items_.empty() && entry_greater{}(built, items_.top())) {
+                items_.push(built);
+                continue;
+            }
+            cost = built.cost;
+            return *j;
+        }
+        return empty_job;
+    }
+
+    // Approximate number of bytes held by the jobs seen so far
+    size_t memory_usage() const { return memory_; }
+
+    // Jobs added, including successors never built
+    size_t added() const { return added_; }
+    // Successors built and simplified
+    size_t built() const { return built_; }
+    // Jobs judged not worth keeping or seen before
+    size_t pruned() const { return pruned_; }
+    // The first identity or contradiction met, keep if none
+    job_verdict verdict() const { return verdict_; }
+    // Successors built per rewrite rule
+    const std::vector<size_t>& built_by_rule() const { return built_by_rule_; }
+
+    // The rules that led from the first job to j, which must be a job
+    // returned by next(), appended to out in order
+    void derivation(const job_type& j, std::vector<uint8_t>& out) const {
+        const size_t start = out.size();
+        for (auto it = old_items_.find(j); it->second.parent; it = old_items_.find(*it->second.parent)) {
+            out.push_back(it->second.step.rule);
+        }
+        std::reverse(out.begin() + start, out.end());
+    }
+
+    const Compare& compare() const { return compare_; }
+
+    // Replace the cost function and re-key the jobs still waiting in the frontier
+    void rekey(const Compare& compare) {
+        compare_ = compare;
+        std::vector<entry> entries;
+        entries.reserve(items_.size());
+        for (; !items_.empty(); items_.pop()) {
+            auto e = items_.top();
+            if (e.step.rule == lazy_none.rule) {
+                e.cost = compare_.cost(*e.job) + compare_.penalty(old_items_.find(*e.job)->second.step.rule);
+            } else {
+                e.cost = compare_.estimate(*e.job, e.step);
+            }
+            entries.push_back(e);
+        }
+        items_ = queue_type(entry_greater{}, std::move(entries));
+    }
+
+private:
+    struct entry {
+        size_t          cost;
+        size_t          seq;  // insertion order, breaks ties between equal costs
+        const job_type* job;  // the job, or the parent of a lazy successor
+        rewrite_step    step; // lazy_none unless the successor still has to be built
+    };
+    struct entry_greater {
+        bool operator()(const entry& a, const entry& b) const {
+            return a.cost != b.cost ? a.cost > b.cost : a.seq > b.seq;
+        }
+    };
+    typedef std::priority_queue<entry, std::vector<entry>, entry_greater> queue_type;
+
+    // Where a job came from, parent is null for the first ones. Only those
+    // keep whether they divided by a variable before simplify(), see sound().
+    struct origin {
+        const job_type* parent;
+        rewrite_step    step;
+        bool            divides;
+    };
+
+    static constexpr size_t node_size    = sizeof(bin_op_expr) + 16;
+    static constexpr size_t job_overhead = sizeof(job_type) + sizeof(entry) + 32;
+    static constexpr rewrite_step lazy_none{0, 0xff};
+
+    Compare                         compare_;
+    size_t                          seq_;
+    size_t                          memory_;
+    size_t                          added_;
+    size_t                          built_;
+    size_t                          pruned_;
+    job_verdict                     verdict_;
+    queue_type                      items_;
+    std::unordered_map<job_type, origin> old_items_;
+    std::vector<rewrite_step>       steps_;
+    std::vector<size_t>             built_by_rule_;
+
+    // Whether a verdict on j, as built by from and before simplify(), holds
+    // for the equation that was added. Only called for identities and
+    // contradictions, so the unsimplified jobs on the way are rebuilt.
+    bool sound(const job_type& j, origin from) const {
+        if (divides_by_variable(j)) {
+            return false;
+        }
+        while (from.parent) {
+            from = old_items_.find(*from.parent)->second;
+            if (from.parent ? divides_by_variable(apply_rewrite(*from.parent, from.step)) : from.divides) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Simplifies job and keeps it with its cost, unless it (or its mirror
+    // image) has been seen before or is judged not worth keeping
+    const job_type* remember(job_type&& j, origin from, size_t& cost) {
+        auto job = make_pair(simplify(*j.first), simplify(*j.second));
+        if (old_items_.find(job) != old_items_.end()) {
+            //std::cout << "skipping " << job << std::endl;
+            ++pruned_;
+            return nullptr;
+        }
+        std::swap(job.first, job.second);
+        if (old_items_.find(job) != old_items_.end()) {
+            //std::cout << "skipping " << job << " because of symmetry!" << std::endl;
+            ++pruned_;
+            return nullptr;
+        }
+        std::swap(job.first, job.second);
+        const auto verdict = compare_.judge(job, cost);
+        if (verdict != job_verdict::keep) {
+            ++pruned_;
+            if (verdict != job_verdict::dead && verdict_ == job_verdict::keep && sound(j, from)) {
+                verdict_ = verdict;
+            }
+            return nullptr;
+        }
+        auto res = old_items_.emplace(std::move(job), from);
+        assert(res.second && "item already found in old_items_");
+        const auto& stored = res.first->first;
+        memory_ += job_overhead + (node_count(*stored.first) + node_count(*stored.second)) * node_size;
+        return &stored;
+    }
+};
+
+template<typename Compare>
+constexpr rewrite_step job_list<Compare>::lazy_none;
+
+////////////////////////////
+// SOLVER
+////////////////////////////
+
+// Can be cancelled from any thread while a solve is running
+class cancellation_token {
+public:
+    cancellation_token() : cancelled_(false) {}
+    void cancel() { cancelled_.store(true, std::memory_order_relaxed); }
+    bool cancelled() const { return cancelled_.load(std::memory_order_relaxed); }
+private:
+    std::atomic<bool> cancelled_;
+
+    cancellation_token(const cancellation_token&) = delete;
+    cancellation_token& operator=(const cancellation_token&) = delete;
+};
+
+enum class search_mode {
+    best_first,          // expand the cheapest job, remember every job seen
+    beam,                // expand level by level, keeping only the beam_width cheapest jobs
+    iterative_deepening, // depth first with an increasing rewrite depth limit
+};
+
+struct solve_options {
+    typedef std::chrono::steady_clock clock;
+
+    solve_options() : deadline(clock::time_point::max()), max_jobs(1000), max_memory(0), cancel(nullptr), mode(search_mode::best_first), beam_width(64), max_depth(16), closed_form(true), numeric_fallback(true), numeric_after_jobs(100), trace(&std::cout), profile(nullptr) {}
+
+    clock::time_point         deadline;
+    size_t                    max_jobs;   // jobs taken from the frontier
+    size_t                    max_memory; // approximate bytes held by the search, 0 means unbounded
+    const cancellation_token* cancel;
+    search_mode               mode;
+    size_t                    beam_width; // search_mode::beam only
+    unsigned                  max_depth;  // search_mode::iterative_deepening only
+
+    // Variables with known values, substituted before solving
+    std::map<std::string, double> bindings;
+    // Solve polynomials of degree 1 to 4 in the variable with the root
+    // formulas instead of searching
+    bool                      closed_form;
+    // When the variable solved for is the only one left, give the search
+    // numeric_after_jobs jobs before looking for a root numerically
+    bool                      numeric_fallback;
+    size_t                    numeric_after_jobs;
+    // Where the search steps are written, nullptr for nowhere
+    std::ostream*             trace;
+    // Learns which rewrite rules lead to solutions and prefers those, shared
+    // by the solves of a batch. Best first search only, nullptr for none.
+    rule_profile*             profile;
+};
+
+enum class solve_status {
+    solved,  // solution holds the isolated expression
+    partial, // a limit was hit, best holds the closest form found so far
+    gave_up, // the search space was exhausted without isolating the variable
+    no_solution, // the equation reduces to a contradiction like 0 = 5
+    any_value,   // the equation reduces to an identity like 0 = 0, there's no solution expression
+};
+std::ostream& operator<<(std::ostream& os, solve_status s);
+
+struct solve_result {
+    solve_status status;
+    expr_ptr     solution;
+    job_type     best;
+    size_t       expanded;
+    size_t       pruned;        // jobs kept out of the frontier, see job_list
+    unsigned     numeric_steps; // evaluations by the numeric fallback, 0 if it wasn't used
+    std::vector<double> roots;  // all real roots, ascending, when solved in closed form; solution is the first
+};
+
+class solve_task;
+
+class solver {
+public:
+    // Solve the equation "lhs = rhs" for variable "v"
+    static expr_ptr solve_for(const std::string& v, const expr& lhs, const expr& rhs);
+
+    static solve_result solve(const std::string& v, const expr& lhs, const expr& rhs, const solve_options& options);
+
+    // Solves for every variable. A polynomial in a single variable has one
+    // entry, its smallest real root; solve() gives all of them in
+    // solve_result::roots.
+    // The search learns from and is guided by profile, unless it's null.
+    // status, unless it's null, gets solved if there are solutions and
+    // otherwise no_solution, any_value or gave_up.
+    static std::map<std::string, expr_ptr> solve_all(const expr& lhs, const expr& rhs, std::ostream* trace = &std::cout, rule_profile* profile = nullptr, solve_status* status = nullptr);
+
+    // Like solve_all, but each distinct variable gets its own search and the
+    // searches run on up to threads threads (0 for one per core). A variable
+    // is solved by its own search if that isolates it, otherwise by the first
+    // search (in variable order) that happened to. Nothing is traced.
+    static std::map<std::string, expr_ptr> solve_all_parallel(const expr& lhs, const expr& rhs, unsigned threads = 0);
+
+    // Number of jobs taken from the frontier so far
+    size_t expanded() const { return expanded_; }
+
+private:
+    friend class solve_task;
+
+    // A search for a target prunes the jobs without it
+    explicit solver(const std::string& target = "", std::ostream* trace = &std::cout, const std::vector<size_t>& penalties = {})
+        : items_(job_compare{target, !target.empty(), penalties}), expanded_(0), best_cost_(0), trace_(trace), solved_(nullptr) {}
+
+    struct job_compare {
+        // An exclusive compare judges the jobs without the target dead,
+        // otherwise they're kept for the other variables. penalties are added
+        // to the cost of the jobs each rewrite rule builds.
+        explicit job_compare(const std::string& target = "", bool exclusive = false, const std::vector<size_t>& penalties = {})
+            : target_(target), exclusive_(exclusive), penalties_(penalties) {}
+
+        // Without a target prefer shallow equations with few variables. With
+        // a target estimate the distance to "target = <expr without target>":
+        // every level the target is buried, every extra occurrence and having
+        // it on both sides costs rewrites. States without the target can never
+        // produce it and go to the back of the queue.
+        size_t cost(const job_type& a) const;
+
+        // cost() of the simplified successor of parent by step, predicted
+        // without building it
+        size_t estimate(const job_type& parent, rewrite_step step) const;
+
+        static size_t cost(size_t depth_cost, size_t lhs_count, size_t rhs_count, size_t depth_sum);
+
+        // Whether to keep a, and if so its cost()
+        job_verdict judge(const job_type& a, size_t& cost) const;
+
+        size_t penalty(uint8_t rule) const { return rule < penalties_.size() ? penalties_[rule] : 0; }
+
+        // The same penalties, for a search of the jobs seen so far for target
+        job_compare retarget(const std::string& target) const { return job_compare{target, false, penalties_}; }
+
+    private:
+        std::string         target_;
+        bool                exclusive_;
+        std::vector<size_t> penalties_;
+    };
+
+    job_list<job_compare>           items_;
+    std::map<std::string, expr_ptr> solutions_;
+    size_t                          expanded_;
+    size_t                          best_cost_; // cost of solve_result::best
+    std::ostream*                   trace_;
+    const job_type*                 solved_;    // the job the best first search isolated the variable in
+
+    // Re-key the frontier for v, unless an earlier search already isolated
+    // it. The rules that led to the solution found are appended to path.
+    void solve_target(const std::string& v, std::vector<uint8_t>& path);
+
+    // Fingerprint used by the memory bounded modes instead of keeping whole
+    // jobs around. Symmetric since "l = r" and "r = l" are the same equation.
+    static size_t fingerprint(const job_type& job);
+    static size_t job_memory(const job_type& job);
+    static constexpr size_t fingerprint_memory = sizeof(size_t) * 4;
+
+    static bool limit_reached(const solve_options& options, size_t iter, size_t memory);
+
+    // Take job into account for result, returns true if it isolates v
+    bool visit(const std::string& v, const job_type& job, size_t cost, solve_result& result);
+
+    // solve for v
+    solve_result do_solve(const std::string& v, const solve_options& options);
+
+    // Takes up to max_expand more jobs of the best first search for v into
+    // result, returns true once the search has finished
+    bool solve_slice(const std::string& v, const solve_options& options, size_t max_expand, solve_result& result);
+
+    // Records the pruning so far in result, true if it decided the equation
+    bool settled(solve_result& result) const;
+
+    // Simplified successors of job not already in visited
+    static std::vector<job_type> expand(const job_type& job, const std::unordered_set<size_t>& visited);
+
+    solve_result do_beam_solve(const std::string& v, job_type initial, const solve_options& options);
+
+    struct deepening_state {
+        const std::string&                   v;
+        const job_compare                    compare;
+        const solve_options&                 options;
+        unsigned                             limit;
+        bool                                 cut_off; // some job was left unexpanded because of limit
+        size_t                               path_memory;
+        std::unordered_map<size_t, unsigned> visited; // fingerprint -> shallowest depth seen at
+    };
+
+    // Returns true when the search should stop (solved or a limit was hit)
+    bool deepening_search(deepening_state& state, const job_type& job, size_t cost, unsigned d, solve_result& result);
+    solve_result do_iterative_deepening_solve(const std::string& v, const job_type& initial, const solve_options& options);
+
+    // Real roots of "lhs = rhs" if it's a polynomial of degree 1 to 4 in v
+    // with constant coefficients. smallest is the first root as a constant,
+    // exact for a linear equation with exact coefficients, or null if there
+    // are no real roots.
+    static bool closed_form(const std::string& v, const expr& lhs, const expr& rhs, std::vector<double>& roots, expr_ptr& smallest);
+
+    // Rewrite search using the mode in options
+    solve_result search(const std::string& v, const expr& lhs, const expr& rhs, const solve_options& options);
+
+};
+
+// solver::solve split into slices of a few expanded jobs, so many solves
+// can take turns on one thread. Only the best first search yields, the
+// other modes run to completion on the first resume. The closed form runs
+// at the start of the first slice, and the numeric fallback takes one slice
+// of its own after the search, bounded by numeric::find_root's steps
+// rather than by max_expand.
+class solve_task {
+public:
+    solve_task(const std::string& v, const expr& lhs, const expr& rhs, const solve_options& options);
+
+    // Runs until max_expand more jobs have been expanded, the search ends
+    // or the solve is finished, returns done()
+    bool resume(size_t max_expand);
+
+    bool done() const { return done_; }
+    const std::string& variable() const { return v_; }
+    const solve_options& options() const { return options_; }
+    size_t expanded() const { return result_.expanded; }
+
+    // The outcome once done
+    solve_result& result() { return result_; }
+
+private:
+    std::string    v_;
+    solve_options  options_;
+    expr_ptr       lhs_;      // simplified, with the bindings substituted
+    expr_ptr       rhs_;
+    solver         solver_;
+    bool           numeric_;  // look for a root numerically if the search fails
+    bool           started_;
+    bool           searched_; // only the numeric fallback is left
+    bool           done_;
+    solve_result   result_;
+
+    // After the search, returns done()
+    bool finish();
+};
+
+#endif
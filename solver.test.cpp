@@ -0,0 +1,307 @@
+#include "solver.h"
+#include "numeric.h"
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <math.h>
+#include <assert.h>
+
+namespace {
+
+void test_solve(const expr_ptr& lhs, const expr_ptr& rhs, const std::string& v, const expr_ptr& expected) {
+    auto s = solver::solve_for(v, *lhs, *rhs);
+    if (!s) {
+        std::cout << "Unable to solve '" << lhs << "'='" << rhs << "' for '" << v << "'" << std::endl;
+        assert(false);
+    }
+    if (expected->equal(*s)) {
+        std::cout << "OK: " << lhs << "=" << rhs << " ==> " << v << "=" << *s << std::endl;
+        return;
+    }
+
+    std::cout << "Wrong answer for '" << lhs << "'='" << rhs << "' for '" << v << "'\n";
+    std::cout << "Expected: " << expected << std::endl;
+    std::cout << "Got: '" << s << "'" << std::endl;
+    assert(false);
+}
+
+void test_solve_status(const expr_ptr& lhs, const expr_ptr& rhs, const std::string& v, const solve_options& options, solve_status expected, const job_type& expected_best)
+{
+    auto r = solver::solve(v, *lhs, *rhs, options);
+    bool ok = r.status == expected && !r.solution == (expected != solve_status::solved);
+    if (ok && expected_best.first) {
+        ok = r.best.first && r.best == expected_best;
+    }
+    if (ok) {
+        return;
+    }
+    std::cout << "Wrong result for '" << lhs << "'='" << rhs << "' for '" << v << "'\n";
+    std::cout << "Expected: " << expected << std::endl;
+    std::cout << "Got: " << r.status << " after " << r.expanded << " jobs" << std::endl;
+    if (r.best.first) {
+        std::cout << "Best: " << r.best << std::endl;
+    }
+    assert(false);
+}
+
+void solve_test()
+{
+    test_solve(var("x"), constant(8), "x", constant(8));
+    test_solve(constant(42), var("x"), "x", constant(42));
+    test_solve(constant(2) * var("x"), constant(8), "x", constant(4));
+    test_solve(constant(3) + constant(60) / var("zz"), constant(6), "zz", constant(20));
+    test_solve(-(-constant(3)), var("x"), "x", constant(3));
+    test_solve(var("x") * constant(4), var("y"), "x", var("y") / constant(4));
+    test_solve(var("x") * constant(4) + constant(10), var("y"), "x", (var("y")-constant(10)) / constant(4));
+
+    test_solve(var("x") * constant(2), var("x") - constant(1), "x", constant(-1));
+    test_solve(var("a") * var("b") + var("c") * var("d") - var("e") / var("f"), var("g") + var("h") * var("i"), "c",
+            (((var("g") + var("h") * var("i")) + var("e") / var("f")) - var("a") * var("b")) / var("d"));
+}
+
+void solve_limits_test()
+{
+    const auto lhs = var("x") * constant(4) + constant(10);
+    const auto rhs = var("y");
+    solve_options options;
+    test_solve_status(lhs, rhs, "x", options, solve_status::solved, empty_job);
+
+    options.max_jobs = 2;
+    test_solve_status(lhs, rhs, "x", options, solve_status::partial, job_type{var("x") * constant(4), var("y") - constant(10)});
+
+    cancellation_token cancel;
+    cancel.cancel();
+    options = solve_options{};
+    options.cancel = &cancel;
+    test_solve_status(lhs, rhs, "x", options, solve_status::partial, empty_job);
+
+    options = solve_options{};
+    options.deadline = solve_options::clock::now();
+    test_solve_status(lhs, rhs, "x", options, solve_status::partial, empty_job);
+
+    options = solve_options{};
+    options.max_memory = 1;
+    test_solve_status(lhs, rhs, "x", options, solve_status::partial, empty_job);
+
+    test_solve_status(var("x"), constant(2), "z", solve_options{}, solve_status::gave_up, empty_job);
+}
+
+void test_solve_mode(search_mode mode, const expr_ptr& lhs, const expr_ptr& rhs, const std::string& v, const expr_ptr& expected)
+{
+    solve_options options;
+    options.mode = mode;
+    options.beam_width = 8;
+    options.closed_form = false;
+    options.numeric_fallback = false;
+    auto r = solver::solve(v, *lhs, *rhs, options);
+    if (r.status == solve_status::solved && r.solution->equal(*expected)) {
+        return;
+    }
+    std::cout << "Search mode " << static_cast<int>(mode) << " failed for '" << lhs << "'='" << rhs << "' for '" << v << "'\n";
+    std::cout << "Expected: " << expected << std::endl;
+    std::cout << "Got: " << r.status;
+    if (r.solution) std::cout << " " << r.solution;
+    std::cout << std::endl;
+    assert(false);
+}
+
+void search_mode_test()
+{
+    for (auto mode : { search_mode::beam, search_mode::iterative_deepening }) {
+        test_solve_mode(mode, var("x"), constant(8), "x", constant(8));
+        test_solve_mode(mode, constant(3) + constant(60) / var("zz"), constant(6), "zz", constant(20));
+        test_solve_mode(mode, var("x") * constant(4) + constant(10), var("y"), "x", (var("y")-constant(10)) / constant(4));
+        test_solve_mode(mode, var("x") * constant(2), var("x") - constant(1), "x", constant(-1));
+    }
+
+    // A tight memory budget stops the search instead of growing without bound
+    solve_options options;
+    options.mode = search_mode::iterative_deepening;
+    options.max_memory = 4096;
+    options.max_jobs = std::numeric_limits<size_t>::max();
+    test_solve_status(var("x") * var("x"), var("y"), "x", options, solve_status::partial, empty_job);
+}
+
+void numeric_fallback_test()
+{
+    // No rewrite isolates x, after the search gives up a few Newton steps do
+    const auto lhs = (var("x") * var("x") + constant(1)) / (var("x") + constant(3));
+    auto r = solver::solve("x", *lhs, *constant(5), solve_options{});
+    assert(r.status == solve_status::solved && r.numeric_steps > 0);
+    assert(r.expanded <= solve_options{}.numeric_after_jobs && r.numeric_steps < 50);
+    auto c = expr_cast<const_expr>(*r.solution);
+    assert(c && (fabs(c->value() - 7) < 1e-9 || fabs(c->value() + 2) < 1e-9));
+
+    // Other variables bound to constants
+    solve_options options;
+    options.bindings["y"] = 2;
+    r = solver::solve("x", *(var("x") * var("y") + var("y") * var("x") * var("x")), *constant(10), options);
+    c = expr_cast<const_expr>(*r.solution);
+    assert(r.status == solve_status::solved && c);
+    assert(fabs(c->value() * c->value() + c->value() - 5) < 1e-9);
+
+    // Unbound variables leave it to the search alone
+    options = solve_options{};
+    options.max_jobs = 50;
+    r = solver::solve("x", *lhs, *var("y"), options);
+    assert(r.status != solve_status::solved && r.numeric_steps == 0);
+
+    options = solve_options{};
+    options.numeric_fallback = false;
+    r = solver::solve("x", *lhs, *constant(5), options);
+    assert(r.status != solve_status::solved && r.numeric_steps == 0);
+}
+
+void closed_form_test()
+{
+    // Degree 2 is out of reach of the rewrites
+    auto r = solver::solve("x", *(var("x") * var("x") - constant(4)), *constant(0), solve_options{});
+    assert(r.status == solve_status::solved && r.expanded == 0);
+    assert(r.roots == std::vector<double>({-2, 2}) && r.solution->equal(*constant(-2)));
+
+    r = solver::solve("x", *(var("x") * var("x")), *constant(-1), solve_options{});
+    assert(r.status == solve_status::gave_up && r.roots.empty() && !r.solution);
+
+    solve_options options;
+    options.bindings["a"] = 3;
+    r = solver::solve("x", *(var("x") * var("x") * var("x") - var("a") * var("x") * var("x")), *constant(0), options);
+    assert(r.status == solve_status::solved && r.roots == std::vector<double>({0, 3}));
+
+    // The x^2 term that's left of 0.1*3 - 0.3 mustn't make this a quadratic
+    const auto x2 = var("x") * var("x");
+    r = solver::solve("x", *(x2->clone() * constant(0.1) * constant(3) - x2->clone() * constant(0.3) + var("x")), *constant(2), solve_options{});
+    assert(r.status == solve_status::solved && r.roots.size() == 1 && fabs(r.roots[0] - 2) <= 1e-12);
+
+    // Terms that are merely small or large are no noise
+    solve_options quiet;
+    quiet.trace = nullptr;
+    r = solver::solve("x", *x2, *constant(1e13), quiet);
+    assert(r.status == solve_status::solved && r.roots.size() == 2 && fabs(r.roots[1] - sqrt(1e13)) <= 1e-9 * sqrt(1e13));
+    r = solver::solve("x", *(x2->clone() * constant(0.000000000001) + var("x") * constant(1000)), *constant(0), quiet);
+    assert(r.status == solve_status::solved && r.roots.size() == 2 && fabs(r.roots[0] + 1e15) <= 1 && r.roots[1] == 0);
+    // Nor is 0*inf a zero
+    r = solver::solve("x", *(var("x") + constant(0) * (constant(1) / constant(0))), *constant(1), quiet);
+    assert(r.status != solve_status::solved && r.roots.empty() && !r.solution);
+
+    // Linear equations with exact coefficients have exact roots, and no -0
+    r = solver::solve("x", *(var("x") * constant(3)), *constant(1), solve_options{});
+    auto c = expr_cast<const_expr>(*r.solution);
+    assert(r.status == solve_status::solved && c && c->exact() && c->exact_value() == rational(1, 3));
+    assert(r.roots == std::vector<double>({1.0 / 3}));
+    for (const auto& slope : { constant(2), constant(0.1) }) {
+        r = solver::solve("x", *(var("x") * slope->clone()), *var("x"), solve_options{});
+        c = expr_cast<const_expr>(*r.solution);
+        assert(r.status == solve_status::solved && c && c->value() == 0 && !signbit(c->value()));
+        std::ostringstream os;
+        os << r.solution;
+        assert(os.str() == "0");
+    }
+
+    // Only the smallest root, see solver::solve_all
+    const auto solutions = solver::solve_all(*(var("x") * var("x")), *(constant(2) * var("x") + constant(3)));
+    assert(solutions.size() == 1 && solutions.at("x")->equal(*constant(-1)));
+}
+
+// Each solution must satisfy lhs = rhs for some values of the other variables
+void check_solutions(const expr& lhs, const expr& rhs, const std::map<std::string, expr_ptr>& solutions)
+{
+    for (const auto& s : solutions) {
+        std::map<std::string, double> values;
+        double x = 2;
+        for (const auto* side : { &lhs, &rhs }) {
+            for (const auto& v : find_vars_in_expr(*side)) {
+                if (v != s.first) values[v] = x++;
+            }
+        }
+        const auto bound = numeric::bind(*s.second, values);
+        auto value = expr_cast<const_expr>(*bound);
+        assert(value);
+        values[s.first] = value->value();
+        const auto bound_lhs = numeric::bind(lhs, values);
+        const auto bound_rhs = numeric::bind(rhs, values);
+        auto l = expr_cast<const_expr>(*bound_lhs);
+        auto r = expr_cast<const_expr>(*bound_rhs);
+        assert(l && r && fabs(l->value() - r->value()) <= 1e-9 * std::max(1.0, fabs(l->value())));
+    }
+}
+
+void pruning_test()
+{
+    solve_options options;
+    options.trace = nullptr;
+    auto r = solver::solve("x", *(var("x") * constant(0)), *constant(5), options);
+    assert(r.status == solve_status::no_solution && !r.solution && r.expanded == 0 && r.numeric_steps == 0);
+    r = solver::solve("x", *(var("x") - var("x")), *constant(0), options);
+    assert(r.status == solve_status::any_value && !r.solution && r.expanded == 0);
+
+    // Only found out by searching
+    options.numeric_fallback = false;
+    r = solver::solve("x", *(var("x") + constant(1)), *(var("x") + constant(2)), options);
+    assert(r.status == solve_status::no_solution && r.expanded > 0 && r.pruned > 0);
+    r = solver::solve("x", *var("x"), *var("x"), options);
+    assert(r.status == solve_status::any_value && r.expanded == 1);
+
+    // Without the variable there's nothing to search
+    r = solver::solve("z", *(var("x") + constant(1)), *var("y"), options);
+    assert(r.status == solve_status::gave_up && r.expanded == 0 && r.pruned == 1);
+
+    // x*2 = x isn't a contradiction because isolating x*2 as 2 = x/x divides
+    // by x, which is 0 in the solution
+    const auto x2 = var("x") * constant(2);
+    const auto x_y0 = var("x") + var("y") * constant(0);
+    r = solver::solve("x", *x2, *x_y0, solve_options{});
+    assert(r.status == solve_status::solved && r.solution->equal(*constant(0)));
+    solve_status status;
+    const auto all = solver::solve_all(*x2, *x_y0, nullptr, nullptr, &status);
+    assert(all.size() == 1 && all.at("x")->equal(*constant(0)) && status == solve_status::solved);
+
+    // solve_all says why it has nothing
+    assert(solver::solve_all(*(var("x") + constant(1)), *var("x"), nullptr, nullptr, &status).empty() && status == solve_status::no_solution);
+    assert(solver::solve_all(*var("x"), *var("x"), nullptr, nullptr, &status).empty() && status == solve_status::any_value);
+    assert(solver::solve_all(*(var("x") * var("x")), *constant(-1), nullptr, nullptr, &status).empty() && status == solve_status::gave_up);
+    options = solve_options{};
+    options.trace = nullptr;
+    options.closed_form = false;
+    for (const auto& rhs : { var("x"), var("x") + var("y") * constant(0) }) {
+        for (const auto& lhs : { var("x") * constant(2), var("x") + var("x") }) {
+            r = solver::solve("x", *lhs, *rhs, options);
+            assert(r.status == solve_status::solved && r.solution->equal(*constant(0)));
+        }
+    }
+    options.numeric_fallback = false;
+    r = solver::solve("x", *x2, *var("x"), options);
+    assert(r.status != solve_status::no_solution && r.status != solve_status::any_value);
+}
+
+void solve_all_parallel_test()
+{
+    const auto lhs = var("a") * var("b") + var("c") * var("d") - var("e") / var("f");
+    const auto rhs = var("g") + var("h") * var("i");
+    const auto solutions = solver::solve_all_parallel(*lhs, *rhs, 4);
+    assert(solutions.size() == 9);
+    check_solutions(*lhs, *rhs, solutions);
+
+    // The same whatever the number of threads
+    const auto one = solver::solve_all_parallel(*lhs, *rhs, 1);
+    assert(one.size() == solutions.size());
+    for (const auto& s : one) {
+        assert(solutions.at(s.first)->equal(*s.second));
+    }
+
+    // One variable still goes to the closed form
+    const auto single = solver::solve_all_parallel(*(var("x") * var("x")), *(constant(2) * var("x") + constant(3)));
+    assert(single.size() == 1 && single.at("x")->equal(*constant(-1)));
+}
+
+} // unnamed namespace
+
+void solver_test()
+{
+    solve_test();
+    solve_limits_test();
+    search_mode_test();
+    numeric_fallback_test();
+    closed_form_test();
+    pruning_test();
+    solve_all_parallel_test();
+}
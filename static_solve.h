@@ -0,0 +1,226 @@
+#ifndef SOLVE_STATIC_SOLVE_H
+#define SOLVE_STATIC_SOLVE_H
+
+#include <string>
+#include <type_traits>
+#include <utility>
+#include "expr.h"
+
+// Equations that are fixed in C++ code, solved by the compiler. constant(),
+// var<>() and the operators mirror the runtime ones but build literal
+// types, so isolating a variable that occurs once and folding constants
+// happen in constexpr context and the solution's type is the solved
+// expression. Evaluating it neither solves nor allocates:
+//
+//   constexpr auto x = static_solve::var<'x'>();
+//   constexpr auto y = static_solve::var<'y'>();
+//   constexpr auto s = static_solve::solve(x, x * static_solve::constant(4) + static_solve::constant(10), y);
+//   // s is ((y - 10) / 4), s.eval(y.is(50)) == 10
+//
+// Like the parser, and unlike the runtime operators, an operation on two
+// constants folds right away. to_expr() hands an expression to the rest of
+// the library.
+namespace static_solve {
+
+struct node {};
+
+template<typename E>
+struct is_node : std::is_base_of<node, E> {};
+
+// The value of variable V in eval(), see variable::is
+template<typename V>
+struct binding {
+    double value;
+};
+
+template<typename V, typename... Rest>
+constexpr double lookup(binding<V> b, Rest...) { return b.value; }
+
+template<typename V, typename B, typename... Rest>
+constexpr double lookup(B, Rest... rest) { return lookup<V>(rest...); }
+
+constexpr double apply(char op, double a, double b) {
+    return op == '+' ? a + b : op == '-' ? a - b : op == '*' ? a * b : a / b;
+}
+
+struct number : node {
+    double value;
+
+    constexpr explicit number(double v) : value(v) {}
+    template<typename... B>
+    constexpr double eval(B...) const { return value; }
+    expr_ptr to_expr() const { return ::constant(value); }
+};
+
+// A variable is named by its type, e.g. variable<'z', 'z'> is zz
+template<char... Name>
+struct variable : node {
+    constexpr variable() {}
+    constexpr binding<variable> is(double v) const { return binding<variable>{v}; }
+    // Doesn't compile unless b binds this variable
+    template<typename... B>
+    constexpr double eval(B... b) const { return lookup<variable>(b...); }
+    static std::string name() { return std::string{Name...}; }
+    expr_ptr to_expr() const { return ::var(name()); }
+};
+
+template<typename E>
+struct negation : node {
+    E operand;
+
+    constexpr explicit negation(E e) : operand(e) {}
+    template<typename... B>
+    constexpr double eval(B... b) const { return -operand.eval(b...); }
+    expr_ptr to_expr() const { return -operand.to_expr(); }
+};
+
+template<char Op, typename L, typename R>
+struct binary : node {
+    L lhs;
+    R rhs;
+
+    constexpr binary(L l, R r) : lhs(l), rhs(r) {}
+    template<typename... B>
+    constexpr double eval(B... b) const { return apply(Op, lhs.eval(b...), rhs.eval(b...)); }
+    expr_ptr to_expr() const { return do_op(Op, lhs.to_expr(), rhs.to_expr()); }
+};
+
+constexpr number constant(double v) { return number{v}; }
+
+template<char... Name>
+constexpr variable<Name...> var() { return variable<Name...>{}; }
+
+template<char Op, typename L, typename R>
+constexpr binary<Op, L, R> make(L l, R r) { return binary<Op, L, R>{l, r}; }
+
+template<char Op>
+constexpr number make(number l, number r) { return number{apply(Op, l.value, r.value)}; }
+
+template<typename E, typename = typename std::enable_if<is_node<E>::value>::type>
+constexpr negation<E> operator-(E e) { return negation<E>{e}; }
+
+constexpr number operator-(number n) { return number{-n.value}; }
+
+template<typename L, typename R>
+struct both_nodes : std::enable_if<is_node<L>::value && is_node<R>::value> {};
+
+template<typename L, typename R, typename = typename both_nodes<L, R>::type>
+constexpr auto operator+(L l, R r) -> decltype(make<'+'>(l, r)) { return make<'+'>(l, r); }
+
+template<typename L, typename R, typename = typename both_nodes<L, R>::type>
+constexpr auto operator-(L l, R r) -> decltype(make<'-'>(l, r)) { return make<'-'>(l, r); }
+
+template<typename L, typename R, typename = typename both_nodes<L, R>::type>
+constexpr auto operator*(L l, R r) -> decltype(make<'*'>(l, r)) { return make<'*'>(l, r); }
+
+template<typename L, typename R, typename = typename both_nodes<L, R>::type>
+constexpr auto operator/(L l, R r) -> decltype(make<'/'>(l, r)) { return make<'/'>(l, r); }
+
+////////////////////////////
+// SOLVING
+////////////////////////////
+
+template<typename V, typename E>
+struct occurrences : std::integral_constant<size_t, 0> {};
+
+template<typename V>
+struct occurrences<V, V> : std::integral_constant<size_t, 1> {};
+
+template<typename V, typename E>
+struct occurrences<V, negation<E>> : occurrences<V, E> {};
+
+template<typename V, char Op, typename L, typename R>
+struct occurrences<V, binary<Op, L, R>> : std::integral_constant<size_t, occurrences<V, L>::value + occurrences<V, R>::value> {};
+
+// Solves a op b = r for a (lhs) or for b (rhs)
+template<char Op>
+struct undo;
+
+template<>
+struct undo<'+'> {
+    template<typename R, typename B> static constexpr auto lhs(R r, B b) -> decltype(r - b) { return r - b; }
+    template<typename R, typename A> static constexpr auto rhs(R r, A a) -> decltype(r - a) { return r - a; }
+};
+
+template<>
+struct undo<'-'> {
+    template<typename R, typename B> static constexpr auto lhs(R r, B b) -> decltype(r + b) { return r + b; }
+    template<typename R, typename A> static constexpr auto rhs(R r, A a) -> decltype(a - r) { return a - r; }
+};
+
+template<>
+struct undo<'*'> {
+    template<typename R, typename B> static constexpr auto lhs(R r, B b) -> decltype(r / b) { return r / b; }
+    template<typename R, typename A> static constexpr auto rhs(R r, A a) -> decltype(r / a) { return r / a; }
+};
+
+template<>
+struct undo<'/'> {
+    template<typename R, typename B> static constexpr auto lhs(R r, B b) -> decltype(r * b) { return r * b; }
+    template<typename R, typename A> static constexpr auto rhs(R r, A a) -> decltype(a / r) { return a / r; }
+};
+
+// Isolates V, which occurs once in E, from e = r
+template<typename V, typename E>
+struct isolate;
+
+template<typename V>
+struct isolate<V, V> {
+    template<typename R>
+    static constexpr R solve(V, R r) { return r; }
+};
+
+template<typename V, typename E>
+struct isolate<V, negation<E>> {
+    template<typename R>
+    static constexpr auto solve(negation<E> e, R r) -> decltype(isolate<V, E>::solve(e.operand, -r)) {
+        return isolate<V, E>::solve(e.operand, -r);
+    }
+};
+
+// Only the side V is in gets instantiated
+template<typename V, char Op, typename L, typename R, bool InLhs = occurrences<V, L>::value != 0>
+struct isolate_binary {
+    template<typename Rhs>
+    static constexpr auto solve(binary<Op, L, R> e, Rhs r) -> decltype(isolate<V, L>::solve(e.lhs, undo<Op>::lhs(r, e.rhs))) {
+        return isolate<V, L>::solve(e.lhs, undo<Op>::lhs(r, e.rhs));
+    }
+};
+
+template<typename V, char Op, typename L, typename R>
+struct isolate_binary<V, Op, L, R, false> {
+    template<typename Rhs>
+    static constexpr auto solve(binary<Op, L, R> e, Rhs r) -> decltype(isolate<V, R>::solve(e.rhs, undo<Op>::rhs(r, e.lhs))) {
+        return isolate<V, R>::solve(e.rhs, undo<Op>::rhs(r, e.lhs));
+    }
+};
+
+template<typename V, char Op, typename L, typename R>
+struct isolate<V, binary<Op, L, R>> : isolate_binary<V, Op, L, R> {};
+
+template<typename V, typename L, typename R, bool InLhs = occurrences<V, L>::value != 0>
+struct isolate_equation {
+    static constexpr auto solve(L lhs, R rhs) -> decltype(isolate<V, L>::solve(lhs, rhs)) { return isolate<V, L>::solve(lhs, rhs); }
+};
+
+template<typename V, typename L, typename R>
+struct isolate_equation<V, L, R, false> {
+    static constexpr auto solve(L lhs, R rhs) -> decltype(isolate<V, R>::solve(rhs, lhs)) { return isolate<V, R>::solve(rhs, lhs); }
+};
+
+// The type of V's solution to lhs = rhs
+template<typename V, typename L, typename R>
+struct solution {
+    static_assert(occurrences<V, L>::value + occurrences<V, R>::value == 1,
+            "static_solve only isolates a variable that occurs exactly once, use solver::solve for the others");
+    typedef decltype(isolate_equation<V, L, R>::solve(std::declval<L>(), std::declval<R>())) type;
+};
+
+template<typename V, typename L, typename R>
+constexpr typename solution<V, L, R>::type solve(V, L lhs, R rhs) {
+    return isolate_equation<V, L, R>::solve(lhs, rhs);
+}
+
+} // namespace static_solve
+
+#endif
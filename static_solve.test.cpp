@@ -0,0 +1,78 @@
+#include "static_solve.h"
+#include "eval.h"
+#include "solver.h"
+#include <sstream>
+#include <assert.h>
+
+namespace {
+
+using namespace static_solve;
+// Rather than the runtime ones
+using static_solve::constant;
+using static_solve::var;
+
+constexpr auto x = var<'x'>();
+constexpr auto y = var<'y'>();
+constexpr auto zz = var<'z', 'z'>();
+
+// Everything here is checked by the compiler
+constexpr auto linear = solve(x, x * constant(4) + constant(10), y);
+static_assert(std::is_same<decltype(linear), const binary<'/', binary<'-', variable<'y'>, number>, number>>::value,
+        "x * 4 + 10 = y solves to (y - 10) / 4");
+static_assert(linear.eval(y.is(50)) == 10, "Solutions evaluate in constant expressions");
+
+// Constants fold as the solution is built, so this is just a number
+constexpr auto folded = solve(x, x * constant(42) + constant(300), constant(0) - constant(200));
+static_assert(std::is_same<decltype(folded), const number>::value && folded.value == -500.0 / 42, "X*42+300=0-200");
+
+// The variable can be on either side and under negations and divisions
+constexpr auto inverse = solve(zz, constant(6), constant(3) + constant(60) / zz);
+static_assert(inverse.value == 20, "(3 + (60 / zz))=6");
+constexpr auto negated = solve(x, y, -(constant(2) - x) / zz);
+static_assert(negated.eval(zz.is(4), y.is(3)) == 14, "Bindings can come in any order");
+
+static_assert(occurrences<variable<'x'>, decltype(x * x - y)>::value == 2, "");
+static_assert(occurrences<variable<'x'>, decltype(zz * y)>::value == 0, "");
+
+std::string str(const expr_ptr& e) {
+    std::ostringstream os;
+    os << e;
+    return os.str();
+}
+
+// The compile time solution is the one the runtime solver finds
+template<typename V, typename L, typename R>
+void test_same_as_runtime(V v, L lhs, R rhs, const std::vector<std::string>& inputs, const std::vector<double>& values) {
+    solve_options options;
+    options.trace = nullptr;
+    const auto runtime = solver::solve(V::name(), *lhs.to_expr(), *rhs.to_expr(), options);
+    assert(runtime.status == solve_status::solved);
+    const auto solved = solve(v, lhs, rhs);
+    const eval::program p{*solved.to_expr(), inputs};
+    const eval::program q{*runtime.solution, inputs};
+    assert(p(values.data()) == q(values.data()));
+}
+
+void test_runtime() {
+    assert(str(linear.to_expr()) == "((y - 10) / 4)");
+    assert(str(folded.to_expr()) == str(constant(-500.0 / 42).to_expr()));
+    assert(str(negated.to_expr()) == "(2 - -((y * zz)))");
+
+    // Not everything needs to be a constant expression
+    double ys[] = { 1, 2, 3 };
+    double sum = 0;
+    for (double v : ys) {
+        sum += linear.eval(y.is(v));
+    }
+    assert(sum == (6 - 30) / 4.0);
+
+    test_same_as_runtime(x, x * constant(4) + constant(10), y, {"y"}, {50});
+    test_same_as_runtime(y, var<'Y'>() + y, constant(500), {"Y"}, {125});
+    test_same_as_runtime(x, (x + y) * zz - constant(3), y / constant(2), {"y", "zz"}, {6, 3});
+}
+
+} // unnamed namespace
+
+void static_solve_test() {
+    test_runtime();
+}
@@ -0,0 +1,102 @@
+#include "templates.h"
+#include <cmath>
+
+bool is_param(const std::string& name) {
+    return !name.empty() && name[0] == '$';
+}
+
+expr_ptr abstract_constants(const expr& e, std::vector<double>& params) {
+    auto m =
+        or_m(const_m([&](double c) {
+                if (c == 0.0 || c == 1.0) {
+                    return constant(c);
+                }
+                params.push_back(c);
+                return var("$" + std::to_string(params.size() - 1));
+            }),
+            neg_m([&](const expr& ne) { return -abstract_constants(ne, params); }),
+            bin_op_m([&](char op, const expr& lhs, const expr& rhs) {
+                auto l = abstract_constants(lhs, params);
+                return do_op(op, std::move(l), abstract_constants(rhs, params));
+            }),
+            [&](const expr& e) { return e.clone(); });
+    return m(e);
+}
+
+expr_ptr substitute_params(const expr& e, const std::vector<double>& params) {
+    auto m =
+        or_m(var_m([&](const std::string& name) {
+                return is_param(name) ? constant(params[std::stoul(name.substr(1))]) : var(name);
+            }),
+            neg_m([&](const expr& ne) { return -substitute_params(ne, params); }),
+            bin_op_m([&](char op, const expr& lhs, const expr& rhs) {
+                return do_op(op, substitute_params(lhs, params), substitute_params(rhs, params));
+            }),
+            [&](const expr& e) { return e.clone(); });
+    return m(e);
+}
+
+bool degenerate_instance(const expr& e) {
+    auto m =
+        or_m(const_m([&](double c) { return !std::isfinite(c); }),
+            neg_m([&](const expr& ne) { return degenerate_instance(ne); }),
+            bin_op_m([&](char op, const expr& lhs, const expr& rhs) {
+                return (op == '/' && match_const(rhs, 0.0)) || degenerate_instance(lhs) || degenerate_instance(rhs);
+            }),
+            [&](const expr&) { return false; });
+    return m(e);
+}
+
+template_cache::solution_map template_cache::solve_all(const expr& lhs, const expr& rhs, solve_status* status) {
+    std::vector<double> params;
+    job_type shape{abstract_constants(*simplify(lhs), params), abstract_constants(*simplify(rhs), params)};
+
+    auto it = cache_.find(shape);
+    if (it == cache_.end()) {
+        ++misses_;
+        shape_solutions solved{solution_map{}, solve_status::gave_up};
+        for (const auto& v : find_vars_in_expr(*shape.first)) {
+            if (!is_param(v)) solve_template(v, shape, solved);
+        }
+        for (const auto& v : find_vars_in_expr(*shape.second)) {
+            if (!is_param(v)) solve_template(v, shape, solved);
+        }
+        if (!solved.solutions.empty()) {
+            solved.status = solve_status::solved;
+        }
+        it = cache_.emplace(std::move(shape), std::move(solved)).first;
+    } else {
+        ++hits_;
+    }
+
+    solution_map res;
+    bool degenerate = false;
+    for (const auto& s : it->second.solutions) {
+        auto e = simplify(*substitute_params(*s.second, params));
+        degenerate |= degenerate_instance(*e);
+        res[s.first] = std::move(e);
+    }
+    // The constants may settle what their parameters couldn't, e.g. x+2=x
+    // has no solution but x+$0=x has one for $0=0
+    if (degenerate || it->second.status == solve_status::gave_up) {
+        return solver::solve_all(lhs, rhs, trace_, profile_, status);
+    }
+    if (status) *status = it->second.status;
+    return res;
+}
+
+void template_cache::solve_template(const std::string& v, const job_type& shape, shape_solutions& solved) {
+    if (solved.solutions.count(v) || solved.status != solve_status::gave_up) {
+        return;
+    }
+    solve_options options;
+    options.trace = trace_;
+    options.profile = profile_;
+    auto r = solver::solve(v, *shape.first, *shape.second, options);
+    if (r.solution) {
+        solved.solutions[v] = std::move(r.solution);
+    } else if (r.status == solve_status::no_solution || r.status == solve_status::any_value) {
+        // The same for every variable
+        solved.status = r.status;
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef SOLVE_TEMPLATES_H
+#define SOLVE_TEMPLATES_H
+
+#include <vector>
+#include "solver.h"
+
+// Equations that only differ in their constants are solved once with the
+// constants replaced by parameters. The parameterized solutions are cached
+// by the shape of the equation and instantiated by substituting the
+// constants back in.
+//
+// 0 and 1 are kept as part of the shape since simplify() treats them
+// specially. Parameters are named "$<index>", which the tokenizer never
+// produces as an identifier.
+
+bool is_param(const std::string& name);
+expr_ptr abstract_constants(const expr& e, std::vector<double>& params);
+expr_ptr substitute_params(const expr& e, const std::vector<double>& params);
+
+// True if e can't be trusted as an instantiated solution, i.e. the
+// parameter values hit a case the symbolic solution didn't account for
+bool degenerate_instance(const expr& e);
+
+class template_cache {
+public:
+    typedef std::map<std::string, expr_ptr> solution_map;
+
+    // Searches for new shapes write their steps to trace, unless it's null,
+    // and learn from and are guided by profile, unless it's null
+    explicit template_cache(std::ostream* trace = &std::cout, rule_profile* profile = nullptr) : hits_(0), misses_(0), trace_(trace), profile_(profile) {}
+
+    // Solve lhs = rhs for all of its variables, status as for
+    // solver::solve_all
+    solution_map solve_all(const expr& lhs, const expr& rhs, solve_status* status = nullptr);
+
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+
+private:
+    // A verdict on a shape holds for every instance of it, since dividing
+    // by a parameter makes verdicts untrusted like dividing by a variable
+    struct shape_solutions {
+        solution_map solutions;
+        solve_status status;
+    };
+
+    std::unordered_map<job_type, shape_solutions> cache_;
+    size_t                                     hits_;
+    size_t                                     misses_;
+    std::ostream*                              trace_;
+    rule_profile*                              profile_;
+
+    void solve_template(const std::string& v, const job_type& shape, shape_solutions& solved);
+};
+
+#endif
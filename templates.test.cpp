@@ -0,0 +1,52 @@
+#include "templates.h"
+#include <iostream>
+#include <assert.h>
+
+namespace {
+
+void test_template(template_cache& cache, const expr_ptr& lhs, const expr_ptr& rhs, const std::string& v, const expr_ptr& expected, bool expect_hit)
+{
+    const auto hits = cache.hits();
+    auto res = cache.solve_all(*lhs, *rhs);
+    auto it = res.find(v);
+    if (it != res.end() && it->second->equal(*expected) && (cache.hits() > hits) == expect_hit) {
+        return;
+    }
+    std::cout << "Template solve failed for '" << lhs << "'='" << rhs << "' for '" << v << "'\n";
+    std::cout << "Expected: " << expected << (expect_hit ? " (cached)" : "") << std::endl;
+    std::cout << "Got: ";
+    if (it != res.end()) std::cout << it->second;
+    std::cout << (cache.hits() > hits ? " (cached)" : "") << std::endl;
+    assert(false);
+}
+
+} // unnamed namespace
+
+void template_test()
+{
+    template_cache cache;
+    test_template(cache, var("X") * constant(42) + constant(300), constant(0) - constant(200), "X", constant(rational(-500, 42)), false);
+    test_template(cache, var("X") * constant(7) + constant(3), constant(0) - constant(11), "X", constant(-2), true);
+    test_template(cache, var("X") * constant(2) + constant(3), var("Y"), "X", (var("Y") - constant(3)) / constant(2), false);
+    test_template(cache, var("X") * constant(5) + constant(6), var("Y"), "X", (var("Y") - constant(6)) / constant(5), true);
+    // Constants folding to 0 change the shape
+    test_template(cache, (var("X") + constant(2)) * (constant(3) - constant(5)), var("Y"), "X", var("Y") / constant(-2) - constant(2), false);
+    test_template(cache, (var("X") + constant(2)) * (constant(3) - constant(3)), var("Y"), "Y", constant(0), false);
+    // The template solution zz = $1 / ($2 - $0) divides by zero, fall back to solving directly
+    test_template(cache, constant(5) + constant(60) / var("zz"), constant(8), "zz", constant(20), false);
+    const auto hits = cache.hits();
+    assert(!cache.solve_all(*(constant(3) + constant(60) / var("zz")), *constant(3)).count("zz"));
+    assert(cache.hits() == hits + 1);
+    assert(cache.misses() == 5);
+
+    // Verdicts are cached with the shape, or found on the instance when the
+    // shape's parameters leave them open
+    template_cache quiet{nullptr};
+    solve_status status;
+    assert(quiet.solve_all(*(var("x") + constant(1)), *var("x"), &status).empty() && status == solve_status::no_solution);
+    assert(quiet.solve_all(*(var("x") + constant(1)), *var("x"), &status).empty() && status == solve_status::no_solution);
+    assert(quiet.hits() == 1);
+    assert(quiet.solve_all(*(var("x") + constant(2)), *var("x"), &status).empty() && status == solve_status::no_solution);
+    assert(quiet.solve_all(*var("x"), *var("x"), &status).empty() && status == solve_status::any_value);
+    assert(quiet.solve_all(*(var("x") * constant(2)), *var("y"), &status).size() == 2 && status == solve_status::solved);
+}